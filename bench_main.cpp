@@ -0,0 +1,386 @@
+// Benchmark - Rule Engine Hot Paths
+// Times the public game_logic.h entry points (ns/op, percentiles, heap
+// allocations/op) on positions collected from seeded self-play, compares the
+// packed (8-bit lane) token checks against the scalar per-field path, and times
+// per-game setup. Function results can be saved and compared across runs.
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <map>
+#include <new>
+#include <sstream>
+#include "game_logic.h"
+
+using std::string;
+using std::vector;
+using std::cout;
+using std::cerr;
+using std::endl;
+using std::mt19937;
+
+// Heap allocations since start; bench is single-threaded. new[] and the nothrow
+// forms go through these in libstdc++.
+static long allocation_count = 0;
+
+void* operator new(size_t size) {
+    allocation_count++;
+    void* p = malloc(size ? size : 1);
+    if (!p) throw std::bad_alloc();
+    return p;
+}
+
+void operator delete(void* p) noexcept {
+    free(p);
+}
+
+// One affordability/noble check: a buyable card seen by the player to move
+struct TokenCheck {
+    const Card* card;
+    const Player* player;
+    const vector<Noble>* nobles;
+    PackedTokens packed_tokens;   // packed once per position, as generateMoves does
+    PackedTokens packed_bonuses;
+};
+
+// Play seeded random games and keep every position along the way
+static vector<GameState> collectPositions(int games, int max_plies) {
+    std::ostream null_os(nullptr);
+    vector<GameState> positions;
+    static MoveList moves;
+    for (int g = 1; g <= games; g++) {
+        GameState state;
+        initializeGame(state, g, builtinCards(), builtinNobles(), null_os);
+        mt19937 rng(g);
+        for (int ply = 0; ply < max_plies && !isGameOver(state); ply++) {
+            positions.push_back(state);
+            generateMoves(state, moves);
+            applyMove(state, toMove(moves.moves[rng() % moves.count], state.current_player), null_os);
+        }
+    }
+    return positions;
+}
+
+// Scalar path: one field at a time, as the rules were written originally
+static int scalarCheck(const TokenCheck& check) {
+    const Player& player = *check.player;
+    Tokens effective = check.card->getEffectiveCost(player.bonuses);
+    int shortfall = 0;
+    for (int c = 0; c < NUM_GEM_COLORS; c++) {
+        shortfall += std::max(0, effective[c] - player.tokens[c]);
+    }
+    if (shortfall > player.tokens[JOKER]) return 0;
+
+    Tokens bonuses = player.bonuses;
+    if (check.card->color < JOKER) bonuses[check.card->color]++;
+    int qualifying = 0;
+    for (const Noble& noble : *check.nobles) {
+        bool meets = true;
+        for (int c = 0; c < NUM_GEM_COLORS; c++) {
+            if (bonuses[c] < noble.requirements[c]) { meets = false; break; }
+        }
+        qualifying += meets;
+    }
+    return 1 + qualifying;
+}
+
+// Packed path: a handful of 64-bit operations per card and noble
+static int packedCheck(const TokenCheck& check) {
+    const Player& player = *check.player;
+    PackedTokens bonuses = check.packed_bonuses;
+    PackedTokens effective = packedEffectiveCost(check.card->packed_cost, bonuses);
+    if (packedJokerShortfall(effective, check.packed_tokens) > player.tokens[JOKER]) return 0;
+
+    if (check.card->color < JOKER) bonuses += packedLane(check.card->color);
+    int qualifying = 0;
+    for (const Noble& noble : *check.nobles) {
+        qualifying += packedCovers(bonuses, noble.packed_requirements);
+    }
+    return 1 + qualifying;
+}
+
+template <typename CheckFn>
+static double timeChecks(const vector<TokenCheck>& checks, int rounds, CheckFn fn, long& checksum) {
+    auto start = std::chrono::steady_clock::now();
+    long sum = 0;
+    for (int r = 0; r < rounds; r++) {
+        for (const TokenCheck& check : checks) sum += fn(check);
+    }
+    auto end = std::chrono::steady_clock::now();
+    checksum = sum;
+    std::chrono::duration<double, std::nano> elapsed = end - start;
+    return elapsed.count() / (double(checks.size()) * rounds);
+}
+
+// Per-game setup: a fresh state through initializeGame vs one state reused with resetGame
+static void benchSetup(int games) {
+    std::ostream null_os(nullptr);
+    const vector<Card>& cards = builtinCards();
+    const vector<Noble>& nobles = builtinNobles();
+    long checksum = 0;
+
+    auto start = std::chrono::steady_clock::now();
+    for (int g = 1; g <= games; g++) {
+        GameState state;
+        initializeGame(state, g, cards, nobles, null_os);
+        checksum += state.faceup_level1[0].id;
+    }
+    auto mid = std::chrono::steady_clock::now();
+    GameState reused;
+    for (int g = 1; g <= games; g++) {
+        resetGame(reused, g, cards, nobles);
+        checksum -= reused.faceup_level1[0].id;
+    }
+    auto end = std::chrono::steady_clock::now();
+
+    if (checksum != 0) cerr << "ERROR: initializeGame and resetGame dealt different games" << endl;
+    std::chrono::duration<double, std::micro> fresh_us = mid - start, reset_us = end - mid;
+    cout << "game setup" << endl;
+    cout << "  initializeGame (fresh state): " << fresh_us.count() / games << " us/game" << endl;
+    cout << "  resetGame (reused state):     " << reset_us.count() / games << " us/game" << endl;
+}
+
+// Keeps benchmarked results observable so the calls are not optimized away
+static volatile long bench_sink;
+
+struct FunctionResult {
+    string name;
+    long ops = 0;
+    double ns_per_op = 0;           // Total time / total ops
+    double p50 = 0, p90 = 0, p99 = 0;   // Over per-sample ns/op
+    double allocs_per_op = 0;
+};
+
+// Time run(i) for every sample i, `passes` times after one warm-up pass. run returns
+// the number of calls it made; prepare(i) runs untimed before it. Each sample is timed
+// as a whole, so the steady_clock overhead (~20 ns) is shared by that sample's calls.
+template <typename PrepareFn, typename RunFn>
+static FunctionResult benchFunction(const string& name, size_t samples, int passes, PrepareFn prepare, RunFn run) {
+    FunctionResult result;
+    result.name = name;
+    vector<double> per_op;
+    per_op.reserve(samples * passes);
+    double total_ns = 0;
+    long allocations = 0;
+    for (int pass = 0; pass <= passes; pass++) {
+        for (size_t i = 0; i < samples; i++) {
+            prepare(i);
+            long allocations_before = allocation_count;
+            auto start = std::chrono::steady_clock::now();
+            int ops = run(i);
+            auto end = std::chrono::steady_clock::now();
+            if (pass == 0 || ops == 0) continue;
+            long sample_allocations = allocation_count - allocations_before;
+            std::chrono::duration<double, std::nano> elapsed = end - start;
+            per_op.push_back(elapsed.count() / ops);
+            total_ns += elapsed.count();
+            allocations += sample_allocations;
+            result.ops += ops;
+        }
+    }
+    if (result.ops == 0) return result;
+    std::sort(per_op.begin(), per_op.end());
+    result.ns_per_op = total_ns / result.ops;
+    result.p50 = per_op[per_op.size() / 2];
+    result.p90 = per_op[per_op.size() * 9 / 10];
+    result.p99 = per_op[per_op.size() * 99 / 100];
+    result.allocs_per_op = (double)allocations / result.ops;
+    return result;
+}
+
+// Every public hot function, on the collected positions and their legal moves
+static vector<FunctionResult> benchFunctions(vector<GameState>& positions, int passes) {
+    std::ostream null_os(nullptr);
+    const vector<Card>& cards = builtinCards();
+    const vector<Noble>& nobles = builtinNobles();
+    vector<vector<Move>> moves(positions.size());
+    vector<vector<string>> move_strings(positions.size());
+    vector<string> jsons(positions.size());
+    for (size_t i = 0; i < positions.size(); i++) {
+        moves[i] = findAllValidMoves(positions[i]);
+        for (const Move& move : moves[i]) move_strings[i].push_back(moveToString(move));
+        jsons[i] = gameStateToJson(positions[i], positions[i].current_player + 1);
+    }
+
+    vector<FunctionResult> results;
+    size_t n = positions.size();
+    long sink = 0;
+    auto none = [](size_t) {};
+    results.push_back(benchFunction("validateMove", n, passes, none, [&](size_t i) {
+        for (const Move& move : moves[i]) sink += validateMove(positions[i], move).valid;
+        return (int)moves[i].size();
+    }));
+    // Timed with the undoMove that restores the position for the next call
+    results.push_back(benchFunction("applyMove+undoMove", n, passes, none, [&](size_t i) {
+        UndoRecord undo;
+        for (const Move& move : moves[i]) {
+            sink += applyMove(positions[i], move, undo, null_os).valid;
+            undoMove(positions[i], undo);
+        }
+        return (int)moves[i].size();
+    }));
+    results.push_back(benchFunction("findAllValidMoves", n, passes, none, [&](size_t i) {
+        sink += findAllValidMoves(positions[i]).size();
+        return 1;
+    }));
+    results.push_back(benchFunction("gameStateToJson", n, passes, none, [&](size_t i) {
+        sink += gameStateToJson(positions[i], positions[i].current_player + 1).size();
+        return 1;
+    }));
+    results.push_back(benchFunction("parseJson", n, passes, none, [&](size_t i) {
+        sink += parseJson(jsons[i], cards, nobles).move_number;
+        return 1;
+    }));
+    results.push_back(benchFunction("parseMove", n, passes, none, [&](size_t i) {
+        for (const string& text : move_strings[i]) sink += parseMove(text, positions[i].current_player).second.valid;
+        return (int)move_strings[i].size();
+    }));
+    results.push_back(benchFunction("moveToString", n, passes, none, [&](size_t i) {
+        for (const Move& move : moves[i]) sink += moveToString(move).size();
+        return (int)moves[i].size();
+    }));
+    results.push_back(benchFunction("validateGameState", n, passes, none, [&](size_t i) {
+        sink += validateGameState(positions[i]).valid;
+        return 1;
+    }));
+    // May grant a noble, so each call gets a fresh copy of the position
+    GameState scratch;
+    results.push_back(benchFunction("checkAndAssignNobles", n, passes,
+        [&](size_t i) { scratch = positions[i]; },
+        [&](size_t i) {
+            sink += checkAndAssignNobles(scratch, positions[i].current_player, -1, null_os);
+            return 1;
+        }));
+    bench_sink = sink;
+    return results;
+}
+
+// Tab-separated, one function per line
+static bool writeResults(const string& path, const vector<FunctionResult>& results) {
+    std::ofstream out(path.c_str());
+    out << "# function\tops\tns_per_op\tp50_ns\tp90_ns\tp99_ns\tallocs_per_op" << endl;
+    out << std::fixed << std::setprecision(2);
+    for (const FunctionResult& r : results) {
+        out << r.name << "\t" << r.ops << "\t" << r.ns_per_op << "\t" << r.p50 << "\t" << r.p90 << "\t" << r.p99
+            << "\t" << r.allocs_per_op << endl;
+    }
+    return (bool)out;
+}
+
+// ns/op and allocs/op by function name from an earlier results file
+static std::map<string, std::pair<double, double>> readResults(const string& path) {
+    std::map<string, std::pair<double, double>> baseline;
+    std::ifstream file(path.c_str());
+    string line;
+    while (std::getline(file, line)) {
+        if (line.empty() || line[0] == '#') continue;
+        std::istringstream fields(line);
+        string name;
+        long ops;
+        double ns_per_op, p50, p90, p99, allocs_per_op;
+        if (fields >> name >> ops >> ns_per_op >> p50 >> p90 >> p99 >> allocs_per_op) {
+            baseline[name] = std::make_pair(ns_per_op, allocs_per_op);
+        }
+    }
+    return baseline;
+}
+
+static void printResults(const vector<FunctionResult>& results,
+                         const std::map<string, std::pair<double, double>>& baseline) {
+    cout << std::fixed << std::setprecision(1);
+    cout << "game_logic functions (ns/op, percentiles over positions)" << endl;
+    cout << "  " << std::left << std::setw(22) << "function" << std::right << std::setw(10) << "ns/op"
+         << std::setw(10) << "p50" << std::setw(10) << "p90" << std::setw(10) << "p99" << std::setw(11) << "allocs/op";
+    if (!baseline.empty()) cout << std::setw(10) << "vs base";
+    cout << endl;
+    for (const FunctionResult& r : results) {
+        cout << "  " << std::left << std::setw(22) << r.name << std::right << std::setw(10) << r.ns_per_op
+             << std::setw(10) << r.p50 << std::setw(10) << r.p90 << std::setw(10) << r.p99
+             << std::setw(11) << std::setprecision(2) << r.allocs_per_op << std::setprecision(1);
+        auto it = baseline.find(r.name);
+        if (it != baseline.end() && it->second.first > 0) {
+            double change = 100.0 * (r.ns_per_op / it->second.first - 1.0);
+            cout << std::setw(9) << std::showpos << change << "%" << std::noshowpos;
+            if (std::abs(r.allocs_per_op - it->second.second) >= 0.005) {
+                cout << " (allocs " << std::setprecision(2) << it->second.second << std::setprecision(1) << ")";
+            }
+        }
+        cout << endl;
+    }
+}
+
+static void printUsage() {
+    cerr << "Usage: ./bench [games] [rounds] [--results FILE] [--baseline FILE]\n"
+         << "  games            Seeded self-play games to collect positions from (default 200)\n"
+         << "  rounds           Passes over the positions per measurement (default 50 for token checks;\n"
+         << "                   function timings use rounds / 10, at least 1)\n"
+         << "  --results FILE   Save the function timings as tab-separated values\n"
+         << "  --baseline FILE  Show the change in ns/op against an earlier --results file" << endl;
+}
+
+int main(int argc, char* argv[]) {
+    int games = 200;
+    int rounds = 50;
+    string results_path, baseline_path;
+    int positional = 0;
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        if (arg == "--results" && i + 1 < argc) {
+            results_path = argv[++i];
+        } else if (arg == "--baseline" && i + 1 < argc) {
+            baseline_path = argv[++i];
+        } else if (arg.compare(0, 2, "--") != 0 && positional < 2) {
+            (positional++ == 0 ? games : rounds) = atoi(arg.c_str());
+        } else {
+            printUsage();
+            return 1;
+        }
+    }
+
+    vector<GameState> positions = collectPositions(games, 200);
+    vector<TokenCheck> checks;
+    for (const GameState& state : positions) {
+        const Player& player = state.players[state.current_player];
+        PackedTokens packed_tokens = packTokens(player.tokens);
+        PackedTokens packed_bonuses = packTokens(player.bonuses);
+        for (const vector<Card>* row : {&state.faceup_level1, &state.faceup_level2, &state.faceup_level3, &player.reserved}) {
+            for (const Card& card : *row) {
+                if (card.id != 0) checks.push_back({&card, &player, &state.available_nobles, packed_tokens, packed_bonuses});
+            }
+        }
+    }
+    cerr << "Collected " << positions.size() << " positions, " << checks.size() << " card checks" << endl;
+
+    long scalar_sum = 0, packed_sum = 0;
+    double scalar_ns = timeChecks(checks, rounds, scalarCheck, scalar_sum);
+    double packed_ns = timeChecks(checks, rounds, packedCheck, packed_sum);
+
+    if (scalar_sum != packed_sum) {
+        cerr << "ERROR: packed and scalar checks disagree (" << scalar_sum << " vs " << packed_sum << ")" << endl;
+        return 1;
+    }
+
+    cout << std::fixed << std::setprecision(2);
+    cout << "token checks (effective cost + affordability + nobles)" << endl;
+    cout << "  scalar: " << scalar_ns << " ns/check" << endl;
+    cout << "  packed: " << packed_ns << " ns/check" << endl;
+    cout << "  speedup: " << (scalar_ns / packed_ns) << "x" << endl;
+
+    benchSetup(100000);
+
+    std::map<string, std::pair<double, double>> baseline;
+    if (!baseline_path.empty()) {
+        baseline = readResults(baseline_path);
+        if (baseline.empty()) cerr << "WARNING: No results read from " << baseline_path << endl;
+    }
+    vector<FunctionResult> results = benchFunctions(positions, std::max(1, rounds / 10));
+    printResults(results, baseline);
+    if (!results_path.empty() && !writeResults(results_path, results)) {
+        cerr << "ERROR: Cannot write " << results_path << endl;
+        return 1;
+    }
+    return 0;
+}
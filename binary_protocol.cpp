@@ -0,0 +1,196 @@
+#include "binary_protocol.h"
+#include <algorithm>
+#include <cstring>
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ != __ORDER_LITTLE_ENDIAN__
+#error "The binary protocol sends WireState in host layout and assumes a little-endian host"
+#endif
+
+using std::string;
+using std::vector;
+using std::to_string;
+
+static bool fitsByte(int value) {
+    return value >= 0 && value <= 255;
+}
+
+ValidationResult packWireState(const GameState& state, int viewer_id, WireState& out) {
+    memset(&out, 0, sizeof(out));
+    out.version = WIRE_STATE_VERSION;
+    out.active_player = (uint8_t)(state.current_player + 1);
+    out.you = (uint8_t)viewer_id;
+    out.move = (uint16_t)(state.move_number + 1);
+
+    for (int c = 0; c < NUM_TOKEN_COLORS; c++) {
+        if (!fitsByte(state.bank[c])) return ValidationResult(false, "Bank token count out of range");
+        out.bank[c] = (uint8_t)state.bank[c];
+    }
+    for (int level = 1; level <= 3; level++) {
+        const vector<Card>& faceup = state.getFaceup(level);
+        size_t deck_size = state.getDeck(level).size();
+        if (faceup.size() > (size_t)MAX_FACEUP) {
+            return ValidationResult(false, "Too many face-up level " + to_string(level) + " cards");
+        }
+        if (deck_size > 255) return ValidationResult(false, "Level " + to_string(level) + " deck too large");
+        for (size_t i = 0; i < faceup.size(); i++) out.faceup[level - 1][i] = (uint8_t)faceup[i].id;
+        out.faceup_size[level - 1] = (uint8_t)faceup.size();
+        out.deck_size[level - 1] = (uint8_t)deck_size;
+    }
+    if (state.available_nobles.size() > (size_t)MAX_NOBLES_IN_PLAY) return ValidationResult(false, "Too many nobles");
+    out.num_nobles = (uint8_t)state.available_nobles.size();
+    for (size_t i = 0; i < state.available_nobles.size(); i++) out.nobles[i] = (uint8_t)state.available_nobles[i].id;
+
+    for (int p = 0; p < 2; p++) {
+        const Player& player = state.players[p];
+        WirePlayer& wp = out.players[p];
+        if (player.reserved.size() > (size_t)MAX_RESERVED || player.cards.size() > (size_t)MAX_CARD_ID ||
+            player.nobles.size() > (size_t)MAX_NOBLES_IN_PLAY || !fitsByte(player.points)) {
+            return ValidationResult(false, "Player " + to_string(p + 1) + " does not fit the wire layout");
+        }
+        double ms = player.time_bank * 1000.0;
+        wp.time_bank_ms = (int32_t)std::max(-2147483647.0, std::min(2147483647.0, ms < 0 ? ms - 0.5 : ms + 0.5));
+        wp.points = (uint8_t)player.points;
+        for (int c = 0; c < NUM_TOKEN_COLORS; c++) {
+            if (!fitsByte(player.tokens[c])) return ValidationResult(false, "Player token count out of range");
+            wp.tokens[c] = (uint8_t)player.tokens[c];
+        }
+        for (int c = 0; c < NUM_GEM_COLORS; c++) {
+            if (!fitsByte(player.bonuses[c])) return ValidationResult(false, "Player bonus out of range");
+            wp.bonuses[c] = (uint8_t)player.bonuses[c];
+        }
+
+        // Mask the opponent's reserved cards as 91/92/93 by level, as the JSON state does
+        bool masked = viewer_id != 0 && viewer_id != p + 1;
+        wp.num_reserved = (uint8_t)player.reserved.size();
+        for (size_t i = 0; i < player.reserved.size(); i++) {
+            wp.reserved[i] = (uint8_t)(masked ? 90 + player.reserved[i].level : player.reserved[i].id);
+        }
+        wp.num_cards = (uint8_t)player.cards.size();
+        for (size_t i = 0; i < player.cards.size(); i++) wp.cards[i] = (uint8_t)player.cards[i].id;
+        wp.num_nobles = (uint8_t)player.nobles.size();
+        for (size_t i = 0; i < player.nobles.size(); i++) wp.nobles[i] = (uint8_t)player.nobles[i].id;
+    }
+    return ValidationResult(true);
+}
+
+static bool findNoble(int id, const vector<Noble>& all_nobles, vector<Noble>& out) {
+    for (const Noble& noble : all_nobles) {
+        if (noble.id == id) {
+            out.push_back(noble);
+            return true;
+        }
+    }
+    return false;
+}
+
+ValidationResult unpackWireState(const WireState& wire, const vector<Card>& all_cards,
+                                 const vector<Noble>& all_nobles, GameState& out) {
+    if (wire.version != WIRE_STATE_VERSION) {
+        return ValidationResult(false, "Unsupported wire state version " + to_string(wire.version));
+    }
+    if (wire.active_player != 1 && wire.active_player != 2) return ValidationResult(false, "Invalid active player");
+
+    out = GameState();
+    out.current_player = wire.active_player - 1;
+    out.move_number = wire.move - 1;
+    for (int c = 0; c < NUM_TOKEN_COLORS; c++) out.bank[c] = wire.bank[c];
+
+    for (int level = 1; level <= 3; level++) {
+        if (wire.faceup_size[level - 1] > MAX_FACEUP) return ValidationResult(false, "Invalid face-up count");
+        vector<Card>& faceup = out.getFaceup(level);
+        for (int i = 0; i < wire.faceup_size[level - 1]; i++) {
+            int id = wire.faceup[level - 1][i];
+            Card card = (id == 0) ? Card{0, level, 0, NO_COLOR, {}, 0} : loadCardById(id, all_cards);
+            if (id != 0 && card.id == 0) return ValidationResult(false, "Unknown card id " + to_string(id));
+            faceup.push_back(card);
+        }
+        out.getDeck(level).assign(wire.deck_size[level - 1], Card{0, level, 0, NO_COLOR, {}, 0});
+    }
+    if (wire.num_nobles > MAX_NOBLES_IN_PLAY) return ValidationResult(false, "Invalid noble count");
+    for (int i = 0; i < wire.num_nobles; i++) {
+        if (!findNoble(wire.nobles[i], all_nobles, out.available_nobles)) {
+            return ValidationResult(false, "Unknown noble id " + to_string(wire.nobles[i]));
+        }
+    }
+
+    for (int p = 0; p < 2; p++) {
+        const WirePlayer& wp = wire.players[p];
+        Player& player = out.players[p];
+        if (wp.num_reserved > MAX_RESERVED || wp.num_cards > MAX_CARD_ID || wp.num_nobles > MAX_NOBLES_IN_PLAY) {
+            return ValidationResult(false, "Invalid card counts for player " + to_string(p + 1));
+        }
+        player.time_bank = wp.time_bank_ms / 1000.0;
+        player.points = wp.points;
+        for (int c = 0; c < NUM_TOKEN_COLORS; c++) player.tokens[c] = wp.tokens[c];
+        for (int c = 0; c < NUM_GEM_COLORS; c++) player.bonuses[c] = wp.bonuses[c];
+        for (int i = 0; i < wp.num_reserved; i++) {
+            int id = wp.reserved[i];
+            Card card = (id >= 91 && id <= 93) ? Card{id, id - 90, 0, NO_COLOR, {}, 0} : loadCardById(id, all_cards);
+            if (card.id == 0) return ValidationResult(false, "Unknown card id " + to_string(id));
+            player.reserved.push_back(card);
+        }
+        for (int i = 0; i < wp.num_cards; i++) {
+            Card card = loadCardById(wp.cards[i], all_cards);
+            if (card.id == 0) return ValidationResult(false, "Unknown card id " + to_string(wp.cards[i]));
+            player.cards.push_back(card);
+        }
+        for (int i = 0; i < wp.num_nobles; i++) {
+            if (!findNoble(wp.nobles[i], all_nobles, player.nobles)) {
+                return ValidationResult(false, "Unknown noble id " + to_string(wp.nobles[i]));
+            }
+        }
+    }
+    out.zobrist_key = computeZobristKey(out);
+    return ValidationResult(true);
+}
+
+void appendFrame(string& out, FrameType type, uint8_t id, const void* payload, uint32_t size) {
+    unsigned char header[FRAME_HEADER_SIZE] = {
+        (unsigned char)(size & 0xFF), (unsigned char)((size >> 8) & 0xFF),
+        (unsigned char)((size >> 16) & 0xFF), (unsigned char)((size >> 24) & 0xFF),
+        (unsigned char)type, id
+    };
+    out.append(reinterpret_cast<const char*>(header), FRAME_HEADER_SIZE);
+    out.append(static_cast<const char*>(payload), size);
+}
+
+void decodeFrameHeader(const unsigned char* header, uint32_t& size, uint8_t& type, uint8_t& id) {
+    size = (uint32_t)header[0] | ((uint32_t)header[1] << 8) | ((uint32_t)header[2] << 16) | ((uint32_t)header[3] << 24);
+    type = header[4];
+    id = header[5];
+}
+
+void writeFrame(std::ostream& os, FrameType type, uint8_t id, const void* payload, uint32_t size) {
+    string frame;
+    appendFrame(frame, type, id, payload, size);
+    os.write(frame.data(), frame.size());
+}
+
+bool readFrame(std::istream& is, uint8_t& type, uint8_t& id, string& payload) {
+    unsigned char header[FRAME_HEADER_SIZE];
+    if (!is.read(reinterpret_cast<char*>(header), FRAME_HEADER_SIZE)) return false;
+    uint32_t size;
+    decodeFrameHeader(header, size, type, id);
+    if (size > MAX_FRAME_PAYLOAD) return false;
+    payload.resize(size);
+    return size == 0 || (bool)is.read(&payload[0], size);
+}
+
+std::pair<Move, ValidationResult> parseMoveFrame(uint8_t type, const string& payload, int player_id) {
+    Move move;
+    move.type = INVALID_MOVE;
+    move.player_id = player_id;
+    if (type != FRAME_MOVE) {
+        return std::make_pair(move, ValidationResult(false, "Expected a MOVE frame, got type " + to_string(type)));
+    }
+    if (payload.size() != sizeof(uint32_t)) {
+        return std::make_pair(move, ValidationResult(false, "MOVE frame payload must be 4 bytes"));
+    }
+    const unsigned char* bytes = reinterpret_cast<const unsigned char*>(payload.data());
+    uint32_t code = (uint32_t)bytes[0] | ((uint32_t)bytes[1] << 8) | ((uint32_t)bytes[2] << 16) | ((uint32_t)bytes[3] << 24);
+    CompactMove cm = decodeMove(code);
+    if (code == NO_ENCODED_MOVE || cm.type >= INVALID_MOVE) {
+        return std::make_pair(move, ValidationResult(false, "Invalid move code " + to_string(code)));
+    }
+    return std::make_pair(toMove(cm, player_id), ValidationResult(true));
+}
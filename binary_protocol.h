@@ -0,0 +1,86 @@
+#ifndef BINARY_PROTOCOL_H
+#define BINARY_PROTOCOL_H
+
+#include <cstdint>
+#include <string>
+#include <type_traits>
+#include <vector>
+#include "game_logic.h"
+
+// Opt-in binary referee <-> engine protocol.
+//
+// Handshake: the referee sends the line BINARY_HANDSHAKE. The peer answers with the
+// same line to switch to binary frames, or with JSON_HANDSHAKE to keep JSON lines.
+//
+// Frames: [u32 payload length][u8 FrameType][u8 viewer/player id][payload].
+// Integers are little-endian, and the payload of a STATE frame is a WireState, so on
+// little-endian hosts an engine can read() a state frame straight into a WireState.
+//   STATE   referee -> engine   viewer 1/2, payload WireState
+//   MOVE    engine -> referee   player 1/2, payload u32 encodeMove() code
+//   RESULT  referee -> peer     viewer 0, payload the text lines the JSON mode prints
+
+const char* const BINARY_HANDSHAKE = "PROTOCOL BINARY 1";
+const char* const JSON_HANDSHAKE = "PROTOCOL JSON";
+
+enum FrameType : uint8_t {
+    FRAME_STATE = 1,
+    FRAME_MOVE = 2,
+    FRAME_RESULT = 3
+};
+
+const int FRAME_HEADER_SIZE = 6;
+const uint32_t MAX_FRAME_PAYLOAD = 1 << 16;
+const uint8_t WIRE_STATE_VERSION = 1;
+
+// One player as seen by the viewer (opponent reserves masked as 91/92/93)
+struct WirePlayer {
+    int32_t time_bank_ms;
+    uint8_t points;
+    uint8_t tokens[6];                       // Indexed by Color
+    uint8_t bonuses[5];
+    uint8_t num_reserved;
+    uint8_t num_cards;
+    uint8_t num_nobles;
+    uint8_t reserved[MAX_RESERVED];
+    uint8_t nobles[MAX_NOBLES_IN_PLAY];
+    uint8_t cards[MAX_CARD_ID];              // Purchased card IDs, in purchase order
+    uint8_t padding;
+};
+
+// Everything the JSON state carries, in a fixed 268-byte layout
+struct WireState {
+    uint8_t version;                         // WIRE_STATE_VERSION
+    uint8_t active_player;                   // 1 or 2
+    uint8_t you;                             // Viewer: 1, 2 (0 = god view)
+    uint8_t num_nobles;
+    uint16_t move;                           // 1-indexed, as in JSON
+    uint8_t bank[6];
+    uint8_t faceup[3][MAX_FACEUP];           // Card IDs (0 = empty slot)
+    uint8_t faceup_size[3];
+    uint8_t deck_size[3];
+    uint8_t nobles[MAX_NOBLES_IN_PLAY];      // Available noble IDs
+    uint8_t padding[3];
+    WirePlayer players[2];
+};
+
+static_assert(std::is_trivially_copyable<WireState>::value, "WireState must be trivially copyable");
+static_assert(sizeof(WirePlayer) == 116 && sizeof(WireState) == 268, "WireState layout must not change");
+
+// Fill a WireState for one viewer; fails if the state does not fit the fixed layout
+ValidationResult packWireState(const GameState& state, int viewer_id, WireState& out);
+// Rebuild a GameState from a WireState (hidden decks become placeholder cards)
+ValidationResult unpackWireState(const WireState& wire, const std::vector<Card>& all_cards,
+                                 const std::vector<Noble>& all_nobles, GameState& out);
+
+// Append one frame (header + payload) to out
+void appendFrame(std::string& out, FrameType type, uint8_t id, const void* payload, uint32_t size);
+void decodeFrameHeader(const unsigned char* header, uint32_t& size, uint8_t& type, uint8_t& id);
+
+void writeFrame(std::ostream& os, FrameType type, uint8_t id, const void* payload, uint32_t size);
+// Read one frame; the payload buffer is reused between calls. False on EOF or oversized frames.
+bool readFrame(std::istream& is, uint8_t& type, uint8_t& id, std::string& payload);
+
+// Decode a MOVE frame for player_id (0-indexed), the binary counterpart of parseMove
+std::pair<Move, ValidationResult> parseMoveFrame(uint8_t type, const std::string& payload, int player_id);
+
+#endif // BINARY_PROTOCOL_H
@@ -0,0 +1,239 @@
+#include "game_archive.h"
+#include <algorithm>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ != __ORDER_LITTLE_ENDIAN__
+#error "Game archives are written in host layout and assume a little-endian host"
+#endif
+
+using std::string;
+using std::vector;
+using std::to_string;
+
+static void padTo8(string& buffer, uint64_t offset) {
+    while ((offset + buffer.size()) % 8 != 0) buffer.push_back('\0');
+}
+
+static bool idsInRange(const uint8_t* ids, int count, int max_id) {
+    for (int i = 0; i < count; i++) {
+        if (ids[i] > max_id) return false;
+    }
+    return true;
+}
+
+// unpackGameState trusts its input: every count must fit its array and every ID
+// must index the CardTable (reserved slots also hold 91-93 for blind reserves)
+static bool checkpointInRange(const CompactState& packed) {
+    for (int l = 0; l < 3; l++) {
+        if (packed.faceup_size[l] > MAX_FACEUP || packed.deck_size[l] > MAX_DECK_SIZE ||
+            !idsInRange(packed.faceup[l], packed.faceup_size[l], MAX_CARD_ID) ||
+            !idsInRange(packed.deck[l], packed.deck_size[l], MAX_CARD_ID)) {
+            return false;
+        }
+    }
+    if (packed.num_nobles > MAX_NOBLES_IN_PLAY || !idsInRange(packed.nobles, packed.num_nobles, MAX_NOBLE_ID) ||
+        packed.current_player > 1) {
+        return false;
+    }
+    for (const CompactPlayer& player : packed.players) {
+        if (player.num_cards > MAX_CARD_ID || player.num_reserved > MAX_RESERVED ||
+            player.num_nobles > MAX_NOBLES_IN_PLAY || !idsInRange(player.cards, player.num_cards, MAX_CARD_ID) ||
+            !idsInRange(player.reserved, player.num_reserved, MAX_CARD_ID + 3) ||
+            !idsInRange(player.nobles, player.num_nobles, MAX_NOBLE_ID)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+ValidationResult GameArchiveWriter::open(const string& path, const vector<Card>& all_cards,
+                                         const vector<Noble>& all_nobles, uint32_t checkpoint_interval) {
+    if (file.is_open()) return ValidationResult(false, "Archive already open");
+    file.open(path.c_str(), std::ios::out | std::ios::trunc | std::ios::binary);
+    if (!file.is_open()) return ValidationResult(false, "Cannot create " + path);
+    cards = all_cards;
+    nobles = all_nobles;
+    header = ArchiveHeader();
+    memcpy(header.magic, GAME_ARCHIVE_MAGIC, 4);
+    header.version = GAME_ARCHIVE_VERSION;
+    header.compact_state_size = sizeof(CompactState);
+    header.checkpoint_interval = checkpoint_interval;
+    header.card_set_hash = cardSetHash(cards, nobles);
+    games.clear();
+    seeds.clear();
+
+    // Written again with the index offsets by close()
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    offset = sizeof(header);
+    return file ? ValidationResult(true) : ValidationResult(false, "Cannot write " + path);
+}
+
+ValidationResult GameArchiveWriter::add(const GameRecord& record) {
+    if (!file.is_open()) return ValidationResult(false, "Archive not open");
+    if (record.card_set_hash != header.card_set_hash) {
+        return ValidationResult(false, "Record was dealt from a different card set");
+    }
+    buffer.clear();
+    encodeGameRecord(record, buffer);
+    ArchiveGameEntry entry = ArchiveGameEntry();
+    entry.record_offset = offset;
+    entry.record_size = (uint32_t)buffer.size();
+    padTo8(buffer, offset);
+    entry.checkpoint_offset = offset + buffer.size();
+
+    // Checkpoints after every interval plies; the opening is dealt from the record
+    uint32_t interval = header.checkpoint_interval;
+    std::ostream null_os(nullptr);
+    CompactState packed;
+    ValidationResult packed_ok(true);
+    ValidationResult result = replayGameRecord(record, cards, nobles, state,
+        [&](const GameState& s, int ply) {
+            if (interval == 0 || ply == 0 || ply % interval != 0) return true;
+            packed_ok = packGameState(s, packed);
+            if (!packed_ok.valid) return false;
+            buffer.append(reinterpret_cast<const char*>(&packed), sizeof(packed));
+            entry.num_checkpoints++;
+            return true;
+        }, null_os);
+    if (result.valid) result = packed_ok;
+    if (!result.valid) return ValidationResult(false, "Game " + to_string(games.size()) + ": " + result.error_message);
+
+    file.write(buffer.data(), buffer.size());
+    if (!file) return ValidationResult(false, "Write failed");
+    offset += buffer.size();
+    if (!record.explicit_deal) seeds.push_back(ArchiveSeedEntry{record.seed.value, (uint64_t)games.size()});
+    games.push_back(entry);
+    return ValidationResult(true);
+}
+
+ValidationResult GameArchiveWriter::close() {
+    if (!file.is_open()) return ValidationResult(true);
+    std::sort(seeds.begin(), seeds.end(), [](const ArchiveSeedEntry& a, const ArchiveSeedEntry& b) {
+        return a.seed != b.seed ? a.seed < b.seed : a.game_id < b.game_id;
+    });
+    header.num_games = games.size();
+    header.index_offset = offset;
+    header.seed_index_offset = offset + games.size() * sizeof(ArchiveGameEntry);
+    header.num_seed_entries = seeds.size();
+    file.write(reinterpret_cast<const char*>(games.data()), games.size() * sizeof(ArchiveGameEntry));
+    file.write(reinterpret_cast<const char*>(seeds.data()), seeds.size() * sizeof(ArchiveSeedEntry));
+    file.seekp(0);
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    bool ok = (bool)file;
+    file.close();
+    return ok ? ValidationResult(true) : ValidationResult(false, "Write failed");
+}
+
+ValidationResult GameArchive::open(const string& path, const vector<Card>& all_cards, const vector<Noble>& all_nobles) {
+    close();
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return ValidationResult(false, "Cannot open " + path);
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(ArchiveHeader)) {
+        ::close(fd);
+        return ValidationResult(false, path + " is not a game archive");
+    }
+    void* mapped = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (mapped == MAP_FAILED) return ValidationResult(false, "Cannot map " + path);
+    // Lookups jump between games; don't read ahead
+    madvise(mapped, st.st_size, MADV_RANDOM);
+    data = static_cast<const char*>(mapped);
+    size = st.st_size;
+
+    memcpy(&header, data, sizeof(header));
+    string error;
+    if (memcmp(header.magic, GAME_ARCHIVE_MAGIC, 4) != 0) {
+        error = path + " is not a game archive";
+    } else if (header.version != GAME_ARCHIVE_VERSION) {
+        error = "Unsupported archive version " + to_string(header.version);
+    } else if (header.compact_state_size != sizeof(CompactState)) {
+        error = "Archive checkpoints were written by a build with a different CompactState layout";
+    } else if (header.card_set_hash != cardSetHash(all_cards, all_nobles)) {
+        error = "Archive was dealt from a different card set";
+    } else if (header.index_offset % 8 != 0 || header.index_offset > size ||
+               header.num_games > (size - header.index_offset) / sizeof(ArchiveGameEntry) ||
+               header.seed_index_offset != header.index_offset + header.num_games * sizeof(ArchiveGameEntry) ||
+               header.num_seed_entries > (size - header.seed_index_offset) / sizeof(ArchiveSeedEntry)) {
+        error = "Corrupt archive index";
+    }
+    if (!error.empty()) {
+        close();
+        return ValidationResult(false, error);
+    }
+    games = reinterpret_cast<const ArchiveGameEntry*>(data + header.index_offset);
+    seeds = reinterpret_cast<const ArchiveSeedEntry*>(data + header.seed_index_offset);
+    cards = all_cards;
+    nobles = all_nobles;
+    table = buildCardTable(cards, nobles);
+    return ValidationResult(true);
+}
+
+void GameArchive::close() {
+    if (data) munmap(const_cast<char*>(data), size);
+    data = nullptr;
+    size = 0;
+    header = ArchiveHeader();
+    games = nullptr;
+    seeds = nullptr;
+}
+
+ValidationResult GameArchive::readRecord(uint64_t game_id, GameRecord& out) const {
+    if (game_id >= header.num_games) return ValidationResult(false, "No game " + to_string(game_id));
+    const ArchiveGameEntry& entry = games[game_id];
+    if (entry.record_offset > header.index_offset || entry.record_size > header.index_offset - entry.record_offset) {
+        return ValidationResult(false, "Corrupt index entry for game " + to_string(game_id));
+    }
+    size_t consumed;
+    return decodeGameRecord(data + entry.record_offset, entry.record_size, out, consumed);
+}
+
+vector<uint64_t> GameArchive::findBySeed(uint64_t seed) const {
+    vector<uint64_t> ids;
+    const ArchiveSeedEntry* end = seeds + header.num_seed_entries;
+    const ArchiveSeedEntry* it = std::lower_bound(seeds, end, seed,
+        [](const ArchiveSeedEntry& entry, uint64_t value) { return entry.seed < value; });
+    for (; it != end && it->seed == seed; ++it) ids.push_back(it->game_id);
+    return ids;
+}
+
+ValidationResult GameArchive::materialize(uint64_t game_id, int ply, GameState& out) const {
+    GameRecord record;
+    ValidationResult result = readRecord(game_id, record);
+    if (!result.valid) return result;
+    if (ply < 0 || ply > (int)record.moves.size()) {
+        return ValidationResult(false, "Game " + to_string(game_id) + " has " + to_string(record.moves.size()) + " plies");
+    }
+
+    const ArchiveGameEntry& entry = games[game_id];
+    int start = 0;
+    uint32_t checkpoint = header.checkpoint_interval ? std::min<uint32_t>(ply / header.checkpoint_interval,
+                                                                        entry.num_checkpoints) : 0;
+    if (checkpoint > 0) {
+        uint64_t at = entry.checkpoint_offset + (uint64_t)(checkpoint - 1) * sizeof(CompactState);
+        if (at > header.index_offset || header.index_offset - at < sizeof(CompactState)) {
+            return ValidationResult(false, "Corrupt checkpoint for game " + to_string(game_id));
+        }
+        CompactState packed;
+        memcpy(&packed, data + at, sizeof(packed));
+        if (!checkpointInRange(packed)) {
+            return ValidationResult(false, "Corrupt checkpoint for game " + to_string(game_id));
+        }
+        unpackGameState(packed, table, out);
+        start = checkpoint * header.checkpoint_interval;
+    } else {
+        result = startReplay(record, cards, nobles, out);
+        if (!result.valid) return result;
+    }
+
+    std::ostream null_os(nullptr);
+    for (int p = start; p < ply; p++) {
+        result = replayMove(record, p, cards, out, null_os);
+        if (!result.valid) return result;
+    }
+    return ValidationResult(true);
+}
@@ -0,0 +1,115 @@
+#ifndef GAME_ARCHIVE_H
+#define GAME_ARCHIVE_H
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+#include "game_logic.h"
+#include "game_record.h"
+
+// Indexed, memory-mapped archive of game records (POSIX only).
+//
+// Games are numbered in the order they were added. Each game's record
+// (game_record.h) is followed by a CompactState checkpoint every
+// checkpoint_interval plies, so any (game, ply) position is rebuilt from the
+// nearest checkpoint with at most checkpoint_interval - 1 replayed moves,
+// without touching other games. After the games come the game index and a
+// seed index sorted by seed.
+//
+// File layout (host byte order, little-endian only; 8-byte aligned):
+//   ArchiveHeader
+//   per game: record, padded to 8 bytes, then its CompactState checkpoints
+//   ArchiveGameEntry[num_games]
+//   ArchiveSeedEntry[num_seed_entries]
+//
+// Checkpoints are raw CompactStates, so an archive is only readable by builds
+// with the same CompactState layout (checked through compact_state_size).
+
+const char GAME_ARCHIVE_MAGIC[4] = {'S', 'P', 'G', 'A'};
+const uint32_t GAME_ARCHIVE_VERSION = 1;
+const uint32_t DEFAULT_CHECKPOINT_INTERVAL = 64;
+
+struct ArchiveHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t compact_state_size;        // sizeof(CompactState) of the writer
+    uint32_t checkpoint_interval;       // Plies between checkpoints (0 = none)
+    uint64_t num_games;
+    uint64_t index_offset;
+    uint64_t seed_index_offset;
+    uint64_t num_seed_entries;          // Seeded games only; explicit deals have no seed
+    uint64_t card_set_hash;
+    uint64_t reserved;
+};
+
+struct ArchiveGameEntry {
+    uint64_t record_offset;
+    uint32_t record_size;
+    uint32_t num_checkpoints;           // After plies interval, 2 * interval, ...
+    uint64_t checkpoint_offset;
+};
+
+struct ArchiveSeedEntry {
+    uint64_t seed;
+    uint64_t game_id;
+};
+
+static_assert(sizeof(ArchiveHeader) == 64, "ArchiveHeader layout");
+static_assert(sizeof(ArchiveGameEntry) == 24, "ArchiveGameEntry layout");
+static_assert(sizeof(CompactState) % 8 == 0, "Checkpoints must keep 8-byte alignment");
+
+// Builds an archive in one pass; the indexes are written by close()
+struct GameArchiveWriter {
+    GameArchiveWriter() = default;
+    ~GameArchiveWriter() { close(); }
+    GameArchiveWriter(const GameArchiveWriter&) = delete;
+    GameArchiveWriter& operator=(const GameArchiveWriter&) = delete;
+
+    ValidationResult open(const std::string& path, const std::vector<Card>& cards, const std::vector<Noble>& nobles,
+                          uint32_t checkpoint_interval = DEFAULT_CHECKPOINT_INTERVAL);
+    // Replay the record to take its checkpoints, then append it
+    ValidationResult add(const GameRecord& record);
+    ValidationResult close();
+
+    std::ofstream file;
+    std::vector<Card> cards;
+    std::vector<Noble> nobles;
+    ArchiveHeader header;
+    uint64_t offset = 0;                // Bytes written so far
+    std::vector<ArchiveGameEntry> games;
+    std::vector<ArchiveSeedEntry> seeds;
+    std::string buffer;                 // Reused per game
+    GameState state;
+};
+
+// Read-only view of an archive. All lookups are const and safe to call from
+// several threads at once.
+struct GameArchive {
+    GameArchive() = default;
+    ~GameArchive() { close(); }
+    GameArchive(const GameArchive&) = delete;
+    GameArchive& operator=(const GameArchive&) = delete;
+
+    // Map the file and check its header and indexes against the card/noble set
+    ValidationResult open(const std::string& path, const std::vector<Card>& cards, const std::vector<Noble>& nobles);
+    void close();
+
+    uint64_t numGames() const { return header.num_games; }
+    ValidationResult readRecord(uint64_t game_id, GameRecord& out) const;
+    // IDs of the seeded games dealt from seed (either seed mode), in game order
+    std::vector<uint64_t> findBySeed(uint64_t seed) const;
+    // The position after `ply` moves of a game (0 = opening)
+    ValidationResult materialize(uint64_t game_id, int ply, GameState& out) const;
+
+    const char* data = nullptr;
+    size_t size = 0;
+    ArchiveHeader header = ArchiveHeader();
+    const ArchiveGameEntry* games = nullptr;
+    const ArchiveSeedEntry* seeds = nullptr;
+    std::vector<Card> cards;
+    std::vector<Noble> nobles;
+    CardTable table;
+};
+
+#endif // GAME_ARCHIVE_H
@@ -0,0 +1,154 @@
+#include "game_log.h"
+#include <cstdio>
+
+using std::string;
+
+GameLog::GameLog(size_t max_pending_bytes) : max_pending(max_pending_bytes) {
+    pending.reserve(max_pending);
+}
+
+ValidationResult GameLog::open(const string& path) {
+    if (isOpen()) return ValidationResult(false, "Log already open");
+    file.open(path.c_str(), std::ios::out | std::ios::trunc | std::ios::binary);
+    if (!file.is_open()) return ValidationResult(false, "Cannot open log file " + path);
+    closing = false;
+    failed = false;
+    writer = std::thread(&GameLog::writerLoop, this);
+    return ValidationResult(true);
+}
+
+void GameLog::append(const string& record) {
+    if (!isOpen()) return;
+    std::unique_lock<std::mutex> lock(mutex);
+    // A record larger than the whole budget still goes through once the buffer is empty
+    has_room.wait(lock, [&] { return pending.empty() || pending.size() + record.size() < max_pending; });
+    bool was_empty = pending.empty();
+    pending.append(record);
+    pending.push_back('\n');
+    lock.unlock();
+    if (was_empty) has_data.notify_one();
+}
+
+void GameLog::writerLoop() {
+    string batch;
+    batch.reserve(max_pending);
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+        has_data.wait(lock, [&] { return !pending.empty() || closing; });
+        if (pending.empty()) break;
+        batch.swap(pending);
+        lock.unlock();
+        has_room.notify_all();
+
+        // Flushed per batch so a crashed referee still leaves every record written so far
+        file.write(batch.data(), batch.size());
+        file.flush();
+        bool ok = (bool)file;
+        batch.clear();
+
+        lock.lock();
+        if (!ok) failed = true;
+    }
+}
+
+bool GameLog::close() {
+    if (!isOpen()) return !failed;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        closing = true;
+    }
+    has_data.notify_one();
+    writer.join();
+    file.close();
+    return !failed;
+}
+
+// Engine-supplied text is copied into the log, so quote and escape it
+static void putJsonString(const string& s, JsonBuffer& out) {
+    out.put('"');
+    for (unsigned char c : s) {
+        if (c == '"' || c == '\\') {
+            out.put('\\');
+            out.put((char)c);
+        } else if (c < 0x20) {
+            char buf[8];
+            snprintf(buf, sizeof(buf), "\\u%04x", c);
+            out.put(buf);
+        } else {
+            out.put((char)c);
+        }
+    }
+    out.put('"');
+}
+
+static void putUint64(uint64_t value, JsonBuffer& out) {
+    char buf[24];
+    snprintf(buf, sizeof(buf), "%llu", (unsigned long long)value);
+    out.put(buf);
+}
+
+void writeLogStartRecord(const GameState& state, SeedMode seed_mode, bool binary, JsonBuffer& out) {
+    out.clear();
+    out.put("{\"type\":\"start\",\"version\":1,\"seed_mode\":");
+    out.put(seed_mode == SEED_SPLITMIX64 ? "\"splitmix64\"" : "\"mt19937\"");
+    out.put(",\"protocol\":");
+    out.put(binary ? "\"binary\"" : "\"json\"");
+    out.put(",\"time_bank\":");
+    out.putDouble(INITIAL_TIME_BANK);
+    out.put(",\"increment\":");
+    out.putDouble(TIME_INCREMENT);
+    out.put(",\"state\":");
+    writeGameStateJson(state, 0, out);
+    out.put('}');
+}
+
+void writeLogMoveRecord(int ply, int player, const string& move, long think_us, double time_bank,
+                        const string& error, JsonBuffer& out, const MoveTiming* timing) {
+    out.clear();
+    out.put("{\"type\":\"move\",\"ply\":");
+    out.putInt(ply);
+    out.put(",\"player\":");
+    out.putInt(player);
+    out.put(",\"move\":");
+    putJsonString(move, out);
+    out.put(",\"think_us\":");
+    out.putInt(think_us);
+    out.put(",\"time_bank\":");
+    out.putDouble(time_bank);
+    if (timing) {
+        out.put(",\"serialize_ns\":");
+        out.putInt(timing->serialize_ns);
+        out.put(",\"write_ns\":");
+        out.putInt(timing->write_ns);
+        out.put(",\"read_ns\":");
+        out.putInt(timing->read_ns);
+    }
+    if (!error.empty()) {
+        out.put(",\"error\":");
+        putJsonString(error, out);
+    }
+    out.put('}');
+}
+
+void writeLogEndRecord(const GameState& state, int winner, const string& reason, uint64_t seed, JsonBuffer& out) {
+    out.clear();
+    out.put("{\"type\":\"end\",\"winner\":");
+    out.putInt(winner);
+    out.put(",\"reason\":");
+    putJsonString(reason, out);
+    out.put(",\"scores\":[");
+    out.putInt(state.players[0].points);
+    out.put(',');
+    out.putInt(state.players[1].points);
+    out.put("],\"moves\":");
+    out.putInt(state.move_number);
+    out.put(",\"seed\":");
+    putUint64(seed, out);
+    char hash[24];
+    snprintf(hash, sizeof(hash), "\"%016llx\"", (unsigned long long)state.zobrist_key);
+    out.put(",\"hash\":");
+    out.put(hash);
+    out.put(",\"state\":");
+    writeGameStateJson(state, 0, out);
+    out.put('}');
+}
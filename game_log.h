@@ -0,0 +1,71 @@
+#ifndef GAME_LOG_H
+#define GAME_LOG_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include "game_logic.h"
+#include "move_timing.h"
+
+// Per-game log written by a background thread.
+//
+// Records are JSON lines. append() copies a record into a pending buffer and
+// returns; the writer thread swaps that buffer out and writes it to the file,
+// so the game loop never waits on disk. The pending buffer is bounded: once it
+// holds max_pending_bytes, append() waits for the writer, so memory stays flat
+// however long the game runs.
+//
+// The file is readable while the game is running. Records written before the
+// end therefore carry only public information (moves and think times); the
+// seed, the Zobrist key (which hashes reserved cards) and the unmasked final
+// state go in the end record.
+struct GameLog {
+    explicit GameLog(size_t max_pending_bytes = 1 << 20);
+    ~GameLog() { close(); }
+    GameLog(const GameLog&) = delete;
+    GameLog& operator=(const GameLog&) = delete;
+
+    // Create or truncate the file and start the writer thread
+    ValidationResult open(const std::string& path);
+    bool isOpen() const { return writer.joinable(); }
+
+    // Queue one record; a newline is appended. Ignored when the log is not open.
+    void append(const std::string& record);
+
+    // Write everything queued, stop the writer and close the file.
+    // False if any write failed.
+    bool close();
+
+    size_t max_pending;
+    std::string pending;            // Filled by append(), swapped out by the writer
+    std::ofstream file;
+    std::thread writer;
+    std::mutex mutex;
+    std::condition_variable has_data;
+    std::condition_variable has_room;
+    bool closing = false;
+    bool failed = false;
+
+    void writerLoop();
+};
+
+// Record builders. Each clears out and writes one JSON object without the newline.
+
+// {"type":"start",...}: seed mode, protocol, clock settings and the opening god view
+void writeLogStartRecord(const GameState& state, SeedMode seed_mode, bool binary, JsonBuffer& out);
+
+// {"type":"move",...}: the move text as received, think time, the mover's bank after
+// the increment, and the error if the move was rejected. With a timing, also the
+// serialize_ns, write_ns and read_ns of the move (see move_timing.h).
+void writeLogMoveRecord(int ply, int player, const std::string& move, long think_us, double time_bank,
+                        const std::string& error, JsonBuffer& out, const MoveTiming* timing = nullptr);
+
+// {"type":"end",...}: winner (0 = tie), reason, scores, the seed, the final Zobrist
+// key (hex), and the god view
+void writeLogEndRecord(const GameState& state, int winner, const std::string& reason, uint64_t seed,
+                       JsonBuffer& out);
+
+#endif // GAME_LOG_H
@@ -5,9 +5,14 @@
 #include <string>
 #include <map>
 #include <algorithm>
+#include <chrono>
 #include <random>
 #include <sstream>
 #include <ctime>
+#include <cstdlib>
+#include <cstdio>
+#include <cstring>
+#include <climits>
 
 using std::string;
 using std::vector;
@@ -43,17 +48,35 @@ using std::atoi;
 // Global flag for setup/replay mode
 // MOVED TO GameState: bool state.replay_mode = false;
 
+// Protocol names for each Color (NO_COLOR has none)
+static const char* const COLOR_NAMES[] = {"black", "blue", "white", "green", "red", "joker", ""};
+
+const char* colorName(Color color) {
+    if (color < BLACK || color > NO_COLOR) return "";
+    return COLOR_NAMES[color];
+}
+
+bool parseColor(const string& name, Color& color) {
+    for (int c = 0; c < NUM_TOKEN_COLORS; c++) {
+        if (name == COLOR_NAMES[c]) {
+            color = static_cast<Color>(c);
+            return true;
+        }
+    }
+    return false;
+}
+
 // Game state validation - checks if current state is valid
 ValidationResult validateGameState(const GameState& state) {
     // 1. Check total gem counts (4 of each color + 5 joker = 25 total)
     Tokens total_gems = state.bank + state.players[0].tokens + state.players[1].tokens;
     
-    if (total_gems.black != 4) return ValidationResult(false, "Black gem count incorrect");
-    if (total_gems.blue != 4) return ValidationResult(false, "Blue gem count incorrect");
-    if (total_gems.white != 4) return ValidationResult(false, "White gem count incorrect");
-    if (total_gems.green != 4) return ValidationResult(false, "Green gem count incorrect");
-    if (total_gems.red != 4) return ValidationResult(false, "Red gem count incorrect");
-    if (total_gems.joker != 5) return ValidationResult(false, "Joker gem count incorrect");
+    if (total_gems[BLACK] != 4) return ValidationResult(false, "Black gem count incorrect");
+    if (total_gems[BLUE] != 4) return ValidationResult(false, "Blue gem count incorrect");
+    if (total_gems[WHITE] != 4) return ValidationResult(false, "White gem count incorrect");
+    if (total_gems[GREEN] != 4) return ValidationResult(false, "Green gem count incorrect");
+    if (total_gems[RED] != 4) return ValidationResult(false, "Red gem count incorrect");
+    if (total_gems[JOKER] != 5) return ValidationResult(false, "Joker gem count incorrect");
     
     // 2. Check no player has more than 10 gems
     for (int i = 0; i < 2; i++) {
@@ -103,7 +126,7 @@ ValidationResult validateGameState(const GameState& state) {
     for (int i = 0; i < 2; i++) {
         Tokens expected_bonuses;
         for (const Card& card : state.players[i].cards) {
-            expected_bonuses[card.color]++;
+            if (card.color < JOKER) expected_bonuses[card.color]++;
         }
         
         if (state.players[i].bonuses != expected_bonuses) {
@@ -188,6 +211,12 @@ pair<Move, ValidationResult> parseMove(const string& move_string, int player_id)
     }
     
     string action = tokens[0];
+
+    // Unknown color names are ignored; validateMove rejects the resulting move
+    auto addGem = [](Tokens& gems, const string& name) {
+        Color color;
+        if (parseColor(name, color)) gems[color]++;
+    };
     
     try {
         if (action == "TAKE") {
@@ -204,13 +233,13 @@ pair<Move, ValidationResult> parseMove(const string& move_string, int player_id)
             
             // Parse gems taken (between TAKE and RETURN/end)
             for (size_t i = 1; i < return_idx; i++) {
-                move.gems_taken[tokens[i]]++;
+                addGem(move.gems_taken, tokens[i]);
             }
             
             // Parse gems returned (after RETURN)
             if (return_idx < tokens.size()) {
                 for (size_t i = return_idx + 1; i < tokens.size(); i++) {
-                    move.gems_returned[tokens[i]]++;
+                    addGem(move.gems_returned, tokens[i]);
                 }
             }
             
@@ -232,7 +261,7 @@ pair<Move, ValidationResult> parseMove(const string& move_string, int player_id)
                 if (tokens[i] == "RETURN") {
                     // Parse gems returned (after RETURN)
                     for (size_t j = i + 1; j < tokens.size(); j++) {
-                        move.gems_returned[tokens[j]]++;
+                        addGem(move.gems_returned, tokens[j]);
                     }
                     break;
                 }
@@ -272,7 +301,7 @@ pair<Move, ValidationResult> parseMove(const string& move_string, int player_id)
                 move.auto_payment = false;
                 size_t payment_end = (noble_idx < tokens.size()) ? noble_idx : tokens.size();
                 for (size_t i = using_idx + 1; i < payment_end; i++) {
-                    move.payment[tokens[i]]++;
+                    addGem(move.payment, tokens[i]);
                 }
             } else {
                 // No USING - auto-calculate payment
@@ -332,40 +361,37 @@ ValidationResult validateMove(const GameState& state, const Move& move) {
     }
 }
 
+// Check whether (packed) card bonuses satisfy a noble's requirements
+static bool meetsRequirements(PackedTokens bonuses, const Noble& noble) {
+    return packedCovers(bonuses, noble.packed_requirements);
+}
+
 // Helper to validate noble choice at end of turn
 ValidationResult validateNobleChoice(const GameState& state, const Tokens& bonuses_after_move, int specified_noble_id) {
-    vector<int> qualifying_nobles;
+    int num_qualifying = 0;
+    int qualifying_id = -1;
+    bool specified_qualifies = false;
+    PackedTokens bonuses = packTokens(bonuses_after_move);
     for (const Noble& noble : state.available_nobles) {
-        if (bonuses_after_move.black >= noble.requirements.black &&
-            bonuses_after_move.blue >= noble.requirements.blue &&
-            bonuses_after_move.white >= noble.requirements.white &&
-            bonuses_after_move.green >= noble.requirements.green &&
-            bonuses_after_move.red >= noble.requirements.red) {
-            qualifying_nobles.push_back(noble.id);
+        if (meetsRequirements(bonuses, noble)) {
+            num_qualifying++;
+            qualifying_id = noble.id;
+            if (noble.id == specified_noble_id) specified_qualifies = true;
         }
     }
     
-    if (qualifying_nobles.empty()) {
+    if (num_qualifying == 0) {
         if (specified_noble_id != -1) {
             return ValidationResult(false, "No nobles qualify, but noble_id specified");
         }
-    } else if (qualifying_nobles.size() == 1) {
-        if (specified_noble_id != -1 && specified_noble_id != qualifying_nobles[0]) {
+    } else if (num_qualifying == 1) {
+        if (specified_noble_id != -1 && specified_noble_id != qualifying_id) {
             return ValidationResult(false, "Noble_id doesn't match the qualifying noble");
         }
     } else {
         // Multiples qualify - player must specify one, or referee will pick lowest ID
-        if (specified_noble_id != -1) {
-            bool found = false;
-            for (int id : qualifying_nobles) {
-                if (id == specified_noble_id) {
-                    found = true;
-                    break;
-                }
-            }
-            if (!found) {
-                return ValidationResult(false, "Specified noble does not qualify");
-            }
+        if (specified_noble_id != -1 && !specified_qualifies) {
+            return ValidationResult(false, "Specified noble does not qualify");
         }
     }
     return ValidationResult(true);
@@ -378,7 +404,7 @@ ValidationResult validateTakeGems(const GameState& state, const Move& move) {
     const Tokens& returned = move.gems_returned;
     
     // Cannot take joker gems
-    if (taken.joker > 0) {
+    if (taken[JOKER] > 0) {
         return ValidationResult(false, "Cannot take joker gems directly");
     }
     
@@ -392,48 +418,44 @@ ValidationResult validateTakeGems(const GameState& state, const Move& move) {
     // Count how many different colors are being taken
     int different_colors = 0;
     int max_of_one_color = 0;
-    string color_with_max;
+    Color color_with_max = NO_COLOR;
     
-    if (taken.black > 0) { different_colors++; if (taken.black > max_of_one_color) { max_of_one_color = taken.black; color_with_max = "black"; } }
-    if (taken.blue > 0) { different_colors++; if (taken.blue > max_of_one_color) { max_of_one_color = taken.blue; color_with_max = "blue"; } }
-    if (taken.white > 0) { different_colors++; if (taken.white > max_of_one_color) { max_of_one_color = taken.white; color_with_max = "white"; } }
-    if (taken.green > 0) { different_colors++; if (taken.green > max_of_one_color) { max_of_one_color = taken.green; color_with_max = "green"; } }
-    if (taken.red > 0) { different_colors++; if (taken.red > max_of_one_color) { max_of_one_color = taken.red; color_with_max = "red"; } }
+    for (int c = 0; c < NUM_GEM_COLORS; c++) {
+        if (taken[c] > 0) {
+            different_colors++;
+            if (taken[c] > max_of_one_color) { max_of_one_color = taken[c]; color_with_max = static_cast<Color>(c); }
+        }
+    }
     
     // Count how many different colors are available in the bank
     int colors_available_in_bank = 0;
-    if (state.bank.black > 0) colors_available_in_bank++;
-    if (state.bank.blue > 0) colors_available_in_bank++;
-    if (state.bank.white > 0) colors_available_in_bank++;
-    if (state.bank.green > 0) colors_available_in_bank++;
-    if (state.bank.red > 0) colors_available_in_bank++;
+    if (state.bank[BLACK] > 0) colors_available_in_bank++;
+    if (state.bank[BLUE] > 0) colors_available_in_bank++;
+    if (state.bank[WHITE] > 0) colors_available_in_bank++;
+    if (state.bank[GREEN] > 0) colors_available_in_bank++;
+    if (state.bank[RED] > 0) colors_available_in_bank++;
 
     // Check that bank has enough of each color
-    if (taken.black > state.bank.black) {
+    if (taken[BLACK] > state.bank[BLACK]) {
         return ValidationResult(false, "Not enough black gems in bank");
     }
-    if (taken.blue > state.bank.blue) {
+    if (taken[BLUE] > state.bank[BLUE]) {
         return ValidationResult(false, "Not enough blue gems in bank");
     }
-    if (taken.white > state.bank.white) {
+    if (taken[WHITE] > state.bank[WHITE]) {
         return ValidationResult(false, "Not enough white gems in bank");
     }
-    if (taken.green > state.bank.green) {
+    if (taken[GREEN] > state.bank[GREEN]) {
         return ValidationResult(false, "Not enough green gems in bank");
     }
-    if (taken.red > state.bank.red) {
+    if (taken[RED] > state.bank[RED]) {
         return ValidationResult(false, "Not enough red gems in bank");
     }
 
     // Case 1: Taking 2 of the same color
     if (total_taken == 2 && different_colors == 1) {
         // Must have 4+ of that color in bank
-        int bank_count = 0;
-        if (color_with_max == "black") bank_count = state.bank.black;
-        else if (color_with_max == "blue") bank_count = state.bank.blue;
-        else if (color_with_max == "white") bank_count = state.bank.white;
-        else if (color_with_max == "green") bank_count = state.bank.green;
-        else if (color_with_max == "red") bank_count = state.bank.red;
+        int bank_count = state.bank[color_with_max];
         
         if (bank_count < 4) {
             return ValidationResult(false, "Need 4+ gems in bank to take 2 of same color");
@@ -448,8 +470,8 @@ ValidationResult validateTakeGems(const GameState& state, const Move& move) {
         }
         
         // Each color must be exactly 1
-        if (taken.black > 1 || taken.blue > 1 || taken.white > 1 || 
-            taken.green > 1 || taken.red > 1) {
+        if (taken[BLACK] > 1 || taken[BLUE] > 1 || taken[WHITE] > 1 || 
+            taken[GREEN] > 1 || taken[RED] > 1) {
             return ValidationResult(false, "Can only take 1 of each color when taking different colors");
         }
     }
@@ -474,22 +496,22 @@ ValidationResult validateTakeGems(const GameState& state, const Move& move) {
     
     // Check that player has the gems they're trying to return
     // (including gems just taken in this move)
-    if (returned.black > player.tokens.black + taken.black) {
+    if (returned[BLACK] > player.tokens[BLACK] + taken[BLACK]) {
         return ValidationResult(false, "Cannot return more black gems than you have");
     }
-    if (returned.blue > player.tokens.blue + taken.blue) {
+    if (returned[BLUE] > player.tokens[BLUE] + taken[BLUE]) {
         return ValidationResult(false, "Cannot return more blue gems than you have");
     }
-    if (returned.white > player.tokens.white + taken.white) {
+    if (returned[WHITE] > player.tokens[WHITE] + taken[WHITE]) {
         return ValidationResult(false, "Cannot return more white gems than you have");
     }
-    if (returned.green > player.tokens.green + taken.green) {
+    if (returned[GREEN] > player.tokens[GREEN] + taken[GREEN]) {
         return ValidationResult(false, "Cannot return more green gems than you have");
     }
-    if (returned.red > player.tokens.red + taken.red) {
+    if (returned[RED] > player.tokens[RED] + taken[RED]) {
         return ValidationResult(false, "Cannot return more red gems than you have");
     }
-    if (returned.joker > player.tokens.joker) {
+    if (returned[JOKER] > player.tokens[JOKER]) {
         return ValidationResult(false, "Cannot return more joker gems than you have");
     }
     
@@ -561,7 +583,7 @@ ValidationResult validateReserveCard(const GameState& state, const Move& move) {
     }
     
     // Calculate gems after taking joker
-    int joker_gained = (state.bank.joker > 0) ? 1 : 0;
+    int joker_gained = (state.bank[JOKER] > 0) ? 1 : 0;
     int player_gems_after = player.tokens.total() + joker_gained - returned.total();
     
     // If player would have more than 10 gems after getting joker, they must return to exactly 10
@@ -577,22 +599,22 @@ ValidationResult validateReserveCard(const GameState& state, const Move& move) {
     }
     
     // Check that player has the gems they're trying to return
-    if (returned.black > player.tokens.black) {
+    if (returned[BLACK] > player.tokens[BLACK]) {
         return ValidationResult(false, "Cannot return more black gems than you have");
     }
-    if (returned.blue > player.tokens.blue) {
+    if (returned[BLUE] > player.tokens[BLUE]) {
         return ValidationResult(false, "Cannot return more blue gems than you have");
     }
-    if (returned.white > player.tokens.white) {
+    if (returned[WHITE] > player.tokens[WHITE]) {
         return ValidationResult(false, "Cannot return more white gems than you have");
     }
-    if (returned.green > player.tokens.green) {
+    if (returned[GREEN] > player.tokens[GREEN]) {
         return ValidationResult(false, "Cannot return more green gems than you have");
     }
-    if (returned.red > player.tokens.red) {
+    if (returned[RED] > player.tokens[RED]) {
         return ValidationResult(false, "Cannot return more red gems than you have");
     }
-    if (returned.joker > player.tokens.joker + joker_gained) {
+    if (returned[JOKER] > player.tokens[JOKER] + joker_gained) {
         return ValidationResult(false, "Cannot return more joker gems than you have");
     }
     
@@ -606,24 +628,12 @@ ValidationResult validateReserveCard(const GameState& state, const Move& move) {
 
 // Helper function to calculate automatic payment (minimize joker usage)
 Tokens calculateAutoPayment(const Tokens& effective_cost, const Tokens& player_tokens) {
-    Tokens payment;
+    // Pay with exact colors first (lane-wise min), then cover the remaining cost with jokers
+    PackedTokens cost = packTokens(effective_cost) & ~packedLane(JOKER, 0xFF);
+    PackedTokens unpaid = packedSubSat(cost, packTokens(player_tokens));
+    Tokens payment = unpackTokens(cost - unpaid);
     
-    // Pay with exact colors first
-    payment.black = min(effective_cost.black, player_tokens.black);
-    payment.blue = min(effective_cost.blue, player_tokens.blue);
-    payment.white = min(effective_cost.white, player_tokens.white);
-    payment.green = min(effective_cost.green, player_tokens.green);
-    payment.red = min(effective_cost.red, player_tokens.red);
-    
-    // Calculate remaining cost and use jokers
-    int remaining = 0;
-    remaining += effective_cost.black - payment.black;
-    remaining += effective_cost.blue - payment.blue;
-    remaining += effective_cost.white - payment.white;
-    remaining += effective_cost.green - payment.green;
-    remaining += effective_cost.red - payment.red;
-    
-    payment.joker = min(remaining, player_tokens.joker);
+    payment[JOKER] = min(packedSum(unpaid), player_tokens[JOKER]);
     
     return payment;
 }
@@ -666,12 +676,7 @@ ValidationResult validateBuyCard(const GameState& state, const Move& move) {
     }
     
     // Calculate effective cost (card cost - player bonuses)
-    Tokens effective_cost;
-    effective_cost.black = max(0, target_card->cost.black - player.bonuses.black);
-    effective_cost.blue = max(0, target_card->cost.blue - player.bonuses.blue);
-    effective_cost.white = max(0, target_card->cost.white - player.bonuses.white);
-    effective_cost.green = max(0, target_card->cost.green - player.bonuses.green);
-    effective_cost.red = max(0, target_card->cost.red - player.bonuses.red);
+    Tokens effective_cost = target_card->getEffectiveCost(player.bonuses);
     
     // Use payment from move, or calculate if auto_payment is true
     Tokens payment = move.payment;
@@ -680,22 +685,22 @@ ValidationResult validateBuyCard(const GameState& state, const Move& move) {
     }
     
     // Check player has the gems they're paying with
-    if (payment.black > player.tokens.black) {
+    if (payment[BLACK] > player.tokens[BLACK]) {
         return ValidationResult(false, "Not enough black gems");
     }
-    if (payment.blue > player.tokens.blue) {
+    if (payment[BLUE] > player.tokens[BLUE]) {
         return ValidationResult(false, "Not enough blue gems");
     }
-    if (payment.white > player.tokens.white) {
+    if (payment[WHITE] > player.tokens[WHITE]) {
         return ValidationResult(false, "Not enough white gems");
     }
-    if (payment.green > player.tokens.green) {
+    if (payment[GREEN] > player.tokens[GREEN]) {
         return ValidationResult(false, "Not enough green gems");
     }
-    if (payment.red > player.tokens.red) {
+    if (payment[RED] > player.tokens[RED]) {
         return ValidationResult(false, "Not enough red gems");
     }
-    if (payment.joker > player.tokens.joker) {
+    if (payment[JOKER] > player.tokens[JOKER]) {
         return ValidationResult(false, "Not enough joker gems");
     }
     
@@ -704,76 +709,226 @@ ValidationResult validateBuyCard(const GameState& state, const Move& move) {
     int jokers_used = 0;
     
     // Black
-    if (payment.black < effective_cost.black) {
-        jokers_used += effective_cost.black - payment.black;
-    } else if (payment.black > effective_cost.black) {
+    if (payment[BLACK] < effective_cost[BLACK]) {
+        jokers_used += effective_cost[BLACK] - payment[BLACK];
+    } else if (payment[BLACK] > effective_cost[BLACK]) {
         return ValidationResult(false, "Overpaying black gems");
     }
     
     // Blue
-    if (payment.blue < effective_cost.blue) {
-        jokers_used += effective_cost.blue - payment.blue;
-    } else if (payment.blue > effective_cost.blue) {
+    if (payment[BLUE] < effective_cost[BLUE]) {
+        jokers_used += effective_cost[BLUE] - payment[BLUE];
+    } else if (payment[BLUE] > effective_cost[BLUE]) {
         return ValidationResult(false, "Overpaying blue gems");
     }
     
     // White
-    if (payment.white < effective_cost.white) {
-        jokers_used += effective_cost.white - payment.white;
-    } else if (payment.white > effective_cost.white) {
+    if (payment[WHITE] < effective_cost[WHITE]) {
+        jokers_used += effective_cost[WHITE] - payment[WHITE];
+    } else if (payment[WHITE] > effective_cost[WHITE]) {
         return ValidationResult(false, "Overpaying white gems");
     }
     
     // Green
-    if (payment.green < effective_cost.green) {
-        jokers_used += effective_cost.green - payment.green;
-    } else if (payment.green > effective_cost.green) {
+    if (payment[GREEN] < effective_cost[GREEN]) {
+        jokers_used += effective_cost[GREEN] - payment[GREEN];
+    } else if (payment[GREEN] > effective_cost[GREEN]) {
         return ValidationResult(false, "Overpaying green gems");
     }
     
     // Red
-    if (payment.red < effective_cost.red) {
-        jokers_used += effective_cost.red - payment.red;
-    } else if (payment.red > effective_cost.red) {
+    if (payment[RED] < effective_cost[RED]) {
+        jokers_used += effective_cost[RED] - payment[RED];
+    } else if (payment[RED] > effective_cost[RED]) {
         return ValidationResult(false, "Overpaying red gems");
     }
     
     // Check joker usage
-    if (jokers_used > payment.joker) {
+    if (jokers_used > payment[JOKER]) {
         return ValidationResult(false, "Not enough jokers to cover cost");
     }
-    if (payment.joker > jokers_used) {
+    if (payment[JOKER] > jokers_used) {
         return ValidationResult(false, "Using too many jokers");
     }
     
     // Check noble selection
     // Count how many nobles the player will qualify for after this purchase
     Tokens new_bonuses = player.bonuses;
-    if (target_card->color == "black") new_bonuses.black++;
-    else if (target_card->color == "blue") new_bonuses.blue++;
-    else if (target_card->color == "white") new_bonuses.white++;
-    else if (target_card->color == "green") new_bonuses.green++;
-    else if (target_card->color == "red") new_bonuses.red++;
+    if (target_card->color < JOKER) new_bonuses[target_card->color]++;
     
     return validateNobleChoice(state, new_bonuses, move.noble_id);
 }
 
 // Helper function to load a specific card by ID
 Card loadCardById(int card_id, const vector<Card>& all_cards) {
+    // Fast path: cards.json lists cards in ID order
+    if (card_id >= 1 && card_id <= (int)all_cards.size() && all_cards[card_id - 1].id == card_id) {
+        return all_cards[card_id - 1];
+    }
     for (const Card& card : all_cards) {
         if (card.id == card_id) {
             return card;
         }
     }
     // Return empty card if not found
-    Card empty_card = {0, 0, 0, "", {}};
+    Card empty_card = {0, 0, 0, NO_COLOR, {}};
     return empty_card;
 }
 
+// Zobrist keys. Counts are clamped to the table size; larger counts never occur in play.
+const int ZOBRIST_MAX_COUNT = 31;    // Tokens per color, bonuses per color
+const int ZOBRIST_MAX_POINTS = 63;
+const int ZOBRIST_MAX_CARD_ID = 93;  // 91-93 are pending blind reserves in replay mode
+
+struct ZobristKeys {
+    uint64_t bank[NUM_TOKEN_COLORS][ZOBRIST_MAX_COUNT + 1];
+    uint64_t tokens[2][NUM_TOKEN_COLORS][ZOBRIST_MAX_COUNT + 1];
+    uint64_t bonuses[2][NUM_GEM_COLORS][ZOBRIST_MAX_COUNT + 1];
+    uint64_t points[2][ZOBRIST_MAX_POINTS + 1];
+    uint64_t faceup[3][MAX_FACEUP][ZOBRIST_MAX_CARD_ID + 1];
+    uint64_t reserved[2][ZOBRIST_MAX_CARD_ID + 1];
+    uint64_t deck_size[3][MAX_DECK_SIZE + 1];
+    uint64_t available_noble[MAX_NOBLE_ID + 1];
+    uint64_t owned_noble[2][MAX_NOBLE_ID + 1];
+    uint64_t passes[3];
+    uint64_t side_to_move;
+};
+
+// Fixed-seed key table, so keys are identical across processes and builds
+static const ZobristKeys& zobristKeys() {
+    static const ZobristKeys keys = [] {
+        ZobristKeys k;
+        SplitMix64 rng(0x53504C454E444F52ULL);  // "SPLENDOR"
+        uint64_t* words = reinterpret_cast<uint64_t*>(&k);
+        for (size_t i = 0; i < sizeof(k) / sizeof(uint64_t); i++) {
+            words[i] = rng();
+        }
+        return k;
+    }();
+    return keys;
+}
+
+static inline int zobristIndex(int n, int max) {
+    return (n < 0) ? 0 : (n > max) ? max : n;
+}
+
+// Compute the position key from scratch. applyMove/undoMove keep state.zobrist_key
+// equal to this; call it after editing a GameState by hand.
+uint64_t computeZobristKey(const GameState& state) {
+    const ZobristKeys& z = zobristKeys();
+    uint64_t key = 0;
+
+    for (int c = 0; c < NUM_TOKEN_COLORS; c++) {
+        key ^= z.bank[c][zobristIndex(state.bank[c], ZOBRIST_MAX_COUNT)];
+    }
+    for (int p = 0; p < 2; p++) {
+        const Player& player = state.players[p];
+        for (int c = 0; c < NUM_TOKEN_COLORS; c++) {
+            key ^= z.tokens[p][c][zobristIndex(player.tokens[c], ZOBRIST_MAX_COUNT)];
+        }
+        for (int c = 0; c < NUM_GEM_COLORS; c++) {
+            key ^= z.bonuses[p][c][zobristIndex(player.bonuses[c], ZOBRIST_MAX_COUNT)];
+        }
+        key ^= z.points[p][zobristIndex(player.points, ZOBRIST_MAX_POINTS)];
+        for (const Card& card : player.reserved) {
+            key ^= z.reserved[p][zobristIndex(card.id, ZOBRIST_MAX_CARD_ID)];
+        }
+        for (const Noble& noble : player.nobles) {
+            key ^= z.owned_noble[p][zobristIndex(noble.id, MAX_NOBLE_ID)];
+        }
+    }
+    for (int level = 1; level <= 3; level++) {
+        const vector<Card>& faceup = state.getFaceup(level);
+        for (size_t i = 0; i < faceup.size() && i < (size_t)MAX_FACEUP; i++) {
+            key ^= z.faceup[level - 1][i][zobristIndex(faceup[i].id, ZOBRIST_MAX_CARD_ID)];
+        }
+        key ^= z.deck_size[level - 1][zobristIndex(state.getDeck(level).size(), MAX_DECK_SIZE)];
+    }
+    for (const Noble& noble : state.available_nobles) {
+        key ^= z.available_noble[zobristIndex(noble.id, MAX_NOBLE_ID)];
+    }
+    key ^= z.passes[zobristIndex(state.consecutive_passes, 2)];
+    if (state.current_player == 1) key ^= z.side_to_move;
+    return key;
+}
+
+// Toggle the key for the card currently in a face-up slot / the current deck size.
+// Called once before and once after the slot or deck changes.
+static void hashFaceupSlot(GameState& state, int level, int idx) {
+    if (idx >= MAX_FACEUP) return;
+    state.zobrist_key ^= zobristKeys().faceup[level - 1][idx][zobristIndex(state.getFaceup(level)[idx].id, ZOBRIST_MAX_CARD_ID)];
+}
+
+static void hashDeckSize(GameState& state, int level) {
+    state.zobrist_key ^= zobristKeys().deck_size[level - 1][zobristIndex(state.getDeck(level).size(), MAX_DECK_SIZE)];
+}
+
+static void hashCountChanges(uint64_t& key, const uint64_t (*table)[ZOBRIST_MAX_COUNT + 1],
+                             const Tokens& before, const Tokens& after, int num_colors) {
+    for (int c = 0; c < num_colors; c++) {
+        if (before[c] != after[c]) {
+            key ^= table[c][zobristIndex(before[c], ZOBRIST_MAX_COUNT)] ^ table[c][zobristIndex(after[c], ZOBRIST_MAX_COUNT)];
+        }
+    }
+}
+
+// Take the face-up card at (level, idx) out of play and refill its slot: from the deck
+// in normal play, with a placeholder awaiting REVEAL in replay mode, or with an empty
+// placeholder once the deck is exhausted. The caller copies the card out first.
+static void refillFaceupSlot(GameState& state, int level, int idx, UndoRecord& undo, ostream& err_os) {
+    vector<Card>& faceup = state.getFaceup(level);
+    vector<Card>& deck = state.getDeck(level);
+    state.getLastRemovedPos(level) = idx;  // Track position for REVEAL
+    undo.level = level;
+    undo.faceup_slot = idx;
+    hashFaceupSlot(state, level, idx);
+    hashDeckSize(state, level);
+
+    if (!state.replay_mode && !deck.empty()) {
+        faceup[idx] = deck.back();
+        deck.pop_back();
+        undo.drew_from_deck = true;
+    } else if (state.replay_mode && !deck.empty()) {
+        faceup[idx] = Card{0, level, 0, NO_COLOR, {}}; // Placeholder
+        state.reveal_expected = true;
+        err_os << "\n>>> PROMPT: Please REVEAL a new level" << level << " card <<<" << endl;
+    } else {
+        // Deck empty - insert placeholder to keep size 4
+        faceup[idx] = Card{0, level, 0, NO_COLOR, {}};
+    }
+    hashFaceupSlot(state, level, idx);
+    hashDeckSize(state, level);
+}
+
 // Apply a validated move to game state
 ValidationResult applyMove(GameState& state, const Move& move, ostream& err_os) {
+    UndoRecord undo;
+    return applyMove(state, move, undo, err_os);
+}
+
+// Apply a validated move, recording what undoMove needs to restore the prior state
+ValidationResult applyMove(GameState& state, const Move& move, UndoRecord& undo, ostream& err_os) {
     int player_idx = move.player_id;
     Player& player = state.players[player_idx];
+
+    undo = UndoRecord();
+    undo.type = move.type;
+    undo.player_idx = player_idx;
+    undo.bank = state.bank;
+    undo.tokens = player.tokens;
+    undo.bonuses = player.bonuses;
+    undo.points = player.points;
+    undo.current_player = state.current_player;
+    undo.move_number = state.move_number;
+    undo.consecutive_passes = state.consecutive_passes;
+    undo.last_removed_pos[0] = state.last_removed_pos_level1;
+    undo.last_removed_pos[1] = state.last_removed_pos_level2;
+    undo.last_removed_pos[2] = state.last_removed_pos_level3;
+    undo.pending_blind_reserve_player = state.pending_blind_reserve_player;
+    undo.pending_blind_reserve_level = state.pending_blind_reserve_level;
+    undo.reveal_expected = state.reveal_expected;
+    undo.zobrist_key = state.zobrist_key;
+    const ZobristKeys& z = zobristKeys();
     
     switch (move.type) {
         case TAKE_GEMS:
@@ -792,147 +947,50 @@ ValidationResult applyMove(GameState& state, const Move& move, ostream& err_os)
             
             // Determine which card to reserve
             if (move.card_id >= 1 && move.card_id <= 90) {
-                // Face-up card - find and remove it
-                for (size_t i = 0; i < state.faceup_level1.size(); i++) {
-                    if (state.faceup_level1[i].id == move.card_id) {
-                        card_to_reserve = state.faceup_level1[i];
-                        state.last_removed_pos_level1 = i;  // Track position for REVEAL
-                        state.faceup_level1.erase(state.faceup_level1.begin() + i);
-                        
-                        // Replace with deck card if available
-                        if (!state.replay_mode && !state.deck_level1.empty()) {
-                            state.faceup_level1.insert(state.faceup_level1.begin() + i, state.deck_level1.back());
-                            state.deck_level1.pop_back();
-                        } else if (state.replay_mode && !state.deck_level1.empty()) {
-                            state.faceup_level1.insert(state.faceup_level1.begin() + i, Card{0, 1, 0, "", {}}); // Placeholder
-                            state.reveal_expected = true;
-                            err_os << "\n>>> PROMPT: Please REVEAL a new level1 card <<<" << endl;
-                        } else {
-                            // Deck empty - insert placeholder to keep size 4
-                            state.faceup_level1.insert(state.faceup_level1.begin() + i, Card{0, 1, 0, "", {}});
-                        }
-                        found = true;
-                        break;
-                    }
-                }
-                
-                if (!found) {
-                    for (size_t i = 0; i < state.faceup_level2.size(); i++) {
-                        if (state.faceup_level2[i].id == move.card_id) {
-                            card_to_reserve = state.faceup_level2[i];
-                            state.last_removed_pos_level2 = i;  // Track position for REVEAL
-                            state.faceup_level2.erase(state.faceup_level2.begin() + i);
-                            
-                            if (!state.replay_mode && !state.deck_level2.empty()) {
-                                state.faceup_level2.insert(state.faceup_level2.begin() + i, state.deck_level2.back());
-                                state.deck_level2.pop_back();
-                            } else if (state.replay_mode && !state.deck_level2.empty()) {
-                                state.faceup_level2.insert(state.faceup_level2.begin() + i, Card{0, 2, 0, "", {}}); // Placeholder
-                                state.reveal_expected = true;
-                                err_os << "\n>>> PROMPT: Please REVEAL a new level2 card <<<" << endl;
-                            } else {
-                                // Deck empty
-                                state.faceup_level2.insert(state.faceup_level2.begin() + i, Card{0, 2, 0, "", {}});
-                            }
-                            found = true;
-                            break;
-                        }
-                    }
-                }
-                
-                if (!found) {
-                    for (size_t i = 0; i < state.faceup_level3.size(); i++) {
-                        if (state.faceup_level3[i].id == move.card_id) {
-                            card_to_reserve = state.faceup_level3[i];
-                            state.last_removed_pos_level3 = i;  // Track position for REVEAL
-                            state.faceup_level3.erase(state.faceup_level3.begin() + i);
-                            
-                            if (!state.replay_mode && !state.deck_level3.empty()) {
-                                state.faceup_level3.insert(state.faceup_level3.begin() + i, state.deck_level3.back());
-                                state.deck_level3.pop_back();
-                            } else if (state.replay_mode && !state.deck_level3.empty()) {
-                                state.faceup_level3.insert(state.faceup_level3.begin() + i, Card{0, 3, 0, "", {}}); // Placeholder
-                                state.reveal_expected = true;
-                                err_os << "\n>>> PROMPT: Please REVEAL a new level3 card <<<" << endl;
-                            } else {
-                                // Deck empty
-                                state.faceup_level3.insert(state.faceup_level3.begin() + i, Card{0, 3, 0, "", {}});
-                            }
-                            found = true;
-                            break;
-                        }
-                    }
+                // Face-up card - take it and refill the slot
+                GameState::CardLocation loc = state.findCardInFaceup(move.card_id);
+                if (loc.found) {
+                    card_to_reserve = state.getFaceup(loc.level)[loc.index];
+                    refillFaceupSlot(state, loc.level, loc.index, undo, err_os);
+                    found = true;
                 }
             }
-            else if (move.card_id == 91 && !state.deck_level1.empty()) {
+            else if (move.card_id >= 91 && move.card_id <= 93 && !state.getDeck(move.card_id - 90).empty()) {
+                int level = move.card_id - 90;
+                undo.level = level;
                 if (!state.replay_mode) {
                     // In normal mode, take the actual card from deck
-                    card_to_reserve = state.deck_level1.back();
-                    state.deck_level1.pop_back();
+                    card_to_reserve = state.getDeck(level).back();
+                    hashDeckSize(state, level);
+                    state.getDeck(level).pop_back();
+                    hashDeckSize(state, level);
+                    undo.drew_from_deck = true;
                 } else {
                     // In replay mode, create a placeholder - actual card will come from REVEAL
-                    card_to_reserve.id = 91;  // Temporary placeholder ID
-                    card_to_reserve.level = 1;
-                    state.pending_blind_reserve_player = player_idx;
-                    state.pending_blind_reserve_level = 1;
-                    state.reveal_expected = true;
-                    err_os << "\n>>> PROMPT: Please REVEAL the reserved level1 card <<<" << endl;
-                }
-                found = true;
-            }
-            else if (move.card_id == 92 && !state.deck_level2.empty()) {
-                if (!state.replay_mode) {
-                    card_to_reserve = state.deck_level2.back();
-                    state.deck_level2.pop_back();
-                } else {
-                    card_to_reserve.id = 92;  // Temporary placeholder ID
-                    card_to_reserve.level = 2;
-                    state.pending_blind_reserve_player = player_idx;
-                    state.pending_blind_reserve_level = 2;
-                    state.reveal_expected = true;
-                    err_os << "\n>>> PROMPT: Please REVEAL the reserved level2 card <<<" << endl;
-                }
-                found = true;
-            }
-            else if (move.card_id == 93 && !state.deck_level3.empty()) {
-                if (!state.replay_mode) {
-                    card_to_reserve = state.deck_level3.back();
-                    state.deck_level3.pop_back();
-                } else {
-                    card_to_reserve.id = 93;  // Temporary placeholder ID
-                    card_to_reserve.level = 3;
+                    card_to_reserve = Card{move.card_id, level, 0, NO_COLOR, {}};  // Temporary placeholder ID
                     state.pending_blind_reserve_player = player_idx;
-                    state.pending_blind_reserve_level = 3;
+                    state.pending_blind_reserve_level = level;
                     state.reveal_expected = true;
-                    err_os << "\n>>> PROMPT: Please REVEAL the reserved level3 card <<<" << endl;
+                    err_os << "\n>>> PROMPT: Please REVEAL the reserved level" << level << " card <<<" << endl;
                 }
                 found = true;
             }
             
             if (found) {
                 player.reserved.push_back(card_to_reserve);
+                undo.reserved_card = true;
+                state.zobrist_key ^= z.reserved[player_idx][zobristIndex(card_to_reserve.id, ZOBRIST_MAX_CARD_ID)];
             }
             
             // Give joker if available
-            if (state.bank.joker > 0) {
-                player.tokens.joker++;
-                state.bank.joker--;
+            if (state.bank[JOKER] > 0) {
+                player.tokens[JOKER]++;
+                state.bank[JOKER]--;
             }
             
             // Return gems if any
-            player.tokens.black -= move.gems_returned.black;
-            player.tokens.blue -= move.gems_returned.blue;
-            player.tokens.white -= move.gems_returned.white;
-            player.tokens.green -= move.gems_returned.green;
-            player.tokens.red -= move.gems_returned.red;
-            player.tokens.joker -= move.gems_returned.joker;
-            
-            state.bank.black += move.gems_returned.black;
-            state.bank.blue += move.gems_returned.blue;
-            state.bank.white += move.gems_returned.white;
-            state.bank.green += move.gems_returned.green;
-            state.bank.red += move.gems_returned.red;
-            state.bank.joker += move.gems_returned.joker;
+            player.tokens -= move.gems_returned;
+            state.bank += move.gems_returned;
             break;
         }
             
@@ -941,132 +999,57 @@ ValidationResult applyMove(GameState& state, const Move& move, ostream& err_os)
             break;
             
         case BUY_CARD: {
-            Card* target_card = nullptr;
-            bool is_reserved = false;
+            // Find the card in reserved first, then face-up
             int reserved_idx = -1;
-            
-            // Find the card in reserved first
             for (size_t i = 0; i < player.reserved.size(); i++) {
                 if (player.reserved[i].id == move.card_id) {
-                    target_card = &player.reserved[i];
-                    is_reserved = true;
                     reserved_idx = i;
                     break;
                 }
             }
-            
-            // If not in reserved, find in face-up
-            int faceup_idx = -1;
-            int faceup_level = 0;
-            if (!target_card) {
-                for (size_t i = 0; i < state.faceup_level1.size(); i++) {
-                    if (state.faceup_level1[i].id == move.card_id) {
-                        target_card = &state.faceup_level1[i];
-                        faceup_idx = i;
-                        faceup_level = 1;
-                        break;
-                    }
-                }
-            }
-            if (!target_card) {
-                for (size_t i = 0; i < state.faceup_level2.size(); i++) {
-                    if (state.faceup_level2[i].id == move.card_id) {
-                        target_card = &state.faceup_level2[i];
-                        faceup_idx = i;
-                        faceup_level = 2;
-                        break;
-                    }
-                }
+            GameState::CardLocation loc;
+            if (reserved_idx < 0) loc = state.findCardInFaceup(move.card_id);
+            if (reserved_idx < 0 && !loc.found) {
+                return ValidationResult(false, "Card ID " + to_string(move.card_id) + " not found in board or reserved");
             }
-            if (!target_card) {
-                for (size_t i = 0; i < state.faceup_level3.size(); i++) {
-                    if (state.faceup_level3[i].id == move.card_id) {
-                        target_card = &state.faceup_level3[i];
-                        faceup_idx = i;
-                        faceup_level = 3;
-                        break;
-                    }
-                }
+
+            Card purchased_card = (reserved_idx >= 0) ? player.reserved[reserved_idx]
+                                                      : state.getFaceup(loc.level)[loc.index];
+            
+            // Calculate payment if auto_payment was used
+            Tokens payment = move.payment;
+            if (move.auto_payment) {
+                Tokens effective_cost = purchased_card.getEffectiveCost(player.bonuses);
+                payment = calculateAutoPayment(effective_cost, player.tokens);
             }
             
-            if (target_card) {
-                // Save card info before removing
-                Card purchased_card = *target_card;
-                
-                // Calculate payment if auto_payment was used
-                Tokens payment = move.payment;
-                if (move.auto_payment) {
-                    Tokens effective_cost = purchased_card.getEffectiveCost(player.bonuses);
-                    payment = calculateAutoPayment(effective_cost, player.tokens);
-                }
-                
-                // Remove payment from player, add to bank
-                player.tokens -= payment;
-                state.bank += payment;
-                
-                // Add card to player's tableau
-                player.cards.push_back(purchased_card);
-                
-                // Update bonuses
-                player.bonuses[purchased_card.color]++;
-                
-                // Update points
-                player.points += purchased_card.points;
-                
-                // Remove card from its source
-                if (is_reserved) {
-                    player.reserved.erase(player.reserved.begin() + reserved_idx);
-                } else {
-                    // Remove from face-up and replace with deck card
-                    if (faceup_level == 1) {
-                        state.last_removed_pos_level1 = faceup_idx;  // Track position for REVEAL
-                        state.faceup_level1.erase(state.faceup_level1.begin() + faceup_idx);
-                        if (!state.replay_mode && !state.deck_level1.empty()) {
-                            state.faceup_level1.insert(state.faceup_level1.begin() + faceup_idx, state.deck_level1.back());
-                            state.deck_level1.pop_back();
-                        } else if (state.replay_mode && !state.deck_level1.empty()) {
-                            state.faceup_level1.insert(state.faceup_level1.begin() + faceup_idx, Card{0, 1, 0, "", {}}); // Placeholder
-                            state.reveal_expected = true;
-                            err_os << "\n>>> PROMPT: Please REVEAL a new level1 card <<<" << endl;
-                        } else {
-                            // Deck empty - insert placeholder
-                            state.faceup_level1.insert(state.faceup_level1.begin() + faceup_idx, Card{0, 1, 0, "", {}});
-                        }
-                    } else if (faceup_level == 2) {
-                        state.last_removed_pos_level2 = faceup_idx;  // Track position for REVEAL
-                        state.faceup_level2.erase(state.faceup_level2.begin() + faceup_idx);
-                        if (!state.replay_mode && !state.deck_level2.empty()) {
-                            state.faceup_level2.insert(state.faceup_level2.begin() + faceup_idx, state.deck_level2.back());
-                            state.deck_level2.pop_back();
-                        } else if (state.replay_mode && !state.deck_level2.empty()) {
-                            state.faceup_level2.insert(state.faceup_level2.begin() + faceup_idx, Card{0, 2, 0, "", {}}); // Placeholder
-                            state.reveal_expected = true;
-                            err_os << "\n>>> PROMPT: Please REVEAL a new level2 card <<<" << endl;
-                        } else {
-                            // Deck empty
-                            state.faceup_level2.insert(state.faceup_level2.begin() + faceup_idx, Card{0, 2, 0, "", {}});
-                        }
-                    } else if (faceup_level == 3) {
-                        state.last_removed_pos_level3 = faceup_idx;  // Track position for REVEAL
-                        state.faceup_level3.erase(state.faceup_level3.begin() + faceup_idx);
-                        if (!state.replay_mode && !state.deck_level3.empty()) {
-                            state.faceup_level3.insert(state.faceup_level3.begin() + faceup_idx, state.deck_level3.back());
-                            state.deck_level3.pop_back();
-                        } else if (state.replay_mode && !state.deck_level3.empty()) {
-                            state.faceup_level3.insert(state.faceup_level3.begin() + faceup_idx, Card{0, 3, 0, "", {}}); // Placeholder
-                            state.reveal_expected = true;
-                            err_os << "\n>>> PROMPT: Please REVEAL a new level3 card <<<" << endl;
-                        } else {
-                            // Deck empty
-                            state.faceup_level3.insert(state.faceup_level3.begin() + faceup_idx, Card{0, 3, 0, "", {}});
-                        }
-                    }
-                }
-                
-                // Check for nobles ONLY during BUY_CARD moves
-                checkAndAssignNobles(state, player_idx, move.noble_id, err_os);
+            // Remove payment from player, add to bank
+            player.tokens -= payment;
+            state.bank += payment;
+            
+            // Add card to player's tableau
+            player.cards.push_back(purchased_card);
+            
+            // Update bonuses
+            if (purchased_card.color < JOKER) player.bonuses[purchased_card.color]++;
+            
+            // Update points
+            player.points += purchased_card.points;
+            
+            // Remove card from its source
+            if (reserved_idx >= 0) {
+                player.reserved.erase(player.reserved.begin() + reserved_idx);
+                undo.reserved_idx = reserved_idx;
+                state.zobrist_key ^= z.reserved[player_idx][zobristIndex(purchased_card.id, ZOBRIST_MAX_CARD_ID)];
             } else {
-                return ValidationResult(false, "Card ID " + to_string(move.card_id) + " not found in board or reserved");
+                refillFaceupSlot(state, loc.level, loc.index, undo, err_os);
+            }
+            
+            // Check for nobles ONLY during BUY_CARD moves
+            undo.noble_idx = checkAndAssignNobles(state, player_idx, move.noble_id, err_os);
+            if (undo.noble_idx >= 0) {
+                int noble = zobristIndex(player.nobles.back().id, MAX_NOBLE_ID);
+                state.zobrist_key ^= z.available_noble[noble] ^ z.owned_noble[player_idx][noble];
             }
             break;
         }
@@ -1077,17 +1060,26 @@ ValidationResult applyMove(GameState& state, const Move& move, ostream& err_os)
             auto& faceup = state.getFaceup(level);
             auto& deck = state.getDeck(level);
             int& last_pos = state.getLastRemovedPos(level);
+            undo.level = level;
 
             if (last_pos >= 0 && last_pos < (int)faceup.size()) {
+                undo.faceup_slot = last_pos;
+                undo.replaced_card = faceup[last_pos];
+                hashFaceupSlot(state, level, last_pos);
                 faceup[last_pos] = move.revealed_card;
+                hashFaceupSlot(state, level, last_pos);
             } else {
                 faceup.push_back(move.revealed_card);
+                hashFaceupSlot(state, level, faceup.size() - 1);
             }
 
             // Remove from deck
-            for (auto it = deck.begin(); it != deck.end(); ++it) {
-                if (it->id == move.revealed_card.id) {
-                    deck.erase(it);
+            for (size_t i = 0; i < deck.size(); i++) {
+                if (deck[i].id == move.revealed_card.id) {
+                    undo.revealed_deck_idx = i;
+                    hashDeckSize(state, level);
+                    deck.erase(deck.begin() + i);
+                    hashDeckSize(state, level);
                     break;
                 }
             }
@@ -1111,23 +1103,109 @@ ValidationResult applyMove(GameState& state, const Move& move, ostream& err_os)
         state.current_player = 1 - state.current_player;
         state.move_number++;
     }
+
+    // Fold token, bonus, point and turn changes into the key
+    hashCountChanges(state.zobrist_key, z.bank, undo.bank, state.bank, NUM_TOKEN_COLORS);
+    hashCountChanges(state.zobrist_key, z.tokens[player_idx], undo.tokens, player.tokens, NUM_TOKEN_COLORS);
+    hashCountChanges(state.zobrist_key, z.bonuses[player_idx], undo.bonuses, player.bonuses, NUM_GEM_COLORS);
+    if (undo.points != player.points) {
+        state.zobrist_key ^= z.points[player_idx][zobristIndex(undo.points, ZOBRIST_MAX_POINTS)]
+                           ^ z.points[player_idx][zobristIndex(player.points, ZOBRIST_MAX_POINTS)];
+    }
+    state.zobrist_key ^= z.passes[zobristIndex(undo.consecutive_passes, 2)]
+                       ^ z.passes[zobristIndex(state.consecutive_passes, 2)];
+    if (undo.current_player != state.current_player) state.zobrist_key ^= z.side_to_move;
     
     return ValidationResult(true);
 }
 
-// Check if player qualifies for any nobles and assign them
-void checkAndAssignNobles(GameState& state, int player_idx, int noble_id, ostream& err_os) {
+// Put a card back into the face-up slot it was taken from, returning the refill to its deck
+static void restoreFaceupSlot(GameState& state, const UndoRecord& undo, const Card& card) {
+    Card& slot = state.getFaceup(undo.level)[undo.faceup_slot];
+    if (undo.drew_from_deck) state.getDeck(undo.level).push_back(slot);
+    slot = card;
+}
+
+// Restore the state from before a successful applyMove(state, move, undo)
+void undoMove(GameState& state, const UndoRecord& undo) {
+    Player& player = state.players[undo.player_idx];
+
+    switch (undo.type) {
+        case RESERVE_CARD:
+            if (undo.reserved_card) {
+                Card card = player.reserved.back();
+                player.reserved.pop_back();
+                if (undo.faceup_slot >= 0) {
+                    restoreFaceupSlot(state, undo, card);
+                } else if (undo.drew_from_deck) {
+                    state.getDeck(undo.level).push_back(card);
+                }
+            }
+            break;
+
+        case BUY_CARD: {
+            if (undo.noble_idx >= 0) {
+                state.available_nobles.insert(state.available_nobles.begin() + undo.noble_idx, player.nobles.back());
+                player.nobles.pop_back();
+            }
+            Card card = player.cards.back();
+            player.cards.pop_back();
+            if (undo.reserved_idx >= 0) {
+                player.reserved.insert(player.reserved.begin() + undo.reserved_idx, card);
+            } else {
+                restoreFaceupSlot(state, undo, card);
+            }
+            break;
+        }
+
+        case REVEAL_CARD: {
+            auto& faceup = state.getFaceup(undo.level);
+            Card revealed;
+            if (undo.faceup_slot >= 0) {
+                revealed = faceup[undo.faceup_slot];
+                faceup[undo.faceup_slot] = undo.replaced_card;
+            } else {
+                revealed = faceup.back();
+                faceup.pop_back();
+            }
+            if (undo.revealed_deck_idx >= 0) {
+                auto& deck = state.getDeck(undo.level);
+                deck.insert(deck.begin() + undo.revealed_deck_idx, revealed);
+            }
+            break;
+        }
+
+        default:
+            break;
+    }
+
+    state.bank = undo.bank;
+    player.tokens = undo.tokens;
+    player.bonuses = undo.bonuses;
+    player.points = undo.points;
+    state.current_player = undo.current_player;
+    state.move_number = undo.move_number;
+    state.consecutive_passes = undo.consecutive_passes;
+    state.last_removed_pos_level1 = undo.last_removed_pos[0];
+    state.last_removed_pos_level2 = undo.last_removed_pos[1];
+    state.last_removed_pos_level3 = undo.last_removed_pos[2];
+    state.pending_blind_reserve_player = undo.pending_blind_reserve_player;
+    state.pending_blind_reserve_level = undo.pending_blind_reserve_level;
+    state.reveal_expected = undo.reveal_expected;
+    state.zobrist_key = undo.zobrist_key;
+}
+
+// Check if player qualifies for any nobles and assign them.
+// Returns the available_nobles index of the granted noble, or -1 if none was granted.
+int checkAndAssignNobles(GameState& state, int player_idx, int noble_id, ostream& err_os) {
     Player& player = state.players[player_idx];
     
     // Find which nobles the player qualifies for
     vector<int> qualifying_noble_indices;
+    PackedTokens bonuses = packTokens(player.bonuses);
     for (size_t i = 0; i < state.available_nobles.size(); i++) {
         const Noble& noble = state.available_nobles[i];
-        if (player.bonuses.black >= noble.requirements.black &&
-            player.bonuses.blue >= noble.requirements.blue &&
-            player.bonuses.white >= noble.requirements.white &&
-            player.bonuses.green >= noble.requirements.green &&
-            player.bonuses.red >= noble.requirements.red) {
+        if (meetsRequirements(bonuses, noble)) {
             qualifying_noble_indices.push_back(i);
         }
     }
@@ -1135,7 +1213,7 @@ void checkAndAssignNobles(GameState& state, int player_idx, int noble_id, ostrea
     // Assign noble based on qualification
     if (qualifying_noble_indices.empty()) {
         // No nobles qualify, nothing to do
-        return;
+        return -1;
     }
     else if (qualifying_noble_indices.size() == 1) {
         // One noble qualifies - assign automatically
@@ -1143,6 +1221,7 @@ void checkAndAssignNobles(GameState& state, int player_idx, int noble_id, ostrea
         player.nobles.push_back(state.available_nobles[idx]);
         player.points += state.available_nobles[idx].points;
         state.available_nobles.erase(state.available_nobles.begin() + idx);
+        return idx;
     }
     else {
         // Multiple nobles qualify
@@ -1162,6 +1241,7 @@ void checkAndAssignNobles(GameState& state, int player_idx, int noble_id, ostrea
             player.nobles.push_back(state.available_nobles[min_idx]);
             player.points += state.available_nobles[min_idx].points;
             state.available_nobles.erase(state.available_nobles.begin() + min_idx);
+            return min_idx;
         }
         else {
             // Find the specified noble
@@ -1184,8 +1264,10 @@ void checkAndAssignNobles(GameState& state, int player_idx, int noble_id, ostrea
                 player.nobles.push_back(state.available_nobles[found_idx]);
                 player.points += state.available_nobles[found_idx].points;
                 state.available_nobles.erase(state.available_nobles.begin() + found_idx);
+                return found_idx;
             } else {
                 err_os << "ERROR: Specified noble " << noble_id << " not available or not qualified" << endl;
+                return -1;
             }
         }
     }
@@ -1268,12 +1350,8 @@ Tokens parseTokens(const string& json_section) {
     Tokens tokens;
     
     // Parse format: "cost": {"blue": 1, "green": 1, ...}
-    string search_colors[] = {"black", "blue", "white", "green", "red", "joker"};
-    int* token_fields[] = {&tokens.black, &tokens.blue, &tokens.white, 
-                           &tokens.green, &tokens.red, &tokens.joker};
-    
-    for (int i = 0; i < 6; i++) {
-        size_t color_pos = json_section.find("\"" + search_colors[i] + "\"");
+    for (int i = 0; i < NUM_TOKEN_COLORS; i++) {
+        size_t color_pos = json_section.find("\"" + string(colorName(static_cast<Color>(i))) + "\"");
         if (color_pos != string::npos) {
             size_t colon_pos = json_section.find(":", color_pos);
             if (colon_pos != string::npos) {
@@ -1283,7 +1361,7 @@ Tokens parseTokens(const string& json_section) {
                 // Trim whitespace
                 num_str.erase(0, num_str.find_first_not_of(" \t\n\r"));
                 num_str.erase(num_str.find_last_not_of(" \t\n\r") + 1);
-                *token_fields[i] = stoi(num_str);
+                tokens[i] = stoi(num_str);
             }
         }
     }
@@ -1313,7 +1391,7 @@ vector<Card> loadCards(const string& filename, ostream& err_os) {
         if (end_pos == string::npos) break;
         
         string card_json = content.substr(pos, end_pos - pos + 1);
-        Card card;
+        Card card = {0, 0, 0, NO_COLOR, {}};
         
         // Extract id
         size_t id_pos = card_json.find("\"id\"");
@@ -1345,7 +1423,9 @@ vector<Card> loadCards(const string& filename, ostream& err_os) {
             size_t colon = card_json.find(":", color_pos);
             size_t quote1 = card_json.find("\"", colon);
             size_t quote2 = card_json.find("\"", quote1 + 1);
-            card.color = card_json.substr(quote1 + 1, quote2 - quote1 - 1);
+            if (!parseColor(card_json.substr(quote1 + 1, quote2 - quote1 - 1), card.color)) {
+                card.color = NO_COLOR;
+            }
         }
         
         // Extract cost
@@ -1355,6 +1435,7 @@ vector<Card> loadCards(const string& filename, ostream& err_os) {
             size_t brace_end = card_json.find("}", brace_start);
             string cost_section = card_json.substr(brace_start, brace_end - brace_start + 1);
             card.cost = parseTokens(cost_section);
+            card.packed_cost = packTokens(card.cost);
         }
         
         cards.push_back(card);
@@ -1387,7 +1468,7 @@ vector<Noble> loadNobles(const string& filename, ostream& err_os) {
         if (end_pos == string::npos) break;
         
         string noble_json = content.substr(pos, end_pos - pos + 1);
-        Noble noble;
+        Noble noble = {0, 0, {}, 0};
         
         // Extract id
         size_t id_pos = noble_json.find("\"id\"");
@@ -1412,6 +1493,7 @@ vector<Noble> loadNobles(const string& filename, ostream& err_os) {
             size_t brace_end = noble_json.find("}", brace_start);
             string req_section = noble_json.substr(brace_start, brace_end - brace_start + 1);
             noble.requirements = parseTokens(req_section);
+            noble.packed_requirements = packTokens(noble.requirements);
         }
         
         nobles.push_back(noble);
@@ -1422,95 +1504,191 @@ vector<Noble> loadNobles(const string& filename, ostream& err_os) {
     return nobles;
 }
 
-// Initialize game state
+// Built-in copy of cards.json and nobles.json, generated into card_tables.inc by
+// gen_card_tables.py, so games can be set up without touching the filesystem
+struct BuiltinCard {
+    int id;
+    int level;
+    int points;
+    Color color;
+    int cost[NUM_GEM_COLORS];
+};
+
+struct BuiltinNoble {
+    int id;
+    int points;
+    int requirements[NUM_GEM_COLORS];
+};
+
+#include "card_tables.inc"
+
+const vector<Card>& builtinCards() {
+    static const vector<Card> cards = [] {
+        vector<Card> out;
+        for (const BuiltinCard& entry : BUILTIN_CARDS) {
+            Card card = {entry.id, entry.level, entry.points, entry.color, {}};
+            for (int c = 0; c < NUM_GEM_COLORS; c++) card.cost[c] = entry.cost[c];
+            card.packed_cost = packTokens(card.cost);
+            out.push_back(card);
+        }
+        return out;
+    }();
+    return cards;
+}
+
+const vector<Noble>& builtinNobles() {
+    static const vector<Noble> nobles = [] {
+        vector<Noble> out;
+        for (const BuiltinNoble& entry : BUILTIN_NOBLES) {
+            Noble noble = {entry.id, entry.points, {}, 0};
+            for (int c = 0; c < NUM_GEM_COLORS; c++) noble.requirements[c] = entry.requirements[c];
+            noble.packed_requirements = packTokens(noble.requirements);
+            out.push_back(noble);
+        }
+        return out;
+    }();
+    return nobles;
+}
+
+const CardTable& builtinCardTable() {
+    static const CardTable table = buildCardTable(builtinCards(), builtinNobles());
+    return table;
+}
+
+// Initialize game state from card and noble files
 void initializeGame(GameState& state, unsigned int seed, 
                     const string& cards_path, 
                     const string& nobles_path, 
                     ostream& err_os) {
-    // Use provided seed or current time
-    if (seed == 0) {
-        seed = static_cast<unsigned int>(time(nullptr));
-    }
-    mt19937 rng(seed);
-    
-    err_os << "Initializing game with seed: " << seed << endl;
-    
-    // Load all cards
     vector<Card> all_cards = loadCards(cards_path, err_os);
     err_os << "Loaded " << all_cards.size() << " cards" << endl;
-    
-    // Separate cards by level
-    vector<Card> level1, level2, level3;
-    for (const Card& card : all_cards) {
-        if (card.level == 1) level1.push_back(card);
-        else if (card.level == 2) level2.push_back(card);
-        else if (card.level == 3) level3.push_back(card);
-    }
-    
-    err_os << "Level 1: " << level1.size() << " cards" << endl;
-    err_os << "Level 2: " << level2.size() << " cards" << endl;
-    err_os << "Level 3: " << level3.size() << " cards" << endl;
-    
-    // Shuffle each level
-    shuffle(level1.begin(), level1.end(), rng);
-    shuffle(level2.begin(), level2.end(), rng);
-    shuffle(level3.begin(), level3.end(), rng);
-    
-    // Draw 4 cards from each level for face-up display
-    for (int i = 0; i < 4 && i < (int)level1.size(); i++) {
-        state.faceup_level1.push_back(level1[i]);
-    }
-    for (int i = 4; i < (int)level1.size(); i++) {
-        state.deck_level1.push_back(level1[i]);
+    vector<Noble> all_nobles = loadNobles(nobles_path, err_os);
+    err_os << "Loaded " << all_nobles.size() << " nobles" << endl;
+    initializeGame(state, seed, all_cards, all_nobles, err_os);
+}
+
+// Reset every field to its default but keep the vectors' storage: the vectors are
+// swapped into a fresh state (which cannot allocate) and moved back with it
+static void clearGameState(GameState& state) {
+    GameState fresh;
+    fresh.replay_mode = state.replay_mode;
+    for (int level = 1; level <= 3; level++) {
+        fresh.getDeck(level).swap(state.getDeck(level));
+        fresh.getFaceup(level).swap(state.getFaceup(level));
+        fresh.getDeck(level).clear();
+        fresh.getFaceup(level).clear();
+    }
+    fresh.available_nobles.swap(state.available_nobles);
+    fresh.available_nobles.clear();
+    for (int p = 0; p < 2; p++) {
+        fresh.players[p].cards.swap(state.players[p].cards);
+        fresh.players[p].reserved.swap(state.players[p].reserved);
+        fresh.players[p].nobles.swap(state.players[p].nobles);
+        fresh.players[p].cards.clear();
+        fresh.players[p].reserved.clear();
+        fresh.players[p].nobles.clear();
+    }
+    state = std::move(fresh);
+}
+
+static void shuffleDeal(vector<Card>& items, mt19937& rng) {
+    shuffle(items.begin(), items.end(), rng);
+}
+
+static void shuffleDeal(vector<Noble>& items, mt19937& rng) {
+    shuffle(items.begin(), items.end(), rng);
+}
+
+// Fisher-Yates with our own bounded draw, so SplitMix64 deals do not depend on the
+// standard library's shuffle/distribution implementation
+template <typename T>
+static void shuffleDeal(vector<T>& items, SplitMix64& rng) {
+    for (size_t i = items.size(); i > 1; i--) {
+        std::swap(items[i - 1], items[rng.below(i)]);
     }
-    
-    for (int i = 0; i < 4 && i < (int)level2.size(); i++) {
-        state.faceup_level2.push_back(level2[i]);
+}
+
+// Each level is shuffled in card order, then the nobles, with one generator; the
+// first 4 cards of a level go face up and the first 3 nobles are in play
+template <typename Rng>
+static void dealGame(GameState& state, const vector<Card>& all_cards, const vector<Noble>& all_nobles, Rng& rng) {
+    clearGameState(state);
+
+    for (int level = 1; level <= 3; level++) {
+        vector<Card>& deck = state.getDeck(level);
+        vector<Card>& faceup = state.getFaceup(level);
+        for (const Card& card : all_cards) {
+            if (card.level == level) deck.push_back(card);
+        }
+        shuffleDeal(deck, rng);
+        size_t num_faceup = std::min<size_t>(4, deck.size());
+        faceup.assign(deck.begin(), deck.begin() + num_faceup);
+        deck.erase(deck.begin(), deck.begin() + num_faceup);
     }
-    for (int i = 4; i < (int)level2.size(); i++) {
-        state.deck_level2.push_back(level2[i]);
+
+    // Nobles are shuffled in place in available_nobles, then cut to 3
+    state.available_nobles.assign(all_nobles.begin(), all_nobles.end());
+    shuffleDeal(state.available_nobles, rng);
+    if (state.available_nobles.size() > 3) state.available_nobles.resize(3);
+
+    // Bank: 4 of each color, 5 jokers
+    state.bank = Tokens(4, 4, 4, 4, 4, 5);
+    state.zobrist_key = computeZobristKey(state);
+}
+
+// Start a new game in an existing state, reusing its storage. Same deal as
+// initializeGame for the seed (mt19937 + std::shuffle).
+void resetGame(GameState& state, unsigned int seed, const vector<Card>& all_cards, const vector<Noble>& all_nobles) {
+    resetGame(state, GameSeed{seed, SEED_LEGACY_MT19937}, all_cards, all_nobles);
+}
+
+void resetGame(GameState& state, const GameSeed& seed, const vector<Card>& all_cards, const vector<Noble>& all_nobles) {
+    if (seed.mode == SEED_SPLITMIX64) {
+        SplitMix64 rng(seed.value);
+        dealGame(state, all_cards, all_nobles, rng);
+        return;
     }
-    
-    for (int i = 0; i < 4 && i < (int)level3.size(); i++) {
-        state.faceup_level3.push_back(level3[i]);
+    unsigned int legacy_seed = static_cast<unsigned int>(seed.value);
+    if (legacy_seed == 0) {
+        legacy_seed = static_cast<unsigned int>(time(nullptr));
     }
-    for (int i = 4; i < (int)level3.size(); i++) {
-        state.deck_level3.push_back(level3[i]);
+    mt19937 rng(legacy_seed);
+    dealGame(state, all_cards, all_nobles, rng);
+}
+
+uint64_t entropySeed() {
+    std::random_device device;
+    uint64_t seed = (static_cast<uint64_t>(device()) << 32) ^ device();
+    seed ^= static_cast<uint64_t>(std::chrono::high_resolution_clock::now().time_since_epoch().count());
+    return mix64(seed);
+}
+
+// Initialize game state from already loaded cards and nobles
+void initializeGame(GameState& state, unsigned int seed, const vector<Card>& all_cards,
+                    const vector<Noble>& all_nobles, ostream& err_os) {
+    // Use provided seed or current time
+    if (seed == 0) {
+        seed = static_cast<unsigned int>(time(nullptr));
     }
-    
+    initializeGame(state, GameSeed{seed, SEED_LEGACY_MT19937}, all_cards, all_nobles, err_os);
+}
+
+void initializeGame(GameState& state, const GameSeed& seed, const vector<Card>& all_cards,
+                    const vector<Noble>& all_nobles, ostream& err_os) {
+    err_os << "Initializing game with seed: " << seed.value
+           << (seed.mode == SEED_SPLITMIX64 ? " (splitmix64)" : "") << endl;
+
+    resetGame(state, seed, all_cards, all_nobles);
+
+    err_os << "Level 1: " << state.faceup_level1.size() + state.deck_level1.size() << " cards" << endl;
+    err_os << "Level 2: " << state.faceup_level2.size() + state.deck_level2.size() << " cards" << endl;
+    err_os << "Level 3: " << state.faceup_level3.size() + state.deck_level3.size() << " cards" << endl;
     err_os << "Face-up cards drawn: " << state.faceup_level1.size() 
          << " (L1), " << state.faceup_level2.size() 
          << " (L2), " << state.faceup_level3.size() << " (L3)" << endl;
-    
-    // Load and shuffle nobles
-    vector<Noble> all_nobles = loadNobles(nobles_path, err_os);
-    err_os << "Loaded " << all_nobles.size() << " nobles" << endl;
-    
-    shuffle(all_nobles.begin(), all_nobles.end(), rng);
-    
-    // Draw 3 nobles
-    for (int i = 0; i < 3 && i < (int)all_nobles.size(); i++) {
-        state.available_nobles.push_back(all_nobles[i]);
-    }
-    
     err_os << "Nobles in play: " << state.available_nobles.size() << endl;
-    
-    // Initialize bank gems (4 of each color, 5 joker)
-    state.bank.black = 4;
-    state.bank.blue = 4;
-    state.bank.white = 4;
-    state.bank.green = 4;
-    state.bank.red = 4;
-    state.bank.joker = 5;
-    
     err_os << "Bank initialized: " << state.bank.total() << " total gems" << endl;
-    
-    // Initialize player gems to 0 (already default initialized)
     err_os << "Players initialized with 0 gems" << endl;
-    
-    state.current_player = 0;
-    state.move_number = 0;
-    
     err_os << "Game initialization complete!" << endl;
 }
 
@@ -1519,23 +1697,23 @@ void printGameState(const GameState& state, ostream& os) {
     os << "\n=== GAME STATE ===" << endl;
     os << "Move: " << state.move_number << ", Current Player: " << state.current_player << endl;
     
-    os << "\nBank: Black=" << state.bank.black << " Blue=" << state.bank.blue 
-         << " White=" << state.bank.white << " Green=" << state.bank.green 
-         << " Red=" << state.bank.red << " Joker=" << state.bank.joker << endl;
+    os << "\nBank: Black=" << state.bank[BLACK] << " Blue=" << state.bank[BLUE] 
+         << " White=" << state.bank[WHITE] << " Green=" << state.bank[GREEN] 
+         << " Red=" << state.bank[RED] << " Joker=" << state.bank[JOKER] << endl;
     
     os << "\nFace-up Level 1 Cards:" << endl;
     for (const Card& card : state.faceup_level1) {
-        os << "  Card #" << card.id << ": " << card.color << " (" << card.points << " pts)" << endl;
+        os << "  Card #" << card.id << ": " << colorName(card.color) << " (" << card.points << " pts)" << endl;
     }
     
     os << "\nFace-up Level 2 Cards:" << endl;
     for (const Card& card : state.faceup_level2) {
-        os << "  Card #" << card.id << ": " << card.color << " (" << card.points << " pts)" << endl;
+        os << "  Card #" << card.id << ": " << colorName(card.color) << " (" << card.points << " pts)" << endl;
     }
     
     os << "\nFace-up Level 3 Cards:" << endl;
     for (const Card& card : state.faceup_level3) {
-        os << "  Card #" << card.id << ": " << card.color << " (" << card.points << " pts)" << endl;
+        os << "  Card #" << card.id << ": " << colorName(card.color) << " (" << card.points << " pts)" << endl;
     }
     
     os << "\nNobles:" << endl;
@@ -1551,150 +1729,208 @@ void printGameState(const GameState& state, ostream& os) {
     os << "==================\n" << endl;
 }
 
-// Convert Tokens to JSON string (alphabetical order, joker last)
-string tokensToJson(const Tokens& tokens) {
-    stringstream ss;
-    ss << "{";
-    ss << "\"black\":" << tokens.black << ",";
-    ss << "\"blue\":" << tokens.blue << ",";
-    ss << "\"green\":" << tokens.green << ",";
-    ss << "\"red\":" << tokens.red << ",";
-    ss << "\"white\":" << tokens.white << ",";
-    ss << "\"joker\":" << tokens.joker;
-    ss << "}";
-    return ss.str();
+// Format a signed integer the way ostream does; returns the number of chars written
+static int formatInt(long value, char* buf) {
+    char digits[24];
+    int n = 0;
+    unsigned long magnitude = (value < 0) ? 0UL - (unsigned long)value : (unsigned long)value;
+    do {
+        digits[n++] = (char)('0' + magnitude % 10);
+        magnitude /= 10;
+    } while (magnitude != 0);
+
+    int len = 0;
+    if (value < 0) buf[len++] = '-';
+    while (n > 0) buf[len++] = digits[--n];
+    return len;
 }
 
-// Convert card bonuses/discounts to JSON (alphabetical order, no joker field)
-string discountsToJson(const Tokens& tokens) {
-    stringstream ss;
-    ss << "{";
-    ss << "\"black\":" << tokens.black << ",";
-    ss << "\"blue\":" << tokens.blue << ",";
-    ss << "\"green\":" << tokens.green << ",";
-    ss << "\"red\":" << tokens.red << ",";
-    ss << "\"white\":" << tokens.white;
-    ss << "}";
-    return ss.str();
+// Format a double the way ostream does with default flags (%g, precision 6)
+static int formatDouble(double value, char* buf, size_t size) {
+    return snprintf(buf, size, "%g", value);
 }
 
-// Convert Player to JSON string (spec format)
-string playerToJson(const Player& player, int player_id, int viewer_id) {
-    stringstream ss;
-    ss << "{";
-    ss << "\"id\":" << player_id << ",";
-    ss << "\"points\":" << player.points << ",";
-    ss << "\"gems\":" << tokensToJson(player.tokens) << ",";
-    ss << "\"discounts\":" << discountsToJson(player.bonuses) << ",";
-    
-    // Reserved card IDs (mask if viewing opponent)
-    ss << "\"reserved_card_ids\":[";
-    for (size_t i = 0; i < player.reserved.size(); i++) {
-        if (i > 0) ss << ",";
-        // Mask opponent's reserved cards with 91/92/93 based on card level
-        // (Don't mask if viewer_id is 0, meaning god mode/spectator)
-        if (viewer_id != 0 && player_id != viewer_id) {
-            ss << (90 + player.reserved[i].level);
-        } else {
-            ss << player.reserved[i].id;
-        }
-    }
-    ss << "],";
-    
-    // Purchased card IDs
-    ss << "\"purchased_card_ids\":[";
-    for (size_t i = 0; i < player.cards.size(); i++) {
-        if (i > 0) ss << ",";
-        ss << player.cards[i].id;
-    }
-    ss << "],";
-    
-    // Owned noble IDs
-    ss << "\"owned_noble_ids\":[";
-    for (size_t i = 0; i < player.nobles.size(); i++) {
-        if (i > 0) ss << ",";
-        ss << player.nobles[i].id;
-    }
-    ss << "],";
-    
-    // Time bank
-    ss << "\"time_bank\":" << player.time_bank;
-    
-    ss << "}";
-    return ss.str();
+void JsonBuffer::putInt(long value) {
+    char buf[24];
+    text.append(buf, formatInt(value, buf));
 }
 
-// Convert entire GameState to JSON string (spec format)
-string gameStateToJson(const GameState& state, int viewer_id) {
-    stringstream ss;
-    ss << "{";
-    
-    // Active player (1-indexed)
-    ss << "\"active_player_id\":" << (state.current_player + 1) << ",";
-    
-    // Who is viewing this state (omit if viewer_id is 0)
-    if (viewer_id != 0) {
-        ss << "\"you\":" << viewer_id << ",";
+void JsonBuffer::putDouble(double value) {
+    char buf[32];
+    text.append(buf, formatDouble(value, buf, sizeof(buf)));
+}
+
+// Writes the same JSON into several buffers at once. Only the viewer-dependent
+// parts ("you" and masked reserve IDs) loop over the outputs individually.
+struct JsonViews {
+    JsonBuffer* outs;
+    const int* viewers;
+    int count;
+
+    void put(char c) {
+        for (int i = 0; i < count; i++) outs[i].put(c);
     }
-    
-    // Move number (1-indexed)
-    ss << "\"move\":" << (state.move_number + 1) << ",";
-    
-    // Players array
-    ss << "\"players\":[";
-    ss << playerToJson(state.players[0], 1, viewer_id) << ",";
-    ss << playerToJson(state.players[1], 2, viewer_id);
-    ss << "],";
-    
-    // Board object
-    ss << "\"board\":{";
-    
-    // Gems on board
-    ss << "\"gems\":" << tokensToJson(state.bank) << ",";
-    
-    // Face-up cards by level (just IDs)
-    ss << "\"face_up_cards\":{";
-    
-    ss << "\"level1\":[";
-    for (size_t i = 0; i < state.faceup_level1.size(); i++) {
-        if (i > 0) ss << ",";
-        ss << state.faceup_level1[i].id;
+    void put(const char* s) {
+        for (int i = 0; i < count; i++) outs[i].put(s);
     }
-    ss << "],";
-    
-    ss << "\"level2\":[";
-    for (size_t i = 0; i < state.faceup_level2.size(); i++) {
-        if (i > 0) ss << ",";
-        ss << state.faceup_level2[i].id;
+    void putInt(long value) {
+        char buf[24];
+        int len = formatInt(value, buf);
+        for (int i = 0; i < count; i++) outs[i].text.append(buf, len);
     }
-    ss << "],";
-    
-    ss << "\"level3\":[";
-    for (size_t i = 0; i < state.faceup_level3.size(); i++) {
-        if (i > 0) ss << ",";
-        ss << state.faceup_level3[i].id;
+    void putDouble(double value) {
+        char buf[32];
+        int len = formatDouble(value, buf, sizeof(buf));
+        for (int i = 0; i < count; i++) outs[i].text.append(buf, len);
     }
-    ss << "]";
-    
-    ss << "},";
-    
-    // Deck sizes (included for engine visibility)
-    ss << "\"deck_level1_size\":" << state.deck_level1.size() << ",";
-    ss << "\"deck_level2_size\":" << state.deck_level2.size() << ",";
-    ss << "\"deck_level3_size\":" << state.deck_level3.size() << ",";
-    
-    // Nobles (just IDs)
-    ss << "\"nobles\":[";
+};
+
+// Gem counts in alphabetical order; discounts omit the joker field
+static void writeTokensJson(JsonViews& out, const Tokens& tokens, bool with_joker) {
+    out.put("{\"black\":");
+    out.putInt(tokens[BLACK]);
+    out.put(",\"blue\":");
+    out.putInt(tokens[BLUE]);
+    out.put(",\"green\":");
+    out.putInt(tokens[GREEN]);
+    out.put(",\"red\":");
+    out.putInt(tokens[RED]);
+    out.put(",\"white\":");
+    out.putInt(tokens[WHITE]);
+    if (with_joker) {
+        out.put(",\"joker\":");
+        out.putInt(tokens[JOKER]);
+    }
+    out.put('}');
+}
+
+static void writeCardIdsJson(JsonViews& out, const vector<Card>& cards) {
+    out.put('[');
+    for (size_t i = 0; i < cards.size(); i++) {
+        if (i > 0) out.put(',');
+        out.putInt(cards[i].id);
+    }
+    out.put(']');
+}
+
+static void writePlayerJson(JsonViews& out, const Player& player, int player_id) {
+    out.put("{\"id\":");
+    out.putInt(player_id);
+    out.put(",\"points\":");
+    out.putInt(player.points);
+    out.put(",\"gems\":");
+    writeTokensJson(out, player.tokens, true);
+    out.put(",\"discounts\":");
+    writeTokensJson(out, player.bonuses, false);
+
+    // Reserved card IDs, masked as 91/92/93 by level for the opponent
+    // (not masked for viewer 0, the god mode/spectator view)
+    out.put(",\"reserved_card_ids\":[");
+    for (int v = 0; v < out.count; v++) {
+        JsonBuffer& buf = out.outs[v];
+        bool masked = out.viewers[v] != 0 && player_id != out.viewers[v];
+        for (size_t i = 0; i < player.reserved.size(); i++) {
+            if (i > 0) buf.put(',');
+            buf.putInt(masked ? 90 + player.reserved[i].level : player.reserved[i].id);
+        }
+    }
+    out.put("],\"purchased_card_ids\":");
+    writeCardIdsJson(out, player.cards);
+
+    out.put(",\"owned_noble_ids\":[");
+    for (size_t i = 0; i < player.nobles.size(); i++) {
+        if (i > 0) out.put(',');
+        out.putInt(player.nobles[i].id);
+    }
+    out.put("],\"time_bank\":");
+    out.putDouble(player.time_bank);
+    out.put('}');
+}
+
+static void writeGameStateJson(JsonViews& out, const GameState& state) {
+    // Active player and move number are 1-indexed; "you" is omitted for viewer 0
+    out.put("{\"active_player_id\":");
+    out.putInt(state.current_player + 1);
+    out.put(',');
+    for (int v = 0; v < out.count; v++) {
+        if (out.viewers[v] != 0) {
+            out.outs[v].put("\"you\":");
+            out.outs[v].putInt(out.viewers[v]);
+            out.outs[v].put(',');
+        }
+    }
+    out.put("\"move\":");
+    out.putInt(state.move_number + 1);
+
+    out.put(",\"players\":[");
+    writePlayerJson(out, state.players[0], 1);
+    out.put(',');
+    writePlayerJson(out, state.players[1], 2);
+
+    out.put("],\"board\":{\"gems\":");
+    writeTokensJson(out, state.bank, true);
+    out.put(",\"face_up_cards\":{\"level1\":");
+    writeCardIdsJson(out, state.faceup_level1);
+    out.put(",\"level2\":");
+    writeCardIdsJson(out, state.faceup_level2);
+    out.put(",\"level3\":");
+    writeCardIdsJson(out, state.faceup_level3);
+    out.put("},\"deck_level1_size\":");
+    out.putInt(state.deck_level1.size());
+    out.put(",\"deck_level2_size\":");
+    out.putInt(state.deck_level2.size());
+    out.put(",\"deck_level3_size\":");
+    out.putInt(state.deck_level3.size());
+
+    out.put(",\"nobles\":[");
     for (size_t i = 0; i < state.available_nobles.size(); i++) {
-        if (i > 0) ss << ",";
-        ss << state.available_nobles[i].id;
+        if (i > 0) out.put(',');
+        out.putInt(state.available_nobles[i].id);
     }
-    ss << "]";
-    
-    ss << "}";  // end board
-    
-    ss << "}";  // end root
-    return ss.str();
+    out.put("]}}");
+}
+
+void writeGameStateJson(const GameState& state, int viewer_id, JsonBuffer& out) {
+    JsonViews views = {&out, &viewer_id, 1};
+    writeGameStateJson(views, state);
+}
+
+void writeGameStateJson(const GameState& state, const int* viewer_ids, JsonBuffer* outs, int count) {
+    JsonViews views = {outs, viewer_ids, count};
+    writeGameStateJson(views, state);
+}
+
+// Convert tokens to JSON (alphabetical order)
+string tokensToJson(const Tokens& tokens) {
+    JsonBuffer buf(64);
+    int viewer = 0;
+    JsonViews views = {&buf, &viewer, 1};
+    writeTokensJson(views, tokens, true);
+    return buf.text;
+}
+
+// Convert card bonuses/discounts to JSON (alphabetical order, no joker field)
+string discountsToJson(const Tokens& tokens) {
+    JsonBuffer buf(64);
+    int viewer = 0;
+    JsonViews views = {&buf, &viewer, 1};
+    writeTokensJson(views, tokens, false);
+    return buf.text;
+}
+
+// Convert Player to JSON string (spec format)
+string playerToJson(const Player& player, int player_id, int viewer_id) {
+    JsonBuffer buf(512);
+    JsonViews views = {&buf, &viewer_id, 1};
+    writePlayerJson(views, player, player_id);
+    return buf.text;
+}
+
+// Convert entire GameState to JSON string (spec format)
+string gameStateToJson(const GameState& state, int viewer_id) {
+    JsonBuffer buf;
+    writeGameStateJson(state, viewer_id, buf);
+    return buf.text;
 }
 
 // Print game state as JSON (for a specific viewer)
@@ -1702,6 +1938,278 @@ void printJsonGameState(const GameState& state, int viewer_id, ostream& os) {
     os << gameStateToJson(state, viewer_id) << endl;
 }
 
+// Reserved card ID as the viewer sees it (91/92/93 for the opponent's reserves)
+static int visibleReservedId(const Card& card, int owner_id, int viewer_id) {
+    return (viewer_id != 0 && owner_id != viewer_id) ? 90 + card.level : card.id;
+}
+
+// New counts of the colors that differ; returns the changed-color mask
+static uint8_t diffTokens(const Tokens& before, const Tokens& after, int num_colors, Tokens& out) {
+    uint8_t mask = 0;
+    for (int c = 0; c < num_colors; c++) {
+        if (before[c] != after[c]) {
+            mask |= (uint8_t)(1 << c);
+            out[c] = after[c];
+        }
+    }
+    return mask;
+}
+
+// Cards and nobles only ever grow during a game, so after must be a later state of
+// the same game as before
+void computeStateDelta(const GameState& before, const GameState& after, int viewer_id, StateDelta& out) {
+    out = StateDelta();
+    out.current_player = after.current_player;
+    out.move_number = after.move_number;
+    out.bank_mask = diffTokens(before.bank, after.bank, NUM_TOKEN_COLORS, out.bank);
+
+    for (int level = 1; level <= 3; level++) {
+        const vector<Card>& old_row = before.getFaceup(level);
+        const vector<Card>& new_row = after.getFaceup(level);
+        if (old_row.size() != new_row.size()) out.faceup_size[level - 1] = (int)new_row.size();
+        for (size_t i = 0; i < new_row.size(); i++) {
+            if (i >= old_row.size() || old_row[i].id != new_row[i].id) {
+                out.faceup.push_back(FaceupChange{level, (int)i, new_row[i].id});
+            }
+        }
+        if (before.getDeck(level).size() != after.getDeck(level).size()) {
+            out.deck_size[level - 1] = (int)after.getDeck(level).size();
+        }
+    }
+
+    out.nobles_changed = before.available_nobles.size() != after.available_nobles.size();
+    for (size_t i = 0; !out.nobles_changed && i < after.available_nobles.size(); i++) {
+        out.nobles_changed = before.available_nobles[i].id != after.available_nobles[i].id;
+    }
+    if (out.nobles_changed) {
+        for (const Noble& noble : after.available_nobles) out.nobles.push_back(noble.id);
+    }
+
+    for (int p = 0; p < 2; p++) {
+        const Player& old_player = before.players[p];
+        const Player& player = after.players[p];
+        PlayerDelta& delta = out.players[p];
+        delta.token_mask = diffTokens(old_player.tokens, player.tokens, NUM_TOKEN_COLORS, delta.tokens);
+        delta.bonus_mask = diffTokens(old_player.bonuses, player.bonuses, NUM_GEM_COLORS, delta.bonuses);
+        if (old_player.points != player.points) delta.points = player.points;
+
+        delta.reserved_changed = old_player.reserved.size() != player.reserved.size();
+        for (size_t i = 0; !delta.reserved_changed && i < player.reserved.size(); i++) {
+            delta.reserved_changed = visibleReservedId(old_player.reserved[i], p + 1, viewer_id) !=
+                                     visibleReservedId(player.reserved[i], p + 1, viewer_id);
+        }
+        if (delta.reserved_changed) {
+            for (const Card& card : player.reserved) delta.reserved.push_back(visibleReservedId(card, p + 1, viewer_id));
+        }
+        for (size_t i = old_player.cards.size(); i < player.cards.size(); i++) delta.cards_added.push_back(player.cards[i].id);
+        for (size_t i = old_player.nobles.size(); i < player.nobles.size(); i++) delta.nobles_added.push_back(player.nobles[i].id);
+        delta.time_bank = player.time_bank;
+    }
+}
+
+// Card for a delta ID: 0 is an empty slot of the level, 91-93 a masked reserve
+static bool deltaCard(int id, int level, const vector<Card>& all_cards, Card& out) {
+    if (id == 0 || (id >= 91 && id <= 93)) {
+        out = Card{id, id == 0 ? level : id - 90, 0, NO_COLOR, {}, 0};
+        return true;
+    }
+    out = loadCardById(id, all_cards);
+    return out.id != 0;
+}
+
+static bool deltaNoble(int id, const vector<Noble>& all_nobles, vector<Noble>& out) {
+    for (const Noble& noble : all_nobles) {
+        if (noble.id == id) {
+            out.push_back(noble);
+            return true;
+        }
+    }
+    return false;
+}
+
+ValidationResult applyStateDelta(GameState& state, const StateDelta& delta, const vector<Card>& all_cards,
+                                 const vector<Noble>& all_nobles) {
+    state.current_player = delta.current_player;
+    state.move_number = delta.move_number;
+    for (int c = 0; c < NUM_TOKEN_COLORS; c++) {
+        if (delta.bank_mask & (1 << c)) state.bank[c] = delta.bank[c];
+    }
+
+    for (int level = 1; level <= 3; level++) {
+        if (delta.faceup_size[level - 1] >= 0) {
+            state.getFaceup(level).resize(delta.faceup_size[level - 1], Card{0, level, 0, NO_COLOR, {}, 0});
+        }
+        if (delta.deck_size[level - 1] >= 0) {
+            state.getDeck(level).resize(delta.deck_size[level - 1], Card{0, level, 0, NO_COLOR, {}, 0});
+        }
+    }
+    for (const FaceupChange& change : delta.faceup) {
+        if (change.level < 1 || change.level > 3 || change.slot < 0 ||
+            change.slot >= (int)state.getFaceup(change.level).size()) {
+            return ValidationResult(false, "Face-up change outside the board");
+        }
+        Card card;
+        if (!deltaCard(change.card_id, change.level, all_cards, card)) {
+            return ValidationResult(false, "Unknown card id " + to_string(change.card_id));
+        }
+        state.getFaceup(change.level)[change.slot] = card;
+    }
+    if (delta.nobles_changed) {
+        state.available_nobles.clear();
+        for (int id : delta.nobles) {
+            if (!deltaNoble(id, all_nobles, state.available_nobles)) return ValidationResult(false, "Unknown noble id " + to_string(id));
+        }
+    }
+
+    for (int p = 0; p < 2; p++) {
+        const PlayerDelta& pd = delta.players[p];
+        Player& player = state.players[p];
+        for (int c = 0; c < NUM_TOKEN_COLORS; c++) {
+            if (pd.token_mask & (1 << c)) player.tokens[c] = pd.tokens[c];
+            if (pd.bonus_mask & (1 << c)) player.bonuses[c] = pd.bonuses[c];
+        }
+        if (pd.points >= 0) player.points = pd.points;
+        if (pd.reserved_changed) {
+            player.reserved.clear();
+            for (int id : pd.reserved) {
+                Card card;
+                if (!deltaCard(id, 0, all_cards, card) || id == 0) return ValidationResult(false, "Unknown card id " + to_string(id));
+                player.reserved.push_back(card);
+            }
+        }
+        for (int id : pd.cards_added) {
+            Card card = loadCardById(id, all_cards);
+            if (card.id == 0) return ValidationResult(false, "Unknown card id " + to_string(id));
+            player.cards.push_back(card);
+        }
+        for (int id : pd.nobles_added) {
+            if (!deltaNoble(id, all_nobles, player.nobles)) return ValidationResult(false, "Unknown noble id " + to_string(id));
+        }
+        player.time_bank = pd.time_bank;
+    }
+
+    state.zobrist_key = computeZobristKey(state);
+    return ValidationResult(true);
+}
+
+// Only the colors in mask, in the same alphabetical order as the full state
+static void writeMaskedTokensJson(JsonBuffer& out, const Tokens& tokens, uint8_t mask) {
+    static const Color ORDER[NUM_TOKEN_COLORS] = {BLACK, BLUE, GREEN, RED, WHITE, JOKER};
+    bool first = true;
+    out.put('{');
+    for (Color color : ORDER) {
+        if (!(mask & (1 << color))) continue;
+        if (!first) out.put(',');
+        first = false;
+        out.put('"');
+        out.put(colorName(color));
+        out.put("\":");
+        out.putInt(tokens[color]);
+    }
+    out.put('}');
+}
+
+static void writeIdListJson(JsonBuffer& out, const vector<int>& ids) {
+    out.put('[');
+    for (size_t i = 0; i < ids.size(); i++) {
+        if (i > 0) out.put(',');
+        out.putInt(ids[i]);
+    }
+    out.put(']');
+}
+
+void writeStateDeltaJson(const StateDelta& delta, int viewer_id, JsonBuffer& out) {
+    out.put("{\"delta\":1,\"active_player_id\":");
+    out.putInt(delta.current_player + 1);
+    if (viewer_id != 0) {
+        out.put(",\"you\":");
+        out.putInt(viewer_id);
+    }
+    out.put(",\"move\":");
+    out.putInt(delta.move_number + 1);
+
+    out.put(",\"players\":[");
+    for (int p = 0; p < 2; p++) {
+        const PlayerDelta& pd = delta.players[p];
+        out.put(p == 0 ? "{\"id\":" : ",{\"id\":");
+        out.putInt(p + 1);
+        if (pd.points >= 0) {
+            out.put(",\"points\":");
+            out.putInt(pd.points);
+        }
+        if (pd.token_mask) {
+            out.put(",\"gems\":");
+            writeMaskedTokensJson(out, pd.tokens, pd.token_mask);
+        }
+        if (pd.bonus_mask) {
+            out.put(",\"discounts\":");
+            writeMaskedTokensJson(out, pd.bonuses, pd.bonus_mask);
+        }
+        if (pd.reserved_changed) {
+            out.put(",\"reserved_card_ids\":");
+            writeIdListJson(out, pd.reserved);
+        }
+        if (!pd.cards_added.empty()) {
+            out.put(",\"purchased_add\":");
+            writeIdListJson(out, pd.cards_added);
+        }
+        if (!pd.nobles_added.empty()) {
+            out.put(",\"nobles_add\":");
+            writeIdListJson(out, pd.nobles_added);
+        }
+        out.put(",\"time_bank\":");
+        out.putDouble(pd.time_bank);
+        out.put('}');
+    }
+
+    // Board members are comma-separated as they are emitted, since any may be absent
+    out.put("],\"board\":{");
+    bool first = true;
+    auto key = [&](const char* name) {
+        out.put(first ? "\"" : ",\"");
+        out.put(name);
+        out.put("\":");
+        first = false;
+    };
+    if (delta.bank_mask) {
+        key("gems");
+        writeMaskedTokensJson(out, delta.bank, delta.bank_mask);
+    }
+    if (!delta.faceup.empty()) {
+        key("face_up_changes");
+        out.put('[');
+        for (size_t i = 0; i < delta.faceup.size(); i++) {
+            out.put(i == 0 ? "[" : ",[");
+            out.putInt(delta.faceup[i].level);
+            out.put(',');
+            out.putInt(delta.faceup[i].slot);
+            out.put(',');
+            out.putInt(delta.faceup[i].card_id);
+            out.put(']');
+        }
+        out.put(']');
+    }
+    if (delta.faceup_size[0] >= 0 || delta.faceup_size[1] >= 0 || delta.faceup_size[2] >= 0) {
+        key("face_up_sizes");
+        for (int level = 0; level < 3; level++) {
+            out.put(level == 0 ? '[' : ',');
+            out.putInt(delta.faceup_size[level]);
+        }
+        out.put(']');
+    }
+    static const char* const DECK_KEYS[] = {"deck_level1_size", "deck_level2_size", "deck_level3_size"};
+    for (int level = 0; level < 3; level++) {
+        if (delta.deck_size[level] < 0) continue;
+        key(DECK_KEYS[level]);
+        out.putInt(delta.deck_size[level]);
+    }
+    if (delta.nobles_changed) {
+        key("nobles");
+        writeIdListJson(out, delta.nobles);
+    }
+    out.put("}}");
+}
+
 // Process SETUP commands for replay mode
 void processSetupCommands(GameState& state, vector<Card>& all_cards, vector<Noble>& all_nobles, istream& is, ostream& err_os) {
     string line;
@@ -1831,6 +2339,7 @@ void processSetupCommands(GameState& state, vector<Card>& all_cards, vector<Nobl
             }
         }
     }
+    state.zobrist_key = computeZobristKey(state);
 }
 
 // Process REVEAL command to manually place a card
@@ -1890,6 +2399,7 @@ bool processRevealCommand(GameState& state, const string& line, vector<Card>& al
         state.pending_blind_reserve_player = -1;
         state.pending_blind_reserve_level = -1;
         state.reveal_expected = false;
+        state.zobrist_key = computeZobristKey(state);
         return true;
     }
     
@@ -1928,71 +2438,147 @@ bool processRevealCommand(GameState& state, const string& line, vector<Card>& al
     }
     
     state.reveal_expected = false;
+    state.zobrist_key = computeZobristKey(state);
     return true;
 }
 
+// Upper bound on return combinations considered for a single take/reserve
+const int MAX_RETURN_COMBINATIONS = 50;
+
 // Helper to generate all combinations of returning gems to reach 10
-void generateReturnCombinations(const Tokens& current_tokens, int num_to_return, Tokens current_return, int color_idx, std::vector<Tokens>& results) {
-    if (results.size() >= 50) return;
+void generateReturnCombinations(const Tokens& current_tokens, int num_to_return, Tokens current_return, int color_idx, Tokens* results, int& count) {
+    if (count >= MAX_RETURN_COMBINATIONS) return;
     if (num_to_return <= 0) {
-        results.push_back(current_return);
+        results[count++] = current_return;
         return;
     }
-    if (color_idx >= 6) return;
-
-    int available = 0;
-    if (color_idx == 0) available = current_tokens.black;
-    else if (color_idx == 1) available = current_tokens.blue;
-    else if (color_idx == 2) available = current_tokens.white;
-    else if (color_idx == 3) available = current_tokens.green;
-    else if (color_idx == 4) available = current_tokens.red;
-    else if (color_idx == 5) available = current_tokens.joker;
+    if (color_idx >= NUM_TOKEN_COLORS) return;
 
+    int available = current_tokens[color_idx];
     for (int i = 0; i <= std::min(num_to_return, available); ++i) {
         Tokens next_return = current_return;
-        if (color_idx == 0) next_return.black = i;
-        else if (color_idx == 1) next_return.blue = i;
-        else if (color_idx == 2) next_return.white = i;
-        else if (color_idx == 3) next_return.green = i;
-        else if (color_idx == 4) next_return.red = i;
-        else if (color_idx == 5) next_return.joker = i;
+        next_return[color_idx] = i;
         
-        generateReturnCombinations(current_tokens, num_to_return - i, next_return, color_idx + 1, results);
-        if (results.size() >= 50) return;
+        generateReturnCombinations(current_tokens, num_to_return - i, next_return, color_idx + 1, results, count);
+        if (count >= MAX_RETURN_COMBINATIONS) return;
     }
 }
 
-std::vector<Move> findAllValidMoves(const GameState& state) {
-    std::vector<Move> validMoves;
+Move toMove(const CompactMove& cm, int player_id) {
+    Move m;
+    m.type = static_cast<MoveType>(cm.type);
+    m.player_id = player_id;
+    m.card_id = cm.card_id;
+    m.noble_id = cm.noble_id;
+    m.auto_payment = (cm.type == BUY_CARD);
+    for (int c = 0; c < NUM_GEM_COLORS; c++) m.gems_taken[c] = cm.gems_taken[c];
+    for (int c = 0; c < NUM_TOKEN_COLORS; c++) m.gems_returned[c] = cm.gems_returned[c];
+    return m;
+}
+
+CompactMove toCompactMove(const Move& move) {
+    CompactMove cm = CompactMove();
+    cm.type = static_cast<uint8_t>(move.type);
+    cm.card_id = (move.type == RESERVE_CARD || move.type == BUY_CARD) ? static_cast<uint8_t>(move.card_id) : 0;
+    cm.noble_id = static_cast<int8_t>(move.noble_id);
+    for (int c = 0; c < NUM_GEM_COLORS; c++) cm.gems_taken[c] = static_cast<uint8_t>(move.gems_taken[c]);
+    for (int c = 0; c < NUM_TOKEN_COLORS; c++) cm.gems_returned[c] = static_cast<uint8_t>(move.gems_returned[c]);
+    return cm;
+}
+
+// 32-bit move encoding (0 = no move):
+//   bits 0-2   type + 1
+//   bits 3-9   card_id (RESERVE/BUY)
+//   bits 10-19 gems_taken, 2 bits per gem color (TAKE); noble_id + 1 in bits 10-13 (BUY)
+//   bits 20-31 gems_returned, 2 bits per token color
+uint32_t encodeMove(const CompactMove& cm) {
+    uint32_t code = (uint32_t)(cm.type + 1) | ((uint32_t)(cm.card_id & 0x7F) << 3);
+    if (cm.type == BUY_CARD) {
+        code |= (uint32_t)((cm.noble_id + 1) & 0xF) << 10;
+    } else {
+        for (int c = 0; c < NUM_GEM_COLORS; c++) code |= (uint32_t)(cm.gems_taken[c] & 3) << (10 + 2 * c);
+    }
+    for (int c = 0; c < NUM_TOKEN_COLORS; c++) code |= (uint32_t)(cm.gems_returned[c] & 3) << (20 + 2 * c);
+    return code;
+}
+
+uint32_t encodeMove(const Move& move) {
+    return encodeMove(toCompactMove(move));
+}
+
+CompactMove decodeMove(uint32_t code) {
+    CompactMove cm = CompactMove();
+    cm.type = (uint8_t)((code & 7) - 1);
+    cm.card_id = (uint8_t)((code >> 3) & 0x7F);
+    cm.noble_id = -1;
+    if (cm.type == BUY_CARD) {
+        cm.noble_id = (int8_t)(((code >> 10) & 0xF) - 1);
+    } else {
+        for (int c = 0; c < NUM_GEM_COLORS; c++) cm.gems_taken[c] = (code >> (10 + 2 * c)) & 3;
+    }
+    for (int c = 0; c < NUM_TOKEN_COLORS; c++) cm.gems_returned[c] = (code >> (20 + 2 * c)) & 3;
+    return cm;
+}
+
+// Generate all valid moves for the current player into a caller-owned buffer.
+// Moves are legal by construction (no validateMove pass) and no heap allocation
+// happens per call. Build with -DSPLENDOR_DEBUG_MOVEGEN to cross-check every
+// generated move against validateMove. Order matches findAllValidMoves.
+int generateMoves(const GameState& state, MoveList& out) {
+    out.count = 0;
     int p_idx = state.current_player;
     const Player& player = state.players[p_idx];
+    const Tokens& tokens = player.tokens;
+    const Tokens& bank = state.bank;
+    PackedTokens packed_tokens = packTokens(tokens);
+    PackedTokens packed_bonuses = packTokens(player.bonuses);
+
+    auto push = [&](const CompactMove& m) {
+#ifdef SPLENDOR_DEBUG_MOVEGEN
+        ValidationResult check = validateMove(state, toMove(m, p_idx));
+        if (!check.valid) {
+            cerr << "generateMoves produced an illegal move \"" << moveToString(toMove(m, p_idx))
+                 << "\": " << check.error_message << endl;
+            std::abort();
+        }
+#endif
+        if (out.count < MAX_MOVES) out.moves[out.count++] = m;
+    };
+
+    // Emit the move as-is, or once per way of returning gems down to 10
+    Tokens rets[MAX_RETURN_COMBINATIONS];
+    auto pushWithReturns = [&](CompactMove m, const Tokens& after) {
+        int excess = after.total() - 10;
+        if (excess <= 0) { push(m); return; }
+        int n = 0;
+        generateReturnCombinations(after, excess, Tokens(), 0, rets, n);
+        for (int r = 0; r < n; r++) {
+            for (int c = 0; c < NUM_TOKEN_COLORS; c++) m.gems_returned[c] = static_cast<uint8_t>(rets[r][c]);
+            push(m);
+        }
+    };
 
     // --- BUY ---
     auto handleBuy = [&](const Card& card) {
         if (card.id == 0) return;
-        Tokens new_bonuses = player.bonuses;
-        if (card.color == "black") new_bonuses.black++;
-        else if (card.color == "blue") new_bonuses.blue++;
-        else if (card.color == "white") new_bonuses.white++;
-        else if (card.color == "green") new_bonuses.green++;
-        else if (card.color == "red") new_bonuses.red++;
-
-        std::vector<int> qualifying;
-        for (const auto& noble : state.available_nobles) {
-            if (new_bonuses.black >= noble.requirements.black &&
-                new_bonuses.blue >= noble.requirements.blue &&
-                new_bonuses.white >= noble.requirements.white &&
-                new_bonuses.green >= noble.requirements.green &&
-                new_bonuses.red >= noble.requirements.red) {
-                qualifying.push_back(noble.id);
-            }
-        }
+        // Affordable when jokers cover whatever bonuses and matching gems leave unpaid
+        PackedTokens effective_cost = packedEffectiveCost(card.packed_cost, packed_bonuses);
+        if (packedJokerShortfall(effective_cost, packed_tokens) > tokens[JOKER]) return;
+
+        PackedTokens new_bonuses = packed_bonuses;
+        if (card.color < JOKER) new_bonuses += packedLane(card.color);
 
-        Move m; m.type = BUY_CARD; m.player_id = p_idx; m.card_id = card.id; m.auto_payment = true;
-        if (qualifying.size() > 1) {
-            for (int nid : qualifying) { Move nm = m; nm.noble_id = nid; if (validateMove(state, nm).valid) validMoves.push_back(nm); }
+        auto qualifies = [&](const Noble& noble) { return meetsRequirements(new_bonuses, noble); };
+        int qualifying = 0;
+        for (const auto& noble : state.available_nobles) if (qualifies(noble)) qualifying++;
+
+        CompactMove m = CompactMove(); m.type = BUY_CARD; m.card_id = static_cast<uint8_t>(card.id); m.noble_id = -1;
+        if (qualifying > 1) {
+            for (const auto& noble : state.available_nobles) {
+                if (qualifies(noble)) { m.noble_id = static_cast<int8_t>(noble.id); push(m); }
+            }
         } else {
-            if (validateMove(state, m).valid) validMoves.push_back(m);
+            push(m);
         }
     };
     for (const auto& c : state.faceup_level1) handleBuy(c);
@@ -2002,14 +2588,11 @@ std::vector<Move> findAllValidMoves(const GameState& state) {
 
     // --- RESERVE ---
     if (player.reserved.size() < 3) {
+        Tokens after = player.tokens;
+        if (state.bank[JOKER] > 0) after[JOKER]++;
         auto handleRes = [&](int cid) {
-            Move m; m.type = RESERVE_CARD; m.player_id = p_idx; m.card_id = cid;
-            int gain = (state.bank.joker > 0) ? 1 : 0;
-            if (player.tokens.total() + gain > 10) {
-                Tokens cur = player.tokens; cur.joker += gain;
-                std::vector<Tokens> rets; generateReturnCombinations(cur, cur.total() - 10, Tokens(), 0, rets);
-                for (const auto& r : rets) { Move rm = m; rm.gems_returned = r; if (validateMove(state, rm).valid) validMoves.push_back(rm); }
-            } else { if (validateMove(state, m).valid) validMoves.push_back(m); }
+            CompactMove m = CompactMove(); m.type = RESERVE_CARD; m.card_id = static_cast<uint8_t>(cid); m.noble_id = -1;
+            pushWithReturns(m, after);
         };
         for (const auto& c : state.faceup_level1) if (c.id > 0) handleRes(c.id);
         for (const auto& c : state.faceup_level2) if (c.id > 0) handleRes(c.id);
@@ -2020,70 +2603,68 @@ std::vector<Move> findAllValidMoves(const GameState& state) {
     }
 
     // --- TAKE ---
-    // Take 2 of same color
-    for (int i = 0; i < 5; i++) {
-        Move m; m.type = TAKE_GEMS; m.player_id = p_idx;
-        if (i == 0) m.gems_taken.black = 2; else if (i == 1) m.gems_taken.blue = 2; else if (i == 2) m.gems_taken.white = 2; else if (i == 3) m.gems_taken.green = 2; else if (i == 4) m.gems_taken.red = 2;
-        if (player.tokens.total() + 2 > 10) {
-            Tokens cur = player.tokens; 
-            if (i == 0) cur.black += 2; else if (i == 1) cur.blue += 2; else if (i == 2) cur.white += 2; else if (i == 3) cur.green += 2; else if (i == 4) cur.red += 2;
-            std::vector<Tokens> rets; generateReturnCombinations(cur, cur.total() - 10, Tokens(), 0, rets);
-            for (const auto& r : rets) { Move tm = m; tm.gems_returned = r; if (validateMove(state, tm).valid) validMoves.push_back(tm); }
-        } else { if (validateMove(state, m).valid) validMoves.push_back(m); }
-    }
-    int colors_available = (state.bank.black > 0) + (state.bank.blue > 0) + (state.bank.white > 0) + (state.bank.green > 0) + (state.bank.red > 0);
+    auto handleTake = [&](const int* colors, int num_colors, int per_color) {
+        CompactMove m = CompactMove(); m.type = TAKE_GEMS; m.noble_id = -1;
+        Tokens after = tokens;
+        for (int i = 0; i < num_colors; i++) {
+            m.gems_taken[colors[i]] = static_cast<uint8_t>(per_color);
+            after[colors[i]] += per_color;
+        }
+        pushWithReturns(m, after);
+    };
+
+    // Take 2 of same color (needs 4+ in the bank)
+    for (int i = 0; i < NUM_GEM_COLORS; i++) {
+        if (bank[i] < 4) continue;
+        handleTake(&i, 1, 2);
+    }
+    int colors_available = 0;
+    for (int c = 0; c < NUM_GEM_COLORS; c++) colors_available += (bank[c] > 0);
     int take_count = std::min(3, colors_available);
 
     if (take_count == 3) {
         for (int i = 0; i < 5; i++) {
             for (int j = i + 1; j < 5; j++) {
                 for (int k = j + 1; k < 5; k++) {
-                    Move m; m.type = TAKE_GEMS; m.player_id = p_idx;
-                    auto set = [&](int idx, Tokens& t) { if (idx == 0) t.black = 1; else if (idx == 1) t.blue = 1; else if (idx == 2) t.white = 1; else if (idx == 3) t.green = 1; else if (idx == 4) t.red = 1; };
-                    set(i, m.gems_taken); set(j, m.gems_taken); set(k, m.gems_taken);
-                    if (player.tokens.total() + 3 > 10) {
-                        Tokens cur = player.tokens; 
-                        auto add = [&](int idx, Tokens& t) { if (idx == 0) t.black++; else if (idx == 1) t.blue++; else if (idx == 2) t.white++; else if (idx == 3) t.green++; else if (idx == 4) t.red++; };
-                        add(i, cur); add(j, cur); add(k, cur);
-                        std::vector<Tokens> rets; generateReturnCombinations(cur, cur.total() - 10, Tokens(), 0, rets);
-                        for (const auto& r : rets) { Move tm = m; tm.gems_returned = r; if (validateMove(state, tm).valid) validMoves.push_back(tm); }
-                    } else { if (validateMove(state, m).valid) validMoves.push_back(m); }
+                    if (!bank[i] || !bank[j] || !bank[k]) continue;
+                    int colors[3] = {i, j, k};
+                    handleTake(colors, 3, 1);
                 }
             }
         }
     } else if (take_count == 2) {
         for (int i = 0; i < 5; i++) {
             for (int j = i + 1; j < 5; j++) {
-                Move m; m.type = TAKE_GEMS; m.player_id = p_idx;
-                auto set = [&](int idx, Tokens& t) { if (idx == 0) t.black = 1; else if (idx == 1) t.blue = 1; else if (idx == 2) t.white = 1; else if (idx == 3) t.green = 1; else if (idx == 4) t.red = 1; };
-                set(i, m.gems_taken); set(j, m.gems_taken);
-                if (player.tokens.total() + 2 > 10) {
-                    Tokens cur = player.tokens; 
-                    auto add = [&](int idx, Tokens& t) { if (idx == 0) t.black++; else if (idx == 1) t.blue++; else if (idx == 2) t.white++; else if (idx == 3) t.green++; else if (idx == 4) t.red++; };
-                    add(i, cur); add(j, cur);
-                    std::vector<Tokens> rets; generateReturnCombinations(cur, cur.total() - 10, Tokens(), 0, rets);
-                    for (const auto& r : rets) { Move tm = m; tm.gems_returned = r; if (validateMove(state, tm).valid) validMoves.push_back(tm); }
-                } else { if (validateMove(state, m).valid) validMoves.push_back(m); }
+                if (!bank[i] || !bank[j]) continue;
+                int colors[2] = {i, j};
+                handleTake(colors, 2, 1);
             }
         }
     } else if (take_count == 1) {
         for (int i = 0; i < 5; i++) {
-            Move m; m.type = TAKE_GEMS; m.player_id = p_idx;
-            if (i == 0) m.gems_taken.black = 1; else if (i == 1) m.gems_taken.blue = 1; else if (i == 2) m.gems_taken.white = 1; else if (i == 3) m.gems_taken.green = 1; else if (i == 4) m.gems_taken.red = 1;
-            if (player.tokens.total() + 1 > 10) {
-                Tokens cur = player.tokens; if (i == 0) cur.black += 1; else if (i == 1) cur.blue += 1; else if (i == 2) cur.white += 1; else if (i == 3) cur.green += 1; else if (i == 4) cur.red += 1;
-                std::vector<Tokens> rets; generateReturnCombinations(cur, cur.total() - 10, Tokens(), 0, rets);
-                for (const auto& r : rets) { Move tm = m; tm.gems_returned = r; if (validateMove(state, tm).valid) validMoves.push_back(tm); }
-            } else { if (validateMove(state, m).valid) validMoves.push_back(m); }
+            if (!bank[i]) continue;
+            handleTake(&i, 1, 1);
         }
     }
 
     // --- PASS ---
-    if (validMoves.empty()) {
-        Move m; m.type = PASS_TURN; m.player_id = p_idx;
-        validMoves.push_back(m);
+    if (out.count == 0) {
+        CompactMove m = CompactMove(); m.type = PASS_TURN; m.noble_id = -1;
+        out.moves[out.count++] = m;
     }
 
+    return out.count;
+}
+
+std::vector<Move> findAllValidMoves(const GameState& state) {
+    MoveList list;
+    generateMoves(state, list);
+
+    std::vector<Move> validMoves;
+    validMoves.reserve(list.count);
+    for (int i = 0; i < list.count; i++) {
+        validMoves.push_back(toMove(list.moves[i], state.current_player));
+    }
     return validMoves;
 }
 
@@ -2091,30 +2672,30 @@ std::string moveToString(const Move& m) {
     std::stringstream ss;
     if (m.type == TAKE_GEMS) {
         ss << "TAKE";
-        if (m.gems_taken.black) { for (int i=0; i<m.gems_taken.black; i++) ss << " black"; }
-        if (m.gems_taken.blue) { for (int i=0; i<m.gems_taken.blue; i++) ss << " blue"; }
-        if (m.gems_taken.white) { for (int i=0; i<m.gems_taken.white; i++) ss << " white"; }
-        if (m.gems_taken.green) { for (int i=0; i<m.gems_taken.green; i++) ss << " green"; }
-        if (m.gems_taken.red) { for (int i=0; i<m.gems_taken.red; i++) ss << " red"; }
+        if (m.gems_taken[BLACK]) { for (int i=0; i<m.gems_taken[BLACK]; i++) ss << " black"; }
+        if (m.gems_taken[BLUE]) { for (int i=0; i<m.gems_taken[BLUE]; i++) ss << " blue"; }
+        if (m.gems_taken[WHITE]) { for (int i=0; i<m.gems_taken[WHITE]; i++) ss << " white"; }
+        if (m.gems_taken[GREEN]) { for (int i=0; i<m.gems_taken[GREEN]; i++) ss << " green"; }
+        if (m.gems_taken[RED]) { for (int i=0; i<m.gems_taken[RED]; i++) ss << " red"; }
         if (m.gems_returned.total() > 0) {
             ss << " RETURN";
-            if (m.gems_returned.black) { for (int i=0; i<m.gems_returned.black; i++) ss << " black"; }
-            if (m.gems_returned.blue) { for (int i=0; i<m.gems_returned.blue; i++) ss << " blue"; }
-            if (m.gems_returned.white) { for (int i=0; i<m.gems_returned.white; i++) ss << " white"; }
-            if (m.gems_returned.green) { for (int i=0; i<m.gems_returned.green; i++) ss << " green"; }
-            if (m.gems_returned.red) { for (int i=0; i<m.gems_returned.red; i++) ss << " red"; }
-            if (m.gems_returned.joker) { for (int i=0; i<m.gems_returned.joker; i++) ss << " joker"; }
+            if (m.gems_returned[BLACK]) { for (int i=0; i<m.gems_returned[BLACK]; i++) ss << " black"; }
+            if (m.gems_returned[BLUE]) { for (int i=0; i<m.gems_returned[BLUE]; i++) ss << " blue"; }
+            if (m.gems_returned[WHITE]) { for (int i=0; i<m.gems_returned[WHITE]; i++) ss << " white"; }
+            if (m.gems_returned[GREEN]) { for (int i=0; i<m.gems_returned[GREEN]; i++) ss << " green"; }
+            if (m.gems_returned[RED]) { for (int i=0; i<m.gems_returned[RED]; i++) ss << " red"; }
+            if (m.gems_returned[JOKER]) { for (int i=0; i<m.gems_returned[JOKER]; i++) ss << " joker"; }
         }
     } else if (m.type == RESERVE_CARD) {
         ss << "RESERVE " << m.card_id;
         if (m.gems_returned.total() > 0) {
             ss << " RETURN";
-            if (m.gems_returned.black) { for (int i=0; i<m.gems_returned.black; i++) ss << " black"; }
-            if (m.gems_returned.blue) { for (int i=0; i<m.gems_returned.blue; i++) ss << " blue"; }
-            if (m.gems_returned.white) { for (int i=0; i<m.gems_returned.white; i++) ss << " white"; }
-            if (m.gems_returned.green) { for (int i=0; i<m.gems_returned.green; i++) ss << " green"; }
-            if (m.gems_returned.red) { for (int i=0; i<m.gems_returned.red; i++) ss << " red"; }
-            if (m.gems_returned.joker) { for (int i=0; i<m.gems_returned.joker; i++) ss << " joker"; }
+            if (m.gems_returned[BLACK]) { for (int i=0; i<m.gems_returned[BLACK]; i++) ss << " black"; }
+            if (m.gems_returned[BLUE]) { for (int i=0; i<m.gems_returned[BLUE]; i++) ss << " blue"; }
+            if (m.gems_returned[WHITE]) { for (int i=0; i<m.gems_returned[WHITE]; i++) ss << " white"; }
+            if (m.gems_returned[GREEN]) { for (int i=0; i<m.gems_returned[GREEN]; i++) ss << " green"; }
+            if (m.gems_returned[RED]) { for (int i=0; i<m.gems_returned[RED]; i++) ss << " red"; }
+            if (m.gems_returned[JOKER]) { for (int i=0; i<m.gems_returned[JOKER]; i++) ss << " joker"; }
         }
     } else if (m.type == BUY_CARD) {
         ss << "BUY " << m.card_id;
@@ -2125,88 +2706,644 @@ std::string moveToString(const Move& m) {
     return ss.str();
 }
 
-GameState parseJson(const std::string& json, const std::vector<Card>& all_c, const std::vector<Noble>& all_n) {
-    GameState st;
-    size_t active_p = json.find("\"active_player_id\":");
-    if (active_p != std::string::npos) st.current_player = std::stoi(json.substr(active_p + 19, json.find_first_of(",}", active_p + 19) - (active_p + 19))) - 1;
-    
-    size_t board_p = json.find("\"board\":");
-    std::string board_json = (board_p != std::string::npos) ? json.substr(board_p) : json;
-    
-    size_t bank_p = board_json.find("\"bank\":");
-    if (bank_p == std::string::npos) bank_p = board_json.find("\"gems\":");
-    if (bank_p != std::string::npos) st.bank = parseTokens(board_json.substr(bank_p));
-    
-    auto get_ids = [&](const std::string& k) {
-        std::vector<Card> r; size_t p = board_json.find("\"" + k + "\":[");
-        if (p == std::string::npos) return r;
-        p += k.length() + 4; // "\"key\":["
-        size_t e = board_json.find("]", p);
-        if (e == std::string::npos) return r;
-        std::stringstream ss(board_json.substr(p, e - p)); std::string id_s;
-        while (std::getline(ss, id_s, ',')) { if (!id_s.empty()) { try { int id = std::stoi(id_s); if (id > 0) r.push_back(loadCardById(id, all_c)); else if (id == 0) r.push_back({0, 0, 0, "", {}}); } catch(...) {} } }
-        return r;
-    };
-    
-    st.faceup_level1 = get_ids("level1"); 
-    st.faceup_level2 = get_ids("level2"); 
-    st.faceup_level3 = get_ids("level3");
-    
-    size_t n_p = board_json.find("\"nobles\":[");
-    if (n_p != std::string::npos) {
-        n_p += 10; size_t n_e = board_json.find("]", n_p);
-        if (n_e != std::string::npos) {
-            std::stringstream ss(board_json.substr(n_p, n_e - n_p)); std::string id_s;
-            while (std::getline(ss, id_s, ',')) { if (!id_s.empty()) { try { int id = std::stoi(id_s); for (const auto& n : all_n) if (n.id == id) st.available_nobles.push_back(n); } catch(...) {} } }
+// Minimal streaming JSON reader for parseGameStateJson. Walks the input once,
+// never copies keys or values, and records the byte offset of the first error.
+// Nesting is bounded so hostile input cannot exhaust the stack.
+const int MAX_JSON_DEPTH = 64;
+
+struct JsonReader {
+    const char* begin;
+    const char* p;
+    const char* end;
+    string error;
+    int depth;                      // Open containers being skipped or recursed into
+
+    // Around each recursive container; an error ends the parse, so only success leaves
+    bool enter() {
+        if (depth >= MAX_JSON_DEPTH) return fail("nesting deeper than " + to_string(MAX_JSON_DEPTH));
+        depth++;
+        return true;
+    }
+    bool leave() {
+        depth--;
+        return error.empty();
+    }
+
+    bool fail(const string& what) {
+        if (error.empty()) error = "JSON error at offset " + to_string(p - begin) + ": " + what;
+        return false;
+    }
+
+    void skipSpace() {
+        while (p < end && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r')) p++;
+    }
+
+    bool expect(char c) {
+        skipSpace();
+        if (p < end && *p == c) {
+            p++;
+            return true;
         }
+        return fail(string("expected '") + c + "'");
     }
-    
-    size_t players_p = json.find("\"players\":[");
-    if (players_p != std::string::npos) {
-        for (int i = 0; i < 2; i++) {
-            size_t p_start = json.find("{", players_p);
-            if (p_start == std::string::npos) break;
-            int d = 1; size_t cur = p_start + 1;
-            while (d > 0 && cur < json.length()) { if (json[cur] == '{') d++; else if (json[cur] == '}') d--; cur++; }
-            std::string p_json = json.substr(p_start, cur - p_start);
-            players_p = cur;
-            
-            Player& p = st.players[i];
-            size_t gems_p = p_json.find("\"gems\":");
-            if (gems_p != std::string::npos) p.tokens = parseTokens(p_json.substr(gems_p));
-            size_t disc_p = p_json.find("\"discounts\":");
-            if (disc_p != std::string::npos) p.bonuses = parseTokens(p_json.substr(disc_p));
-            
-            size_t r_p = p_json.find("\"reserved_card_ids\":[");
-            if (r_p != std::string::npos) {
-                r_p += 21; size_t r_e = p_json.find("]", r_p);
-                if (r_e != std::string::npos) {
-                    std::stringstream ss(p_json.substr(r_p, r_e - r_p)); std::string id_s;
-                    while (std::getline(ss, id_s, ',')) { 
-                        if (!id_s.empty()) { 
-                            try { 
-                                int id = std::stoi(id_s); 
-                                if (id > 0 && id <= 90) p.reserved.push_back(loadCardById(id, all_c)); 
-                                else if (id >= 91) p.reserved.push_back({id, id-90, 0, "", {}}); 
-                            } catch(...) {} 
-                        } 
-                    }
+
+    // Before each object member / array element: false at the closing bracket or on error
+    bool more(char close, bool& first) {
+        skipSpace();
+        if (p >= end) return fail("unexpected end of input");
+        if (*p == close) {
+            p++;
+            return false;
+        }
+        if (!first && !expect(',')) return false;
+        first = false;
+        return true;
+    }
+
+    // Object key and its ':'; the key points into the input (escapes are kept verbatim)
+    bool readKey(const char*& key, size_t& len) {
+        if (!expect('"')) return false;
+        key = p;
+        while (p < end && *p != '"') p += (*p == '\\') ? 2 : 1;
+        if (p >= end) return fail("unterminated string");
+        len = p - key;
+        p++;
+        return expect(':');
+    }
+
+    bool readDouble(double& out) {
+        skipSpace();
+        char* num_end = nullptr;
+        out = strtod(p, &num_end);
+        if (num_end == p || num_end > end) return fail("expected a number");
+        p = num_end;
+        return true;
+    }
+
+    bool readInt(int& out) {
+        skipSpace();
+        const char* start = p;
+        bool negative = (p < end && *p == '-');
+        if (negative) p++;
+        long value = 0;
+        while (p < end && *p >= '0' && *p <= '9' && value < 100000000) value = value * 10 + (*p++ - '0');
+        if (p == start || (negative && p == start + 1)) return fail("expected an integer");
+        if (p < end && (*p == '.' || *p == 'e' || *p == 'E' || (*p >= '0' && *p <= '9'))) {
+            // Not a plain small integer: take the number as a double and truncate
+            p = start;
+            double d;
+            if (!readDouble(d)) return false;
+            if (!(d >= INT_MIN && d <= INT_MAX)) return fail("integer out of range");
+            out = (int)d;
+            return true;
+        }
+        out = (int)(negative ? -value : value);
+        return true;
+    }
+
+    bool skipValue() {
+        skipSpace();
+        if (p >= end) return fail("unexpected end of input");
+        char c = *p;
+        if (c == '{' || c == '[') {
+            if (!enter()) return false;
+            char close = (c == '{') ? '}' : ']';
+            p++;
+            bool first = true;
+            while (more(close, first)) {
+                if (c == '{') {
+                    const char* key = nullptr;
+                    size_t len = 0;
+                    if (!readKey(key, len)) return false;
                 }
+                if (!skipValue()) return false;
+            }
+            return leave();
+        }
+        if (c == '"') {
+            p++;
+            while (p < end && *p != '"') p += (*p == '\\') ? 2 : 1;
+            if (p >= end) return fail("unterminated string");
+            p++;
+            return true;
+        }
+        if (c == '-' || (c >= '0' && c <= '9')) {
+            double ignored;
+            return readDouble(ignored);
+        }
+        for (const char* word : {"true", "false", "null"}) {
+            size_t n = strlen(word);
+            if ((size_t)(end - p) >= n && memcmp(p, word, n) == 0) {
+                p += n;
+                return true;
             }
-            size_t pts_p = p_json.find("\"points\":");
-            if (pts_p != std::string::npos) p.points = std::stoi(p_json.substr(pts_p + 9, p_json.find_first_of(",}", pts_p + 9) - (pts_p + 9)));
         }
+        return fail("unexpected character");
     }
-    
-    auto get_val = [&](const std::string& k) {
-        size_t p = json.find("\"" + k + "\":");
-        if (p == std::string::npos) return 0;
-        size_t e = json.find_first_of(",}", p + k.length() + 3);
-        try { return std::stoi(json.substr(p + k.length() + 3, e - (p + k.length() + 3))); } catch(...) { return 0; }
-    };
-    st.deck_level1.assign(get_val("deck_level1_size"), {0, 1, 0, "", {}});
-    st.deck_level2.assign(get_val("deck_level2_size"), {0, 2, 0, "", {}});
-    st.deck_level3.assign(get_val("deck_level3_size"), {0, 3, 0, "", {}});
-    
+};
+
+static bool keyIs(const char* key, size_t len, const char* name) {
+    return strlen(name) == len && memcmp(key, name, len) == 0;
+}
+
+// Calls on_id(id) for each element of an integer array
+template <typename OnId>
+static bool readIdArray(JsonReader& r, OnId on_id) {
+    if (!r.expect('[')) return false;
+    bool first = true;
+    while (r.more(']', first)) {
+        int id;
+        if (!r.readInt(id)) return false;
+        if (!on_id(id)) return false;
+    }
+    return r.error.empty();
+}
+
+// Token object keyed by color name; missing colors are 0
+static bool readTokensJson(JsonReader& r, Tokens& tokens) {
+    tokens = Tokens();
+    if (!r.expect('{')) return false;
+    bool first = true;
+    while (r.more('}', first)) {
+        const char* key = nullptr;
+        size_t len = 0;
+        if (!r.readKey(key, len)) return false;
+        int color = 0;
+        while (color < NUM_TOKEN_COLORS && !keyIs(key, len, colorName(static_cast<Color>(color)))) color++;
+        if (color == NUM_TOKEN_COLORS) {
+            if (!r.skipValue()) return false;
+        } else if (!r.readInt(tokens[color])) {
+            return false;
+        }
+    }
+    return r.error.empty();
+}
+
+// Development card by ID; 0 is an empty slot of the given level
+static bool readCardId(JsonReader& r, int id, int level, const vector<Card>& all_cards, vector<Card>& out) {
+    if (id == 0) {
+        out.push_back(Card{0, level, 0, NO_COLOR, {}, 0});
+        return true;
+    }
+    Card card = loadCardById(id, all_cards);
+    if (card.id == 0) return r.fail("unknown card id " + to_string(id));
+    out.push_back(card);
+    return true;
+}
+
+static bool readNobleId(JsonReader& r, int id, const vector<Noble>& all_nobles, vector<Noble>& out) {
+    for (const Noble& noble : all_nobles) {
+        if (noble.id == id) {
+            out.push_back(noble);
+            return true;
+        }
+    }
+    return r.fail("unknown noble id " + to_string(id));
+}
+
+static bool readPlayerJson(JsonReader& r, Player& player, const vector<Card>& all_cards, const vector<Noble>& all_nobles) {
+    if (!r.expect('{')) return false;
+    bool first = true;
+    while (r.more('}', first)) {
+        const char* key = nullptr;
+        size_t len = 0;
+        if (!r.readKey(key, len)) return false;
+        bool ok;
+        if (keyIs(key, len, "points")) {
+            ok = r.readInt(player.points);
+        } else if (keyIs(key, len, "gems")) {
+            ok = readTokensJson(r, player.tokens);
+        } else if (keyIs(key, len, "discounts")) {
+            ok = readTokensJson(r, player.bonuses);
+        } else if (keyIs(key, len, "reserved_card_ids")) {
+            // 91/92/93 are the opponent's masked reserves of level 1/2/3
+            ok = readIdArray(r, [&](int id) {
+                if (id >= 91 && id <= 93) {
+                    player.reserved.push_back(Card{id, id - 90, 0, NO_COLOR, {}, 0});
+                    return true;
+                }
+                return readCardId(r, id, 0, all_cards, player.reserved);
+            });
+        } else if (keyIs(key, len, "purchased_card_ids")) {
+            ok = readIdArray(r, [&](int id) { return readCardId(r, id, 0, all_cards, player.cards); });
+        } else if (keyIs(key, len, "owned_noble_ids")) {
+            ok = readIdArray(r, [&](int id) { return readNobleId(r, id, all_nobles, player.nobles); });
+        } else if (keyIs(key, len, "time_bank")) {
+            ok = r.readDouble(player.time_bank);
+        } else {
+            ok = r.skipValue();  // "id": players are taken in array order
+        }
+        if (!ok) return false;
+    }
+    return r.error.empty();
+}
+
+// Members of the root object and of "board" share one handler, so either nesting is accepted
+static bool readStateMember(JsonReader& r, const char* key, size_t len, GameState& state,
+                            const vector<Card>& all_cards, const vector<Noble>& all_nobles, int& num_players) {
+    if (keyIs(key, len, "active_player_id")) {
+        int id;
+        if (!r.readInt(id)) return false;
+        if (id != 1 && id != 2) return r.fail("active_player_id must be 1 or 2");
+        state.current_player = id - 1;
+        return true;
+    }
+    if (keyIs(key, len, "move")) {
+        int move;
+        if (!r.readInt(move)) return false;
+        if (move < 1) return r.fail("move must be positive");
+        state.move_number = move - 1;
+        return true;
+    }
+    if (keyIs(key, len, "players")) {
+        if (!r.expect('[')) return false;
+        bool first = true;
+        while (r.more(']', first)) {
+            if (num_players == 2) return r.fail("more than 2 players");
+            if (!readPlayerJson(r, state.players[num_players++], all_cards, all_nobles)) return false;
+        }
+        return r.error.empty();
+    }
+    if (keyIs(key, len, "board") || keyIs(key, len, "face_up_cards")) {
+        if (!r.expect('{') || !r.enter()) return false;
+        bool first = true;
+        while (r.more('}', first)) {
+            const char* member = nullptr;
+            size_t member_len = 0;
+            if (!r.readKey(member, member_len)) return false;
+            if (!readStateMember(r, member, member_len, state, all_cards, all_nobles, num_players)) return false;
+        }
+        return r.leave();
+    }
+    if (keyIs(key, len, "gems") || keyIs(key, len, "bank")) {
+        return readTokensJson(r, state.bank);
+    }
+    for (int level = 1; level <= 3; level++) {
+        static const char* const ROW_KEYS[] = {"level1", "level2", "level3"};
+        static const char* const DECK_KEYS[] = {"deck_level1_size", "deck_level2_size", "deck_level3_size"};
+        if (keyIs(key, len, ROW_KEYS[level - 1])) {
+            vector<Card>& row = state.getFaceup(level);
+            row.clear();
+            return readIdArray(r, [&](int id) { return readCardId(r, id, level, all_cards, row); });
+        }
+        if (keyIs(key, len, DECK_KEYS[level - 1])) {
+            int size;
+            if (!r.readInt(size)) return false;
+            if (size < 0) return r.fail("negative deck size");
+            int level_cards = (int)std::count_if(all_cards.begin(), all_cards.end(),
+                                                 [&](const Card& card) { return card.level == level; });
+            if (size > level_cards) {
+                return r.fail("deck size " + to_string(size) + " exceeds the " + to_string(level_cards) +
+                              " level " + to_string(level) + " cards");
+            }
+            // Deck contents are hidden from engines: unknown cards of the right level
+            state.getDeck(level).assign(size, Card{0, level, 0, NO_COLOR, {}, 0});
+            return true;
+        }
+    }
+    if (keyIs(key, len, "nobles")) {
+        state.available_nobles.clear();
+        return readIdArray(r, [&](int id) { return readNobleId(r, id, all_nobles, state.available_nobles); });
+    }
+    return r.skipValue();  // "you" and anything unknown
+}
+
+// Parse a referee JSON state in a single pass. Unknown keys are skipped; errors
+// report the byte offset. Fills everything the referee sends, including
+// purchased cards, owned nobles, time banks and the move number.
+ValidationResult parseGameStateJson(const string& json, const vector<Card>& all_cards,
+                                    const vector<Noble>& all_nobles, GameState& out) {
+    out = GameState();
+    JsonReader r = {json.data(), json.data(), json.data() + json.size(), "", 0};
+    int num_players = 0;
+
+    bool ok = r.expect('{');
+    bool first = true;
+    while (ok && r.more('}', first)) {
+        const char* key = nullptr;
+        size_t len = 0;
+        ok = r.readKey(key, len) && readStateMember(r, key, len, out, all_cards, all_nobles, num_players);
+    }
+    if (ok && r.error.empty()) {
+        r.skipSpace();
+        if (r.p != r.end) r.fail("trailing characters after state");
+    }
+
+    out.zobrist_key = computeZobristKey(out);
+    if (!r.error.empty()) return ValidationResult(false, r.error);
+    return ValidationResult(true);
+}
+
+GameState parseJson(const std::string& json, const std::vector<Card>& all_c, const std::vector<Noble>& all_n) {
+    GameState st;
+    parseGameStateJson(json, all_c, all_n, st);
     return st;
 }
+
+// Gem counts of a delta object; mask gets a bit for each color present
+static bool readMaskedTokensJson(JsonReader& r, Tokens& tokens, uint8_t& mask) {
+    if (!r.expect('{')) return false;
+    bool first = true;
+    while (r.more('}', first)) {
+        const char* key = nullptr;
+        size_t len = 0;
+        if (!r.readKey(key, len)) return false;
+        int color = 0;
+        while (color < NUM_TOKEN_COLORS && !keyIs(key, len, colorName(static_cast<Color>(color)))) color++;
+        if (color == NUM_TOKEN_COLORS) {
+            if (!r.skipValue()) return false;
+            continue;
+        }
+        if (!r.readInt(tokens[color])) return false;
+        mask |= (uint8_t)(1 << color);
+    }
+    return r.error.empty();
+}
+
+static bool readIntList(JsonReader& r, vector<int>& out) {
+    out.clear();
+    return readIdArray(r, [&](int id) {
+        out.push_back(id);
+        return true;
+    });
+}
+
+static bool readPlayerDeltaJson(JsonReader& r, PlayerDelta& delta) {
+    if (!r.expect('{')) return false;
+    bool first = true;
+    while (r.more('}', first)) {
+        const char* key = nullptr;
+        size_t len = 0;
+        if (!r.readKey(key, len)) return false;
+        bool ok;
+        if (keyIs(key, len, "points")) {
+            ok = r.readInt(delta.points);
+        } else if (keyIs(key, len, "gems")) {
+            ok = readMaskedTokensJson(r, delta.tokens, delta.token_mask);
+        } else if (keyIs(key, len, "discounts")) {
+            ok = readMaskedTokensJson(r, delta.bonuses, delta.bonus_mask);
+        } else if (keyIs(key, len, "reserved_card_ids")) {
+            delta.reserved_changed = true;
+            ok = readIntList(r, delta.reserved);
+        } else if (keyIs(key, len, "purchased_add")) {
+            ok = readIntList(r, delta.cards_added);
+        } else if (keyIs(key, len, "nobles_add")) {
+            ok = readIntList(r, delta.nobles_added);
+        } else if (keyIs(key, len, "time_bank")) {
+            ok = r.readDouble(delta.time_bank);
+        } else {
+            ok = r.skipValue();  // "id": players are taken in array order
+        }
+        if (!ok) return false;
+    }
+    return r.error.empty();
+}
+
+// Like readStateMember: root and "board" members share one handler
+static bool readDeltaMember(JsonReader& r, const char* key, size_t len, StateDelta& delta,
+                            int& num_players, bool& is_delta) {
+    if (keyIs(key, len, "delta")) {
+        is_delta = true;
+        return r.skipValue();
+    }
+    if (keyIs(key, len, "active_player_id")) {
+        int id;
+        if (!r.readInt(id)) return false;
+        if (id != 1 && id != 2) return r.fail("active_player_id must be 1 or 2");
+        delta.current_player = id - 1;
+        return true;
+    }
+    if (keyIs(key, len, "move")) {
+        int move;
+        if (!r.readInt(move)) return false;
+        if (move < 1) return r.fail("move must be positive");
+        delta.move_number = move - 1;
+        return true;
+    }
+    if (keyIs(key, len, "players")) {
+        if (!r.expect('[')) return false;
+        bool first = true;
+        while (r.more(']', first)) {
+            if (num_players == 2) return r.fail("more than 2 players");
+            if (!readPlayerDeltaJson(r, delta.players[num_players++])) return false;
+        }
+        return r.error.empty();
+    }
+    if (keyIs(key, len, "board")) {
+        if (!r.expect('{') || !r.enter()) return false;
+        bool first = true;
+        while (r.more('}', first)) {
+            const char* member = nullptr;
+            size_t member_len = 0;
+            if (!r.readKey(member, member_len)) return false;
+            if (!readDeltaMember(r, member, member_len, delta, num_players, is_delta)) return false;
+        }
+        return r.leave();
+    }
+    if (keyIs(key, len, "gems")) {
+        return readMaskedTokensJson(r, delta.bank, delta.bank_mask);
+    }
+    if (keyIs(key, len, "face_up_changes")) {
+        if (!r.expect('[')) return false;
+        bool first = true;
+        vector<int> triple;
+        while (r.more(']', first)) {
+            if (!readIntList(r, triple)) return false;
+            if (triple.size() != 3) return r.fail("face-up change must be [level, slot, card_id]");
+            delta.faceup.push_back(FaceupChange{triple[0], triple[1], triple[2]});
+        }
+        return r.error.empty();
+    }
+    if (keyIs(key, len, "face_up_sizes")) {
+        vector<int> sizes;
+        if (!readIntList(r, sizes)) return false;
+        if (sizes.size() != 3) return r.fail("face_up_sizes must have 3 entries");
+        for (int level = 0; level < 3; level++) {
+            if (sizes[level] < 0 || sizes[level] > MAX_FACEUP) return r.fail("face-up size out of range");
+            delta.faceup_size[level] = sizes[level];
+        }
+        return true;
+    }
+    static const char* const DECK_KEYS[] = {"deck_level1_size", "deck_level2_size", "deck_level3_size"};
+    for (int level = 0; level < 3; level++) {
+        if (keyIs(key, len, DECK_KEYS[level])) {
+            // Deltas carry no card set; no level has more cards than the largest deck
+            if (!r.readInt(delta.deck_size[level])) return false;
+            if (delta.deck_size[level] < 0) return r.fail("negative deck size");
+            if (delta.deck_size[level] > MAX_DECK_SIZE) return r.fail("deck size out of range");
+            return true;
+        }
+    }
+    if (keyIs(key, len, "nobles")) {
+        delta.nobles_changed = true;
+        return readIntList(r, delta.nobles);
+    }
+    return r.skipValue();  // "you" and anything unknown
+}
+
+// Parse one writeStateDeltaJson line; fails on full states (no "delta" member)
+ValidationResult parseStateDeltaJson(const string& json, StateDelta& out) {
+    out = StateDelta();
+    JsonReader r = {json.data(), json.data(), json.data() + json.size(), "", 0};
+    int num_players = 0;
+    bool is_delta = false;
+
+    bool ok = r.expect('{');
+    bool first = true;
+    while (ok && r.more('}', first)) {
+        const char* key = nullptr;
+        size_t len = 0;
+        ok = r.readKey(key, len) && readDeltaMember(r, key, len, out, num_players, is_delta);
+    }
+    if (ok && r.error.empty()) {
+        r.skipSpace();
+        if (r.p != r.end) r.fail("trailing characters after delta");
+    }
+
+    if (!r.error.empty()) return ValidationResult(false, r.error);
+    if (!is_delta) return ValidationResult(false, "Not a state delta (no \"delta\" member)");
+    return ValidationResult(true);
+}
+
+// Build an ID-indexed card/noble table (IDs outside 1-90 / 1-10 are ignored)
+CardTable buildCardTable(const vector<Card>& all_cards, const vector<Noble>& all_nobles) {
+    CardTable table;
+    for (int i = 0; i <= MAX_CARD_ID; i++) {
+        table.cards[i] = Card{0, 0, 0, NO_COLOR, {}};
+    }
+    for (int i = 0; i <= MAX_NOBLE_ID; i++) {
+        table.nobles[i] = Noble{0, 0, {}};
+    }
+    for (const Card& card : all_cards) {
+        if (card.id >= 1 && card.id <= MAX_CARD_ID) table.cards[card.id] = card;
+    }
+    for (const Noble& noble : all_nobles) {
+        if (noble.id >= 1 && noble.id <= MAX_NOBLE_ID) table.nobles[noble.id] = noble;
+    }
+    return table;
+}
+
+// Convert a GameState to its compact form. Fails if the state exceeds the compact capacities.
+ValidationResult packGameState(const GameState& state, CompactState& out) {
+    out = CompactState();
+    out.zobrist_key = state.zobrist_key;
+
+    for (int c = 0; c < NUM_TOKEN_COLORS; c++) out.bank[c] = static_cast<uint8_t>(state.bank[c]);
+
+    for (int l = 1; l <= 3; l++) {
+        const vector<Card>& faceup = (l == 1) ? state.faceup_level1 : (l == 2) ? state.faceup_level2 : state.faceup_level3;
+        const vector<Card>& deck = (l == 1) ? state.deck_level1 : (l == 2) ? state.deck_level2 : state.deck_level3;
+        if (faceup.size() > (size_t)MAX_FACEUP) {
+            return ValidationResult(false, "Too many face-up level " + to_string(l) + " cards to pack");
+        }
+        if (deck.size() > (size_t)MAX_DECK_SIZE) {
+            return ValidationResult(false, "Level " + to_string(l) + " deck too large to pack");
+        }
+        out.faceup_size[l - 1] = static_cast<uint8_t>(faceup.size());
+        for (size_t i = 0; i < faceup.size(); i++) out.faceup[l - 1][i] = static_cast<uint8_t>(faceup[i].id);
+        out.deck_size[l - 1] = static_cast<uint8_t>(deck.size());
+        for (size_t i = 0; i < deck.size(); i++) out.deck[l - 1][i] = static_cast<uint8_t>(deck[i].id);
+    }
+
+    if (state.available_nobles.size() > (size_t)MAX_NOBLES_IN_PLAY) {
+        return ValidationResult(false, "Too many available nobles to pack");
+    }
+    out.num_nobles = static_cast<uint8_t>(state.available_nobles.size());
+    for (size_t i = 0; i < state.available_nobles.size(); i++) {
+        out.nobles[i] = static_cast<uint8_t>(state.available_nobles[i].id);
+    }
+
+    for (int p = 0; p < 2; p++) {
+        const Player& player = state.players[p];
+        CompactPlayer& cp = out.players[p];
+        if (player.cards.size() > (size_t)MAX_CARD_ID || player.reserved.size() > (size_t)MAX_RESERVED ||
+            player.nobles.size() > (size_t)MAX_NOBLES_IN_PLAY) {
+            return ValidationResult(false, "Player " + to_string(p + 1) + " too large to pack");
+        }
+
+        for (int c = 0; c < NUM_TOKEN_COLORS; c++) cp.tokens[c] = static_cast<uint8_t>(player.tokens[c]);
+        for (int c = 0; c < NUM_GEM_COLORS; c++) cp.bonuses[c] = static_cast<uint8_t>(player.bonuses[c]);
+        cp.points = static_cast<uint8_t>(player.points);
+
+        cp.num_cards = static_cast<uint8_t>(player.cards.size());
+        for (size_t i = 0; i < player.cards.size(); i++) cp.cards[i] = static_cast<uint8_t>(player.cards[i].id);
+        cp.num_reserved = static_cast<uint8_t>(player.reserved.size());
+        for (size_t i = 0; i < player.reserved.size(); i++) cp.reserved[i] = static_cast<uint8_t>(player.reserved[i].id);
+        cp.num_nobles = static_cast<uint8_t>(player.nobles.size());
+        for (size_t i = 0; i < player.nobles.size(); i++) cp.nobles[i] = static_cast<uint8_t>(player.nobles[i].id);
+        cp.time_bank = player.time_bank;
+    }
+
+    out.move_number = state.move_number;
+    out.current_player = static_cast<uint8_t>(state.current_player);
+    out.consecutive_passes = static_cast<uint8_t>(state.consecutive_passes);
+    out.last_removed_pos[0] = static_cast<int8_t>(state.last_removed_pos_level1);
+    out.last_removed_pos[1] = static_cast<int8_t>(state.last_removed_pos_level2);
+    out.last_removed_pos[2] = static_cast<int8_t>(state.last_removed_pos_level3);
+    out.pending_blind_reserve_player = static_cast<int8_t>(state.pending_blind_reserve_player);
+    out.pending_blind_reserve_level = static_cast<int8_t>(state.pending_blind_reserve_level);
+    out.replay_mode = state.replay_mode;
+    out.reveal_expected = state.reveal_expected;
+
+    return ValidationResult(true);
+}
+
+// Expand a compact state into a GameState, reusing the storage already held by `out`.
+// Empty slots and unknown deck cards become placeholders of their row's level.
+void unpackGameState(const CompactState& packed, const CardTable& table, GameState& out) {
+    for (int c = 0; c < NUM_TOKEN_COLORS; c++) out.bank[c] = packed.bank[c];
+
+    for (int l = 1; l <= 3; l++) {
+        vector<Card>& faceup = out.getFaceup(l);
+        vector<Card>& deck = out.getDeck(l);
+        faceup.clear();
+        for (int i = 0; i < packed.faceup_size[l - 1]; i++) {
+            int id = packed.faceup[l - 1][i];
+            faceup.push_back(id > 0 ? table.cards[id] : Card{0, l, 0, NO_COLOR, {}});
+        }
+        deck.clear();
+        for (int i = 0; i < packed.deck_size[l - 1]; i++) {
+            int id = packed.deck[l - 1][i];
+            deck.push_back(id > 0 ? table.cards[id] : Card{0, l, 0, NO_COLOR, {}});
+        }
+    }
+
+    out.available_nobles.clear();
+    for (int i = 0; i < packed.num_nobles; i++) {
+        out.available_nobles.push_back(table.nobles[packed.nobles[i]]);
+    }
+
+    for (int p = 0; p < 2; p++) {
+        const CompactPlayer& cp = packed.players[p];
+        Player& player = out.players[p];
+
+        for (int c = 0; c < NUM_TOKEN_COLORS; c++) player.tokens[c] = cp.tokens[c];
+        for (int c = 0; c < NUM_GEM_COLORS; c++) player.bonuses[c] = cp.bonuses[c];
+        player.bonuses[JOKER] = 0;
+        player.points = cp.points;
+
+        player.cards.clear();
+        for (int i = 0; i < cp.num_cards; i++) player.cards.push_back(table.cards[cp.cards[i]]);
+        player.reserved.clear();
+        for (int i = 0; i < cp.num_reserved; i++) {
+            int id = cp.reserved[i];
+            if (id > MAX_CARD_ID) player.reserved.push_back(Card{id, id - 90, 0, NO_COLOR, {}});
+            else player.reserved.push_back(table.cards[id]);
+        }
+        player.nobles.clear();
+        for (int i = 0; i < cp.num_nobles; i++) player.nobles.push_back(table.nobles[cp.nobles[i]]);
+        player.time_bank = cp.time_bank;
+    }
+
+    out.move_number = packed.move_number;
+    out.current_player = packed.current_player;
+    out.consecutive_passes = packed.consecutive_passes;
+    out.last_removed_pos_level1 = packed.last_removed_pos[0];
+    out.last_removed_pos_level2 = packed.last_removed_pos[1];
+    out.last_removed_pos_level3 = packed.last_removed_pos[2];
+    out.pending_blind_reserve_player = packed.pending_blind_reserve_player;
+    out.pending_blind_reserve_level = packed.pending_blind_reserve_level;
+    out.replay_mode = packed.replay_mode != 0;
+    out.reveal_expected = packed.reveal_expected != 0;
+    out.zobrist_key = packed.zobrist_key;
+}
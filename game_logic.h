@@ -10,31 +10,50 @@
 #include <random>
 #include <sstream>
 #include <ctime>
+#include <cstdint>
+#include <type_traits>
 
 // Constants for timing
 const double INITIAL_TIME_BANK = 300.0; // 5 minutes initial time bank
 const double TIME_INCREMENT = 1.0;
 
-// Struct to represent gem/token counts
+// Gem colors. Values index the lanes of Tokens; names are only used at the
+// protocol boundary (see colorName / parseColor).
+enum Color {
+    BLACK = 0,
+    BLUE,
+    WHITE,
+    GREEN,
+    RED,
+    JOKER,
+    NO_COLOR     // Placeholder cards (empty slots, hidden cards)
+};
+
+const int NUM_GEM_COLORS = 5;     // Colors that appear on cards (no joker)
+const int NUM_TOKEN_COLORS = 6;   // Gem colors plus joker
+
+const char* colorName(Color color);
+bool parseColor(const std::string& name, Color& color);
+
+// Struct to represent gem/token counts, one lane per Color
 struct Tokens {
-    int black = 0;
-    int blue = 0;
-    int white = 0;
-    int green = 0;
-    int red = 0;
-    int joker = 0;
+    int count[NUM_TOKEN_COLORS] = {0, 0, 0, 0, 0, 0};
 
     Tokens() = default;
     Tokens(int bl, int bu, int wh, int gr, int re, int jo = 0)
-        : black(bl), blue(bu), white(wh), green(gr), red(re), joker(jo) {}
+        : count{bl, bu, wh, gr, re, jo} {}
 
     int total() const {
-        return black + blue + white + green + red + joker;
+        int sum = 0;
+        for (int c = 0; c < NUM_TOKEN_COLORS; c++) sum += count[c];
+        return sum;
     }
 
     bool operator==(const Tokens& other) const {
-        return black == other.black && blue == other.blue && white == other.white &&
-               green == other.green && red == other.red && joker == other.joker;
+        for (int c = 0; c < NUM_TOKEN_COLORS; c++) {
+            if (count[c] != other.count[c]) return false;
+        }
+        return true;
     }
 
     bool operator!=(const Tokens& other) const {
@@ -42,44 +61,18 @@ struct Tokens {
     }
 
     Tokens& operator+=(const Tokens& other) {
-        black += other.black;
-        blue += other.blue;
-        white += other.white;
-        green += other.green;
-        red += other.red;
-        joker += other.joker;
+        for (int c = 0; c < NUM_TOKEN_COLORS; c++) count[c] += other.count[c];
         return *this;
     }
 
     Tokens& operator-=(const Tokens& other) {
-        black -= other.black;
-        blue -= other.blue;
-        white -= other.white;
-        green -= other.green;
-        red -= other.red;
-        joker -= other.joker;
+        for (int c = 0; c < NUM_TOKEN_COLORS; c++) count[c] -= other.count[c];
         return *this;
     }
 
-    int& operator[](const std::string& color) {
-        if (color == "black") return black;
-        if (color == "blue") return blue;
-        if (color == "white") return white;
-        if (color == "green") return green;
-        if (color == "red") return red;
-        if (color == "joker") return joker;
-        static int dummy; return dummy; // Should handle error better
-    }
-
-    const int& operator[](const std::string& color) const {
-        if (color == "black") return black;
-        if (color == "blue") return blue;
-        if (color == "white") return white;
-        if (color == "green") return green;
-        if (color == "red") return red;
-        if (color == "joker") return joker;
-        static const int dummy = 0; return dummy;
-    }
+    // Indexed by Color (or a plain lane index 0-5)
+    int& operator[](int color) { return count[color]; }
+    const int& operator[](int color) const { return count[color]; }
 };
 
 inline Tokens operator+(Tokens lhs, const Tokens& rhs) {
@@ -92,21 +85,74 @@ inline Tokens operator-(Tokens lhs, const Tokens& rhs) {
     return lhs;
 }
 
+// Packed token vector: one 8-bit lane per Color in a 64-bit word (lanes 6-7 unused).
+// Lane values must stay within 0-127 so lane-wise arithmetic never borrows across lanes.
+typedef uint64_t PackedTokens;
+
+const PackedTokens PACKED_LANE_HIGH_BITS = 0x8080808080808080ULL;
+
+inline PackedTokens packTokens(const Tokens& tokens) {
+    PackedTokens packed = 0;
+    for (int c = 0; c < NUM_TOKEN_COLORS; c++) {
+        packed |= static_cast<PackedTokens>(static_cast<uint8_t>(tokens[c])) << (8 * c);
+    }
+    return packed;
+}
+
+inline Tokens unpackTokens(PackedTokens packed) {
+    Tokens tokens;
+    for (int c = 0; c < NUM_TOKEN_COLORS; c++) {
+        tokens[c] = static_cast<int>((packed >> (8 * c)) & 0xFF);
+    }
+    return tokens;
+}
+
+// Single-lane vector with `n` in the lane of `color`
+inline PackedTokens packedLane(Color color, int n = 1) {
+    return static_cast<PackedTokens>(n) << (8 * color);
+}
+
+// Lane-wise max(0, a - b)
+inline PackedTokens packedSubSat(PackedTokens a, PackedTokens b) {
+    PackedTokens diff = (a | PACKED_LANE_HIGH_BITS) - b;    // Lane = 128 + a - b, never borrows
+    PackedTokens non_negative = diff & PACKED_LANE_HIGH_BITS;
+    return diff & (non_negative - (non_negative >> 7));     // Keep low 7 bits where a >= b
+}
+
+// Sum of all lanes (valid while the sum stays below 256)
+inline int packedSum(PackedTokens packed) {
+    return static_cast<int>((packed * 0x0101010101010101ULL) >> 56);
+}
+
+// Cost still owed after card bonuses
+inline PackedTokens packedEffectiveCost(PackedTokens cost, PackedTokens bonuses) {
+    return packedSubSat(cost, bonuses);
+}
+
+// Number of jokers needed to pay `effective_cost` from `tokens`
+inline int packedJokerShortfall(PackedTokens effective_cost, PackedTokens tokens) {
+    return packedSum(packedSubSat(effective_cost, tokens));
+}
+
+// True if every lane of `have` is at least the matching lane of `need`
+inline bool packedCovers(PackedTokens have, PackedTokens need) {
+    return packedSubSat(need, have) == 0;
+}
+
 // Struct for a development card
 struct Card {
     int id;
     int level;
     int points;
-    std::string color;
+    Color color;
     Tokens cost;
+    PackedTokens packed_cost;   // packTokens(cost); set by the loaders, update it if you edit cost
 
     Tokens getEffectiveCost(const Tokens& bonuses) const {
         Tokens effective;
-        effective.black = std::max(0, cost.black - bonuses.black);
-        effective.blue = std::max(0, cost.blue - bonuses.blue);
-        effective.white = std::max(0, cost.white - bonuses.white);
-        effective.green = std::max(0, cost.green - bonuses.green);
-        effective.red = std::max(0, cost.red - bonuses.red);
+        for (int c = 0; c < NUM_GEM_COLORS; c++) {
+            effective[c] = std::max(0, cost[c] - bonuses[c]);
+        }
         return effective;
     }
 };
@@ -116,6 +162,7 @@ struct Noble {
     int id;
     int points;
     Tokens requirements;
+    PackedTokens packed_requirements;   // packTokens(requirements); set by the loaders
 };
 
 // Struct for player state
@@ -158,10 +205,18 @@ struct GameState {
         return (level == 1) ? faceup_level1 : (level == 2) ? faceup_level2 : faceup_level3;
     }
 
+    const std::vector<Card>& getFaceup(int level) const {
+        return (level == 1) ? faceup_level1 : (level == 2) ? faceup_level2 : faceup_level3;
+    }
+
     std::vector<Card>& getDeck(int level) {
         return (level == 1) ? deck_level1 : (level == 2) ? deck_level2 : deck_level3;
     }
 
+    const std::vector<Card>& getDeck(int level) const {
+        return (level == 1) ? deck_level1 : (level == 2) ? deck_level2 : deck_level3;
+    }
+
     int& getLastRemovedPos(int level) {
         return (level == 1) ? last_removed_pos_level1 : (level == 2) ? last_removed_pos_level2 : last_removed_pos_level3;
     }
@@ -192,8 +247,64 @@ struct GameState {
     
     // Track if REVEAL is expected in replay mode
     bool reveal_expected = false;
+
+    // Zobrist position key, kept current by applyMove/undoMove (see computeZobristKey)
+    uint64_t zobrist_key = 0;
+};
+
+// Limits used by the compact state representation
+const int MAX_CARD_ID = 90;          // Development cards are numbered 1-90
+const int MAX_NOBLE_ID = 10;         // Nobles are numbered 1-10
+const int MAX_DECK_SIZE = 40;        // Largest deck (level 1)
+const int MAX_FACEUP = 4;            // Face-up cards per level
+const int MAX_RESERVED = 3;          // Reserved cards per player
+const int MAX_NOBLES_IN_PLAY = 3;    // Nobles dealt per game
+
+// Card and noble data indexed by ID (index 0 is an empty card/noble)
+struct CardTable {
+    Card cards[MAX_CARD_ID + 1];
+    Noble nobles[MAX_NOBLE_ID + 1];
 };
 
+// Compact player state. Token lanes are indexed by Color.
+struct CompactPlayer {
+    uint8_t tokens[6];
+    uint8_t bonuses[5];
+    uint8_t points;
+    uint8_t num_cards;
+    uint8_t num_reserved;
+    uint8_t num_nobles;
+    uint8_t cards[MAX_CARD_ID];              // Purchased card IDs, in purchase order
+    uint8_t reserved[MAX_RESERVED];          // Reserved card IDs (91/92/93 = pending blind reserve)
+    uint8_t nobles[MAX_NOBLES_IN_PLAY];      // Acquired noble IDs
+    double time_bank;
+};
+
+// Compact, trivially-copyable game state for search engines.
+// Cards and nobles are stored as IDs into a CardTable; copying is a plain memcpy.
+struct CompactState {
+    uint64_t zobrist_key;
+    uint8_t bank[6];
+    uint8_t faceup[3][MAX_FACEUP];           // Card IDs per level (0 = empty slot)
+    uint8_t faceup_size[3];
+    uint8_t deck[3][MAX_DECK_SIZE];          // Card IDs per level, top of deck last (0 = unknown card)
+    uint8_t deck_size[3];
+    uint8_t nobles[MAX_NOBLES_IN_PLAY];      // Available noble IDs
+    uint8_t num_nobles;
+    CompactPlayer players[2];
+
+    int32_t move_number;
+    uint8_t current_player;
+    uint8_t consecutive_passes;
+    int8_t last_removed_pos[3];
+    int8_t pending_blind_reserve_player;
+    int8_t pending_blind_reserve_level;
+    uint8_t replay_mode;
+    uint8_t reveal_expected;
+};
+
+static_assert(std::is_trivially_copyable<CompactState>::value, "CompactState must be trivially copyable");
+
 // Enum for move types
 enum MoveType {
     TAKE_GEMS,
@@ -228,6 +339,55 @@ struct Move {
     Card revealed_card;     // The card revealed
 };
 
+// Compact move for search engines: no strings or embedded cards, trivially copyable.
+// Gem lanes are indexed by Color.
+struct CompactMove {
+    uint8_t type;               // MoveType
+    uint8_t card_id;            // RESERVE/BUY: 1-90, or 91/92/93 for blind reserve
+    int8_t noble_id;            // BUY: explicit noble choice (-1 = none)
+    uint8_t gems_taken[5];
+    uint8_t gems_returned[6];
+};
+
+// Fixed-capacity move buffer; large enough for every position reachable in play
+const int MAX_MOVES = 1024;
+
+struct MoveList {
+    CompactMove moves[MAX_MOVES];
+    int count = 0;
+};
+
+// What applyMove changed that undoMove cannot recompute from the move alone.
+// Only valid after a successful applyMove; undo moves in reverse order.
+struct UndoRecord {
+    MoveType type = INVALID_MOVE;
+    int player_idx = 0;
+
+    // Scalars and token vectors before the move
+    Tokens bank;
+    Tokens tokens;                    // Mover's tokens
+    Tokens bonuses;                   // Mover's bonuses
+    int points = 0;                   // Mover's points
+    int current_player = 0;
+    int move_number = 0;
+    int consecutive_passes = 0;
+    int last_removed_pos[3] = {-1, -1, -1};
+    int pending_blind_reserve_player = -1;
+    int pending_blind_reserve_level = -1;
+    bool reveal_expected = false;
+    uint64_t zobrist_key = 0;
+
+    // Cards moved by the move
+    int level = 0;                    // Level of the face-up row / deck touched (0 = none)
+    int faceup_slot = -1;             // Face-up slot that was refilled or revealed into (-1 = none/appended)
+    bool drew_from_deck = false;      // A card was drawn from the deck at `level`
+    bool reserved_card = false;       // RESERVE: a card was appended to the mover's reserved list
+    int reserved_idx = -1;            // BUY: reserved slot the card was bought from (-1 = face-up)
+    int noble_idx = -1;               // BUY: available_nobles index of the granted noble (-1 = none)
+    Card replaced_card = {0, 0, 0, NO_COLOR, {}, 0};  // REVEAL: face-up card overwritten
+    int revealed_deck_idx = -1;       // REVEAL: deck position the revealed card was removed from
+};
+
 // Validation result
 struct ValidationResult {
     bool valid;
@@ -246,31 +406,175 @@ ValidationResult validateBuyCard(const GameState& state, const Move& move);
 
 std::pair<Move, ValidationResult> parseMove(const std::string& move_string, int player_id);
 ValidationResult applyMove(GameState& state, const Move& move, std::ostream& err_os = std::cerr);
-void checkAndAssignNobles(GameState& state, int player_idx, int noble_id = -1, std::ostream& err_os = std::cerr);
+ValidationResult applyMove(GameState& state, const Move& move, UndoRecord& undo, std::ostream& err_os = std::cerr);
+void undoMove(GameState& state, const UndoRecord& undo);
+uint64_t computeZobristKey(const GameState& state);
+int checkAndAssignNobles(GameState& state, int player_idx, int noble_id = -1, std::ostream& err_os = std::cerr);
 bool isGameOver(const GameState& state);
 int determineWinner(const GameState& state);
 
 // Engine helper functions
 std::vector<Move> findAllValidMoves(const GameState& state);
+int generateMoves(const GameState& state, MoveList& out);
+Move toMove(const CompactMove& cm, int player_id);
+CompactMove toCompactMove(const Move& move);
+
+// Pack a TAKE/RESERVE/BUY/PASS move into 32 bits (never 0) and back; see game_logic.cpp for the layout
+const uint32_t NO_ENCODED_MOVE = 0;
+uint32_t encodeMove(const CompactMove& cm);
+uint32_t encodeMove(const Move& move);
+CompactMove decodeMove(uint32_t code);
+
 std::string moveToString(const Move& m);
 GameState parseJson(const std::string& json, const std::vector<Card>& all_c, const std::vector<Noble>& all_n);
+ValidationResult parseGameStateJson(const std::string& json, const std::vector<Card>& all_cards,
+                                    const std::vector<Noble>& all_nobles, GameState& out);
 Tokens calculateAutoPayment(const Tokens& effective_cost, const Tokens& player_tokens);
 Card loadCardById(int card_id, const std::vector<Card>& all_cards);
 std::vector<Card> loadCards(const std::string& filename, std::ostream& err_os = std::cerr);
 std::vector<Noble> loadNobles(const std::string& filename, std::ostream& err_os = std::cerr);
 
+// Built-in cards and nobles (compiled from cards.json/nobles.json), in ID order
+const std::vector<Card>& builtinCards();
+const std::vector<Noble>& builtinNobles();
+const CardTable& builtinCardTable();
+
 void initializeGame(GameState& state, unsigned int seed = 0, 
                     const std::string& cards_path = "cards.json", 
                     const std::string& nobles_path = "nobles.json", 
                     std::ostream& err_os = std::cerr);
+// Same deal without file access, e.g. initializeGame(state, seed, builtinCards(), builtinNobles())
+void initializeGame(GameState& state, unsigned int seed, const std::vector<Card>& all_cards,
+                    const std::vector<Noble>& all_nobles, std::ostream& err_os = std::cerr);
+// Reset an existing state to a new game for seed (same deal as initializeGame), reusing
+// its vectors' storage; no logging, no allocation once the state has played a game
+void resetGame(GameState& state, unsigned int seed, const std::vector<Card>& all_cards,
+               const std::vector<Noble>& all_nobles);
+
+// SplitMix64 finalizer: a bijection on 64-bit values
+inline uint64_t mix64(uint64_t z) {
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+const uint64_t SPLITMIX_GAMMA = 0x9E3779B97F4A7C15ULL;
+
+// Counter-based generator: output i is mix64(seed + i * gamma), so any position of
+// the stream is O(1) to reach. Satisfies UniformRandomBitGenerator.
+struct SplitMix64 {
+    typedef uint64_t result_type;
+    uint64_t seed;
+    uint64_t counter = 0;
+
+    explicit SplitMix64(uint64_t stream_seed) : seed(stream_seed) {}
+    static constexpr result_type min() { return 0; }
+    static constexpr result_type max() { return ~0ULL; }
+    result_type operator()() { return mix64(seed + (++counter) * SPLITMIX_GAMMA); }
+    // Uniform in [0, n); the modulo bias is below 2^-56 for deck-sized n
+    uint64_t below(uint64_t n) { return (*this)() % n; }
+};
+
+// How a seed turns into a deal. LEGACY_MT19937 reproduces initializeGame's deals for
+// 32-bit seeds (0 = clock); SPLITMIX64 uses all 64 bits with a portable shuffle.
+enum SeedMode {
+    SEED_LEGACY_MT19937,
+    SEED_SPLITMIX64
+};
+
+struct GameSeed {
+    uint64_t value;
+    SeedMode mode;
+};
+
+void resetGame(GameState& state, const GameSeed& seed, const std::vector<Card>& all_cards,
+               const std::vector<Noble>& all_nobles);
+void initializeGame(GameState& state, const GameSeed& seed, const std::vector<Card>& all_cards,
+                    const std::vector<Noble>& all_nobles, std::ostream& err_os = std::cerr);
+
+// Seed of game game_index in the run seeded run_seed. Distinct indices of one run
+// always get distinct seeds (the mapping is a bijection).
+inline uint64_t deriveGameSeed(uint64_t run_seed, uint64_t game_index) {
+    return mix64(run_seed ^ mix64((game_index + 1) * SPLITMIX_GAMMA));
+}
+
+// Fresh 64-bit seed from std::random_device and the clock, for runs started without one
+uint64_t entropySeed();
 void printGameState(const GameState& state, std::ostream& os = std::cout);
 
+// Compact state conversion
+CardTable buildCardTable(const std::vector<Card>& all_cards, const std::vector<Noble>& all_nobles);
+ValidationResult packGameState(const GameState& state, CompactState& out);
+void unpackGameState(const CompactState& packed, const CardTable& table, GameState& out);
+
+// Reusable output buffer for the JSON writers. Writers append; clear() keeps the
+// capacity, so serializing into the same buffer again does not allocate.
+struct JsonBuffer {
+    std::string text;
+
+    explicit JsonBuffer(size_t capacity = 4096) { text.reserve(capacity); }
+    void clear() { text.clear(); }
+    void put(char c) { text.push_back(c); }
+    void put(const char* s) { text.append(s); }
+    void putInt(long value);
+    void putDouble(double value);     // Same digits as ostream's default formatting
+};
+
+// Append the JSON state for one viewer (0 = god view), byte-identical to gameStateToJson
+void writeGameStateJson(const GameState& state, int viewer_id, JsonBuffer& out);
+// Append several viewers' JSON in one pass over the state (outs[i] gets viewer_ids[i])
+void writeGameStateJson(const GameState& state, const int* viewer_ids, JsonBuffer* outs, int count);
+
 std::string tokensToJson(const Tokens& tokens);
 std::string discountsToJson(const Tokens& tokens);
 std::string playerToJson(const Player& player, int player_id, int viewer_id);
 std::string gameStateToJson(const GameState& state, int viewer_id);
 void printJsonGameState(const GameState& state, int viewer_id = 1, std::ostream& os = std::cout);
 
+// One player's changes between two consecutive states. Counts are the new absolute
+// values for the colors in the mask; purchased cards and owned nobles only grow.
+struct PlayerDelta {
+    uint8_t token_mask = 0;          // Bit (1 << color) per changed gem count
+    Tokens tokens;
+    uint8_t bonus_mask = 0;          // Bit (1 << color) per changed discount
+    Tokens bonuses;
+    int points = -1;                 // -1 = unchanged
+    bool reserved_changed = false;
+    std::vector<int> reserved;       // Whole reserved list when changed (91-93 = masked)
+    std::vector<int> cards_added;    // Purchased card IDs appended
+    std::vector<int> nobles_added;   // Owned noble IDs appended
+    double time_bank = 0;            // Always sent
+};
+
+struct FaceupChange {
+    int level;                       // 1-3
+    int slot;
+    int card_id;                     // 0 = empty slot
+};
+
+// What one viewer needs to turn the previous state into the next one
+struct StateDelta {
+    int current_player = 0;
+    int move_number = 0;
+    uint8_t bank_mask = 0;
+    Tokens bank;
+    std::vector<FaceupChange> faceup;
+    int faceup_size[3] = {-1, -1, -1};   // -1 = unchanged
+    int deck_size[3] = {-1, -1, -1};     // -1 = unchanged
+    bool nobles_changed = false;
+    std::vector<int> nobles;             // Available noble IDs when changed
+    PlayerDelta players[2];
+};
+
+// Diff two states as viewer_id sees them (0 = god view, nothing masked)
+void computeStateDelta(const GameState& before, const GameState& after, int viewer_id, StateDelta& out);
+// Update state in place; hidden decks become placeholder cards, as in parseGameStateJson
+ValidationResult applyStateDelta(GameState& state, const StateDelta& delta, const std::vector<Card>& all_cards,
+                                 const std::vector<Noble>& all_nobles);
+// One-line JSON form: {"delta":1,"active_player_id":..,"move":..,...}, only changed fields present
+void writeStateDeltaJson(const StateDelta& delta, int viewer_id, JsonBuffer& out);
+ValidationResult parseStateDeltaJson(const std::string& json, StateDelta& out);
+
 void processSetupCommands(GameState& state, std::vector<Card>& all_cards, std::vector<Noble>& all_nobles, std::istream& is = std::cin, std::ostream& err_os = std::cerr);
 bool processRevealCommand(GameState& state, const std::string& line, std::vector<Card>& all_cards, std::ostream& err_os = std::cerr);
 
@@ -0,0 +1,274 @@
+#include "game_record.h"
+#include <algorithm>
+#include <cstring>
+
+using std::string;
+using std::vector;
+using std::to_string;
+
+uint64_t cardSetHash(const vector<Card>& cards, const vector<Noble>& nobles) {
+    uint64_t h = mix64(cards.size() * 0x100 + nobles.size());
+    auto add = [&](uint64_t value) { h = mix64(h ^ (value + SPLITMIX_GAMMA)); };
+    for (const Card& card : cards) {
+        add(((uint64_t)card.id << 16) | ((uint64_t)card.level << 8) | (uint64_t)card.points);
+        add((uint64_t)card.color);
+        for (int c = 0; c < NUM_GEM_COLORS; c++) add((uint64_t)card.cost[c]);
+    }
+    for (const Noble& noble : nobles) {
+        add(((uint64_t)noble.id << 8) | (uint64_t)noble.points);
+        for (int c = 0; c < NUM_GEM_COLORS; c++) add((uint64_t)noble.requirements[c]);
+    }
+    return h;
+}
+
+// Explicit BUY payments share the code with the noble choice: bits 14-28 hold the
+// gem colors (3 bits each, a card costs at most 7 of a color), bits 29-31 the
+// jokers. An all-zero payment only pays for a free card and decodes as auto.
+const int PAYMENT_SHIFT = 14;
+const uint32_t BUY_CODE_MASK = (1u << PAYMENT_SHIFT) - 1;
+
+uint32_t encodeRecordedMove(const Move& move) {
+    uint32_t code = encodeMove(move);
+    if (move.type == BUY_CARD && !move.auto_payment) {
+        for (int c = 0; c < NUM_GEM_COLORS; c++) {
+            code |= (uint32_t)(std::min(move.payment[c], 7) & 7) << (PAYMENT_SHIFT + 3 * c);
+        }
+        code |= (uint32_t)(std::min(move.payment[JOKER], 7) & 7) << (PAYMENT_SHIFT + 3 * NUM_GEM_COLORS);
+    }
+    return code;
+}
+
+Move decodeRecordedMove(uint32_t code, int player_id) {
+    if ((code & 7) != (uint32_t)BUY_CARD + 1) return toMove(decodeMove(code), player_id);
+
+    Move move = toMove(decodeMove(code & BUY_CODE_MASK), player_id);
+    uint32_t payment = code >> PAYMENT_SHIFT;
+    if (payment != 0) {
+        move.auto_payment = false;
+        for (int c = 0; c < NUM_TOKEN_COLORS; c++) move.payment[c] = (payment >> (3 * c)) & 7;
+    }
+    return move;
+}
+
+static void putU32(string& out, uint32_t value) {
+    for (int i = 0; i < 4; i++) out.push_back((char)((value >> (8 * i)) & 0xFF));
+}
+
+static void putU64(string& out, uint64_t value) {
+    for (int i = 0; i < 8; i++) out.push_back((char)((value >> (8 * i)) & 0xFF));
+}
+
+static void putVarint(string& out, uint32_t value) {
+    while (value >= 0x80) {
+        out.push_back((char)((value & 0x7F) | 0x80));
+        value >>= 7;
+    }
+    out.push_back((char)value);
+}
+
+static uint32_t getU32(const unsigned char* p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static uint64_t getU64(const unsigned char* p) {
+    return (uint64_t)getU32(p) | ((uint64_t)getU32(p + 4) << 32);
+}
+
+static bool getVarint(const unsigned char*& p, const unsigned char* end, uint32_t& value) {
+    value = 0;
+    for (int shift = 0; shift < 35 && p < end; shift += 7) {
+        unsigned char byte = *p++;
+        value |= (uint32_t)(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) return true;
+    }
+    return false;
+}
+
+void encodeGameRecord(const GameRecord& record, string& out) {
+    size_t start = out.size();
+    out.append(GAME_RECORD_MAGIC, 4);
+    out.push_back((char)GAME_RECORD_VERSION);
+    uint8_t flags = (record.seed.mode == SEED_SPLITMIX64 ? RECORD_SPLITMIX64 : 0) |
+                    (record.explicit_deal ? RECORD_EXPLICIT_DEAL : 0);
+    out.push_back((char)flags);
+    out.push_back((char)(uint8_t)record.winner);
+    out.push_back((char)(uint8_t)record.reason);
+    putU32(out, 0);  // Size, patched below
+    putU32(out, (uint32_t)record.moves.size());
+    putU64(out, record.explicit_deal ? 0 : record.seed.value);
+    putU64(out, record.card_set_hash);
+
+    if (record.explicit_deal) {
+        for (int level = 0; level < 3; level++) {
+            out.push_back((char)record.faceup[level].size());
+            for (int id : record.faceup[level]) out.push_back((char)id);
+        }
+        out.push_back((char)record.nobles.size());
+        for (int id : record.nobles) out.push_back((char)id);
+    }
+    for (const RecordedMove& move : record.moves) {
+        putVarint(out, move.code);
+        putVarint(out, move.think_us);
+        if (record.explicit_deal) out.push_back((char)move.drawn_card);
+    }
+
+    uint32_t size = (uint32_t)(out.size() - start);
+    for (int i = 0; i < 4; i++) out[start + 8 + i] = (char)((size >> (8 * i)) & 0xFF);
+}
+
+ValidationResult decodeGameRecord(const char* data, size_t size, GameRecord& out, size_t& consumed) {
+    consumed = 0;
+    const unsigned char* p = reinterpret_cast<const unsigned char*>(data);
+    if (size < GAME_RECORD_HEADER_SIZE) return ValidationResult(false, "Truncated record header");
+    if (memcmp(p, GAME_RECORD_MAGIC, 4) != 0) return ValidationResult(false, "Not a game record");
+    if (p[4] != GAME_RECORD_VERSION) return ValidationResult(false, "Unsupported record version " + to_string(p[4]));
+    uint32_t record_size = getU32(p + 8);
+    if (record_size < GAME_RECORD_HEADER_SIZE || record_size > size) {
+        return ValidationResult(false, "Truncated record (" + to_string(record_size) + " bytes)");
+    }
+    uint8_t flags = p[5];
+    uint32_t num_moves = getU32(p + 12);
+    // Every move takes at least two bytes
+    if (num_moves > (record_size - GAME_RECORD_HEADER_SIZE) / 2) return ValidationResult(false, "Bad move count");
+
+    out.explicit_deal = (flags & RECORD_EXPLICIT_DEAL) != 0;
+    out.seed = GameSeed{getU64(p + 16), (flags & RECORD_SPLITMIX64) ? SEED_SPLITMIX64 : SEED_LEGACY_MT19937};
+    out.winner = p[6];
+    out.reason = (RecordEndReason)std::min<int>(p[7], END_UNFINISHED);
+    out.card_set_hash = getU64(p + 24);
+
+    const unsigned char* end = p + record_size;
+    p += GAME_RECORD_HEADER_SIZE;
+    auto readIds = [&](vector<int>& ids) {
+        ids.clear();
+        if (p >= end) return false;
+        size_t count = *p++;
+        if ((size_t)(end - p) < count) return false;
+        for (size_t i = 0; i < count; i++) ids.push_back(*p++);
+        return true;
+    };
+    for (vector<int>& ids : out.faceup) ids.clear();
+    out.nobles.clear();
+    if (out.explicit_deal) {
+        if (!readIds(out.faceup[0]) || !readIds(out.faceup[1]) || !readIds(out.faceup[2]) || !readIds(out.nobles)) {
+            return ValidationResult(false, "Truncated deal");
+        }
+    }
+
+    out.moves.resize(num_moves);
+    for (uint32_t i = 0; i < num_moves; i++) {
+        RecordedMove& move = out.moves[i];
+        move.drawn_card = 0;
+        if (!getVarint(p, end, move.code) || !getVarint(p, end, move.think_us)) {
+            return ValidationResult(false, "Truncated move " + to_string(i + 1));
+        }
+        if (out.explicit_deal) {
+            if (p >= end) return ValidationResult(false, "Truncated move " + to_string(i + 1));
+            move.drawn_card = *p++;
+        }
+    }
+    if (p != end) return ValidationResult(false, "Record size does not match its moves");
+    consumed = record_size;
+    return ValidationResult(true);
+}
+
+ValidationResult loadGameRecords(const string& path, vector<GameRecord>& out) {
+    std::ifstream file(path.c_str(), std::ios::binary);
+    if (!file.is_open()) return ValidationResult(false, "Cannot open " + path);
+    string data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+    size_t offset = 0;
+    while (offset < data.size()) {
+        GameRecord record;
+        size_t consumed;
+        ValidationResult decoded = decodeGameRecord(data.data() + offset, data.size() - offset, record, consumed);
+        if (!decoded.valid) {
+            return ValidationResult(false, path + " at byte " + to_string(offset) + ": " + decoded.error_message);
+        }
+        out.push_back(std::move(record));
+        offset += consumed;
+    }
+    return ValidationResult(true);
+}
+
+// Opening position of an explicit deal: the recorded face-up cards and nobles, with
+// the rest of each level in its deck (in ID order; draws are placed on top as played)
+static ValidationResult dealExplicit(const GameRecord& record, const vector<Card>& cards,
+                                     const vector<Noble>& nobles, GameState& state) {
+    resetGame(state, GameSeed{0, SEED_SPLITMIX64}, cards, nobles);
+    for (int level = 1; level <= 3; level++) {
+        vector<Card>& faceup = state.getFaceup(level);
+        vector<Card>& deck = state.getDeck(level);
+        faceup.clear();
+        deck.clear();
+        for (int id : record.faceup[level - 1]) {
+            Card card = loadCardById(id, cards);
+            if (card.id == 0 || card.level != level) {
+                return ValidationResult(false, "Bad level " + to_string(level) + " card " + to_string(id));
+            }
+            faceup.push_back(card);
+        }
+        for (const Card& card : cards) {
+            if (card.level != level) continue;
+            bool on_board = false;
+            for (const Card& up : faceup) on_board = on_board || up.id == card.id;
+            if (!on_board) deck.push_back(card);
+        }
+    }
+    state.available_nobles.clear();
+    for (int id : record.nobles) {
+        auto it = std::find_if(nobles.begin(), nobles.end(), [&](const Noble& n) { return n.id == id; });
+        if (it == nobles.end()) return ValidationResult(false, "Unknown noble " + to_string(id));
+        state.available_nobles.push_back(*it);
+    }
+    state.zobrist_key = computeZobristKey(state);
+    return ValidationResult(true);
+}
+
+ValidationResult startReplay(const GameRecord& record, const vector<Card>& cards, const vector<Noble>& nobles,
+                             GameState& state) {
+    if (record.card_set_hash != cardSetHash(cards, nobles)) {
+        return ValidationResult(false, "Record was dealt from a different card set");
+    }
+    state.replay_mode = false;
+    if (record.explicit_deal) return dealExplicit(record, cards, nobles, state);
+    resetGame(state, record.seed, cards, nobles);
+    return ValidationResult(true);
+}
+
+ValidationResult replayMove(const GameRecord& record, int ply, const vector<Card>& cards, GameState& state,
+                            std::ostream& err_os) {
+    const RecordedMove& recorded = record.moves[ply];
+    if (recorded.drawn_card != 0) {
+        // Put the card this move drew on top of its deck
+        Card card = loadCardById(recorded.drawn_card, cards);
+        string not_in_deck = "Move " + to_string(ply + 1) + " draws card " + to_string(recorded.drawn_card) +
+                             ", which is not in the deck";
+        // getDeck falls back to level 3 for anything else, so unknown cards stop here
+        if (card.id == 0 || card.level < 1 || card.level > 3) return ValidationResult(false, not_in_deck);
+        vector<Card>& deck = state.getDeck(card.level);
+        auto it = std::find_if(deck.begin(), deck.end(), [&](const Card& c) { return c.id == card.id; });
+        if (it == deck.end()) return ValidationResult(false, not_in_deck);
+        std::iter_swap(it, deck.end() - 1);
+    }
+    int mover = state.current_player;
+    ValidationResult applied = applyMove(state, decodeRecordedMove(recorded.code, mover), err_os);
+    if (!applied.valid) {
+        return ValidationResult(false, "Move " + to_string(ply + 1) + ": " + applied.error_message);
+    }
+    // The referee's clock, to the microsecond
+    state.players[mover].time_bank += TIME_INCREMENT - recorded.think_us / 1e6;
+    return applied;
+}
+
+ValidationResult replayGameRecord(const GameRecord& record, const vector<Card>& cards, const vector<Noble>& nobles,
+                                  GameState& state, const std::function<bool(const GameState&, int)>& visit,
+                                  std::ostream& err_os) {
+    ValidationResult result = startReplay(record, cards, nobles, state);
+    if (!result.valid || !visit(state, 0)) return result;
+    for (size_t ply = 0; ply < record.moves.size(); ply++) {
+        result = replayMove(record, (int)ply, cards, state, err_os);
+        if (!result.valid || !visit(state, (int)ply + 1)) return result;
+    }
+    return result;
+}
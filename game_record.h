@@ -0,0 +1,97 @@
+#ifndef GAME_RECORD_H
+#define GAME_RECORD_H
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+#include "game_logic.h"
+
+// Compact binary game records.
+//
+// A record stores how the game was dealt and the moves, not the states: the
+// reader deals the game again from the seed and replays every move through
+// applyMove, which reconstructs each intermediate GameState exactly. A file
+// is any number of records back to back.
+//
+// Record layout (little-endian):
+//   0   char[4]  "SPGR"
+//   4   u8       version (GAME_RECORD_VERSION)
+//   5   u8       flags (RECORD_*)
+//   6   u8       winner: 1/2, 0 = tie, RECORD_NO_RESULT = unfinished
+//   7   u8       end reason (RecordEndReason)
+//   8   u32      record size in bytes, header included
+//   12  u32      number of moves
+//   16  u64      seed
+//   24  u64      cardSetHash of the cards and nobles dealt from
+//   32  explicit deals only: per level a count and face-up card IDs, then a
+//       count and the noble IDs (u8 each)
+//   then per move: the move code and the think time in microseconds as
+//       LEB128 varints, plus for explicit deals the ID of the card the move
+//       drew (u8, 0 = none)
+//
+// Move codes are encodeMove codes; a BUY with an explicit payment also sets
+// 3 bits per gem color from bit 14 and the joker count in bits 29-31.
+
+const char GAME_RECORD_MAGIC[4] = {'S', 'P', 'G', 'R'};
+const uint8_t GAME_RECORD_VERSION = 1;
+const size_t GAME_RECORD_HEADER_SIZE = 32;
+
+const uint8_t RECORD_SPLITMIX64 = 1;      // Seed is a SEED_SPLITMIX64 seed (else legacy mt19937)
+const uint8_t RECORD_EXPLICIT_DEAL = 2;   // No seed: the deal and every drawn card are stored
+const uint8_t RECORD_NO_RESULT = 255;
+
+enum RecordEndReason {
+    END_NORMAL,                 // Points or pass rule; see isGameOver
+    END_TIMEOUT,                // Loser ran out of time
+    END_INVALID_MOVE,           // Loser sent an illegal move
+    END_UNFINISHED              // Log or stream stopped before the game ended
+};
+
+struct RecordedMove {
+    uint32_t code;              // See encodeRecordedMove
+    uint32_t think_us;          // 0 when unknown
+    uint8_t drawn_card;         // Explicit deals: card drawn by the move (0 = none)
+};
+
+struct GameRecord {
+    GameSeed seed = GameSeed{0, SEED_LEGACY_MT19937};
+    bool explicit_deal = false;
+    uint64_t card_set_hash = 0;
+    int winner = RECORD_NO_RESULT;
+    RecordEndReason reason = END_UNFINISHED;
+    std::vector<int> faceup[3];         // Explicit deals: opening face-up IDs per level
+    std::vector<int> nobles;            // Explicit deals: opening noble IDs
+    std::vector<RecordedMove> moves;
+};
+
+// Identifies a card/noble set, so a record is never replayed against other tables
+uint64_t cardSetHash(const std::vector<Card>& cards, const std::vector<Noble>& nobles);
+
+// Move codes as stored in records: encodeMove plus any explicit BUY payment
+uint32_t encodeRecordedMove(const Move& move);
+Move decodeRecordedMove(uint32_t code, int player_id);
+
+// Append one record to out
+void encodeGameRecord(const GameRecord& record, std::string& out);
+// Decode the record at data (size bytes available); consumed is its size in bytes
+ValidationResult decodeGameRecord(const char* data, size_t size, GameRecord& out, size_t& consumed);
+// Read every record in a file
+ValidationResult loadGameRecords(const std::string& path, std::vector<GameRecord>& out);
+
+// Deal the record's opening position into state (storage is reused as in resetGame)
+ValidationResult startReplay(const GameRecord& record, const std::vector<Card>& cards,
+                             const std::vector<Noble>& nobles, GameState& state);
+// Apply move `ply` (0-based) of the record to the state it has reached, charging its
+// think time to the mover's bank. Moves are not validated again; records are checked
+// when they are converted or written.
+ValidationResult replayMove(const GameRecord& record, int ply, const std::vector<Card>& cards, GameState& state,
+                            std::ostream& err_os = std::cerr);
+// Replay the whole record, calling visit with the state after each ply (0 = opening).
+// Stops early, without error, when visit returns false.
+ValidationResult replayGameRecord(const GameRecord& record, const std::vector<Card>& cards,
+                                  const std::vector<Noble>& nobles, GameState& state,
+                                  const std::function<bool(const GameState&, int)>& visit,
+                                  std::ostream& err_os = std::cerr);
+
+#endif // GAME_RECORD_H
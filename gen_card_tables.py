@@ -0,0 +1,50 @@
+"""Generate card_tables.inc (the built-in card and noble tables) from the JSON data.
+
+Usage: python3 gen_card_tables.py cards.json nobles.json > card_tables.inc
+"""
+import json
+import sys
+
+# Color enum order in game_logic.h
+GEM_COLORS = ["black", "blue", "white", "green", "red"]
+
+
+def gem_list(counts):
+    return "{" + ", ".join(str(counts.get(color, 0)) for color in GEM_COLORS) + "}"
+
+
+def main(cards_path, nobles_path):
+    with open(cards_path) as f:
+        cards = json.load(f)
+    with open(nobles_path) as f:
+        nobles = json.load(f)
+
+    # Built-in tables are indexed by ID, so IDs must be 1..N in order
+    for expected, entry in enumerate(cards, 1):
+        if entry["id"] != expected:
+            sys.exit("cards must be listed with IDs 1..N in order (got %d at %d)" % (entry["id"], expected))
+    for expected, entry in enumerate(nobles, 1):
+        if entry["id"] != expected:
+            sys.exit("nobles must be listed with IDs 1..N in order (got %d at %d)" % (entry["id"], expected))
+
+    out = sys.stdout
+    out.write("// Generated by gen_card_tables.py from %s and %s. Do not edit;\n" % (cards_path, nobles_path))
+    out.write("// run `make card_tables.inc` after changing the JSON files.\n")
+    out.write("// Gem counts are in Color order: black, blue, white, green, red.\n\n")
+
+    out.write("static const BuiltinCard BUILTIN_CARDS[%d] = {\n" % len(cards))
+    for card in cards:
+        out.write("    {%d, %d, %d, %s, %s},\n" % (card["id"], card["level"], card["points"],
+                                                 card["color"].upper(), gem_list(card["cost"])))
+    out.write("};\n\n")
+
+    out.write("static const BuiltinNoble BUILTIN_NOBLES[%d] = {\n" % len(nobles))
+    for noble in nobles:
+        out.write("    {%d, %d, %s},\n" % (noble["id"], noble["points"], gem_list(noble["requirements"])))
+    out.write("};\n")
+
+
+if __name__ == "__main__":
+    if len(sys.argv) != 3:
+        sys.exit(__doc__.strip())
+    main(sys.argv[1], sys.argv[2])
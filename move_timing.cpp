@@ -0,0 +1,43 @@
+#include "move_timing.h"
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+
+int64_t monotonicNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void TimingStats::add(int player_idx, const MoveTiming& timing) {
+    MoveTiming& sum = total[player_idx];
+    MoveTiming& top = max[player_idx];
+    moves[player_idx]++;
+    sum.serialize_ns += timing.serialize_ns;
+    sum.write_ns += timing.write_ns;
+    sum.think_ns += timing.think_ns;
+    sum.read_ns += timing.read_ns;
+    sum.process_ns += timing.process_ns;
+    top.serialize_ns = std::max(top.serialize_ns, timing.serialize_ns);
+    top.write_ns = std::max(top.write_ns, timing.write_ns);
+    top.think_ns = std::max(top.think_ns, timing.think_ns);
+    top.read_ns = std::max(top.read_ns, timing.read_ns);
+    top.process_ns = std::max(top.process_ns, timing.process_ns);
+}
+
+void TimingStats::report(std::ostream& os) const {
+    const char* names[5] = {"serialize", "write", "think", "read", "process"};
+    os << "Move timing (ms, mean / max):" << std::endl;
+    for (int p = 0; p < 2; p++) {
+        if (moves[p] == 0) continue;
+        const int64_t sums[5] = {total[p].serialize_ns, total[p].write_ns, total[p].think_ns, total[p].read_ns,
+                                 total[p].process_ns};
+        const int64_t maxima[5] = {max[p].serialize_ns, max[p].write_ns, max[p].think_ns, max[p].read_ns,
+                                   max[p].process_ns};
+        os << "  Player " << (p + 1) << " (" << moves[p] << " moves):";
+        for (int i = 0; i < 5; i++) {
+            os << " " << names[i] << " " << std::fixed << std::setprecision(3) << sums[i] / 1e6 / moves[p]
+               << " / " << maxima[i] / 1e6;
+        }
+        os << std::endl;
+    }
+}
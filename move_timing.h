@@ -0,0 +1,41 @@
+#ifndef MOVE_TIMING_H
+#define MOVE_TIMING_H
+
+#include <cstdint>
+#include <iostream>
+
+// Per-move latency breakdown for the referee (POSIX only).
+//
+// Each move's wall time is split at monotonic nanosecond timestamps taken at
+// the protocol boundaries: when the referee starts serializing the state,
+// starts writing it, finishes flushing it, sees the first byte of the reply,
+// and has the complete reply. The engine's time bank is charged from the flush
+// until the read that delivered the reply's newline or last frame byte, so a
+// reply sent a byte at a time cannot stop the clock early; serialization and
+// blocked writes are referee or transport time.
+// Latency in relays after the flush (e.g. a runner's pipes) cannot be told
+// apart from thinking and stays in think_ns.
+
+// Monotonic clock in nanoseconds (steady_clock)
+int64_t monotonicNs();
+
+struct MoveTiming {
+    int64_t serialize_ns = 0;   // Building the state (views, deltas or frames) sent before the move
+    int64_t write_ns = 0;       // Writing and flushing it; long when the pipe is full
+    int64_t think_ns = 0;       // Flush complete -> complete move line or frame arrived (charged)
+    int64_t read_ns = 0;        // First byte -> complete move; part of think_ns, large when a reply trickles in
+    int64_t process_ns = 0;     // Parsing, validating, applying and logging the move
+};
+
+// Running totals and maxima per player
+struct TimingStats {
+    int moves[2] = {0, 0};
+    MoveTiming total[2];
+    MoveTiming max[2];
+
+    void add(int player_idx, const MoveTiming& timing);
+    // Mean and max of each component per player, in milliseconds
+    void report(std::ostream& os) const;
+};
+
+#endif // MOVE_TIMING_H
@@ -0,0 +1,238 @@
+// Perft - Move Generation Correctness and Speed
+// Counts the positions reachable in exactly `depth` moves from seeded positions,
+// walking the tree with findAllValidMoves and applyMove/undoMove. Deck draws are
+// fixed by the seed, so the counts are reproducible: perft_reference.txt holds
+// counts from the current rules code, and `./perft --verify` checks a build
+// against them and reports nodes/s.
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include "game_logic.h"
+
+using std::string;
+using std::vector;
+using std::cout;
+using std::cerr;
+using std::endl;
+using std::mt19937;
+
+// A position: the opening dealt from seed, then `plies` moves picked by mt19937(seed)
+struct PerftPosition {
+    unsigned int seed;
+    int plies;
+};
+
+struct PerftCounts {
+    uint64_t nodes = 0;
+    uint64_t checksum = 0;          // Sum of the leaves' Zobrist keys; catches wrong states with right counts
+    long errors = 0;                // Generated moves that applyMove rejected, or failed --check tests
+};
+
+struct PerftOptions {
+    bool use_move_list = false;     // generateMoves/MoveList instead of findAllValidMoves
+    bool check = false;             // Cross-check generators and Zobrist keys at every node (slow)
+};
+
+// Move generation order is not part of the rules, so positions are reached through
+// moves sorted by their encodeMove codes
+static vector<Move> sortedMoves(const GameState& state) {
+    vector<Move> moves = findAllValidMoves(state);
+    std::stable_sort(moves.begin(), moves.end(), [](const Move& a, const Move& b) {
+        return encodeMove(a) < encodeMove(b);
+    });
+    return moves;
+}
+
+static ValidationResult setupPosition(const PerftPosition& position, GameState& state) {
+    std::ostream null_os(nullptr);
+    initializeGame(state, position.seed, builtinCards(), builtinNobles(), null_os);
+    mt19937 rng(position.seed);
+    for (int ply = 0; ply < position.plies; ply++) {
+        vector<Move> moves = sortedMoves(state);
+        if (isGameOver(state) || moves.empty()) {
+            return ValidationResult(false, "Game " + std::to_string(position.seed) + " ends before ply " +
+                                    std::to_string(position.plies));
+        }
+        ValidationResult result = applyMove(state, moves[rng() % moves.size()], null_os);
+        if (!result.valid) return result;
+    }
+    return ValidationResult(true);
+}
+
+static void checkNode(const GameState& state, const vector<Move>& moves, PerftCounts& counts) {
+    static MoveList list;
+    generateMoves(state, list);
+    if (list.count != (int)moves.size()) {
+        cerr << "ERROR: generateMoves found " << list.count << " moves, findAllValidMoves " << moves.size() << endl;
+        counts.errors++;
+    }
+    if (state.zobrist_key != computeZobristKey(state)) {
+        cerr << "ERROR: incremental Zobrist key differs from computeZobristKey" << endl;
+        counts.errors++;
+    }
+}
+
+// Game-over positions count as leaves, so every line of play is counted once
+static void perft(GameState& state, int depth, const PerftOptions& options, vector<MoveList>& lists,
+                  std::ostream& null_os, PerftCounts& counts) {
+    if (depth == 0 || isGameOver(state)) {
+        counts.nodes++;
+        counts.checksum += state.zobrist_key;
+        return;
+    }
+    UndoRecord undo;
+    uint64_t key = state.zobrist_key;
+    if (options.use_move_list) {
+        MoveList& moves = lists[depth - 1];
+        generateMoves(state, moves);
+        for (int i = 0; i < moves.count; i++) {
+            if (!applyMove(state, toMove(moves.moves[i], state.current_player), undo, null_os).valid) {
+                counts.errors++;
+                continue;
+            }
+            perft(state, depth - 1, options, lists, null_os, counts);
+            undoMove(state, undo);
+        }
+    } else {
+        vector<Move> moves = findAllValidMoves(state);
+        if (options.check) checkNode(state, moves, counts);
+        for (const Move& move : moves) {
+            if (!applyMove(state, move, undo, null_os).valid) {
+                counts.errors++;
+                continue;
+            }
+            perft(state, depth - 1, options, lists, null_os, counts);
+            undoMove(state, undo);
+        }
+    }
+    if (state.zobrist_key != key) {
+        cerr << "ERROR: undoMove did not restore the position" << endl;
+        counts.errors++;
+    }
+}
+
+// Run one perft and report its speed on cerr; returns false if the position could not be set up
+static bool runPerft(const PerftPosition& position, int depth, const PerftOptions& options, PerftCounts& counts,
+                     double& seconds) {
+    GameState state;
+    ValidationResult result = setupPosition(position, state);
+    if (!result.valid) {
+        cerr << "ERROR: " << result.error_message << endl;
+        return false;
+    }
+    std::ostream null_os(nullptr);
+    vector<MoveList> lists(std::max(depth, 1));
+    counts = PerftCounts();
+    auto start = std::chrono::steady_clock::now();
+    perft(state, depth, options, lists, null_os, counts);
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    seconds = elapsed.count();
+    return true;
+}
+
+static string hex64(uint64_t value) {
+    std::ostringstream out;
+    out << "0x" << std::hex << std::setw(16) << std::setfill('0') << value;
+    return out.str();
+}
+
+// Check every "seed plies depth nodes checksum" line of a reference file
+static int verifyReference(const string& path, const PerftOptions& options) {
+    std::ifstream file(path.c_str());
+    if (!file.is_open()) {
+        cerr << "ERROR: Cannot open " << path << endl;
+        return 1;
+    }
+    string line;
+    int checked = 0, failed = 0;
+    uint64_t total_nodes = 0;
+    double total_seconds = 0;
+    while (std::getline(file, line)) {
+        if (line.empty() || line[0] == '#') continue;
+        std::istringstream fields(line);
+        PerftPosition position;
+        int depth;
+        uint64_t nodes;
+        string checksum;
+        if (!(fields >> position.seed >> position.plies >> depth >> nodes >> checksum)) {
+            cerr << "ERROR: Bad reference line: " << line << endl;
+            failed++;
+            continue;
+        }
+        PerftCounts counts;
+        double seconds = 0;
+        bool ok = runPerft(position, depth, options, counts, seconds) && counts.errors == 0 &&
+                  counts.nodes == nodes && hex64(counts.checksum) == checksum;
+        checked++;
+        total_nodes += counts.nodes;
+        total_seconds += seconds;
+        cout << (ok ? "ok   " : "FAIL ") << line;
+        if (!ok) cout << "  (got " << counts.nodes << " " << hex64(counts.checksum) << ")";
+        cout << endl;
+        if (!ok) failed++;
+    }
+    cout << checked << " counts, " << failed << " failed, " << total_nodes << " nodes in " << std::fixed
+         << std::setprecision(3) << total_seconds << "s (" << std::setprecision(0)
+         << total_nodes / std::max(total_seconds, 1e-9) << " nodes/s)" << endl;
+    return (failed || checked == 0) ? 1 : 0;
+}
+
+static void printUsage() {
+    cerr << "Usage: ./perft [options] SEED PLIES DEPTH   Count depths 1..DEPTH from one position\n"
+         << "       ./perft [options] --verify FILE      Check every line of a reference file\n"
+         << "A position is the opening dealt from SEED, followed by PLIES moves picked by mt19937(SEED).\n"
+         << "Counts are printed as reference lines: seed plies depth nodes checksum.\n"
+         << "Options:\n"
+         << "  --move-list   Generate with generateMoves/MoveList instead of findAllValidMoves\n"
+         << "  --check       Cross-check both generators and the Zobrist key at every node (slow)" << endl;
+}
+
+int main(int argc, char* argv[]) {
+    PerftOptions options;
+    string verify_path;
+    vector<string> args;
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        if (arg == "--move-list") {
+            options.use_move_list = true;
+        } else if (arg == "--check") {
+            options.check = true;
+        } else if (arg == "--verify" && i + 1 < argc) {
+            verify_path = argv[++i];
+        } else if (arg.compare(0, 2, "--") == 0) {
+            cerr << "ERROR: Unknown option " << arg << endl;
+            printUsage();
+            return 1;
+        } else {
+            args.push_back(arg);
+        }
+    }
+    if (options.use_move_list && options.check) {
+        cerr << "ERROR: --check walks the tree with findAllValidMoves; drop --move-list" << endl;
+        return 1;
+    }
+    if (!verify_path.empty()) return verifyReference(verify_path, options);
+    if (args.size() != 3) {
+        printUsage();
+        return 1;
+    }
+
+    PerftPosition position = {(unsigned int)strtoul(args[0].c_str(), nullptr, 10), atoi(args[1].c_str())};
+    int max_depth = atoi(args[2].c_str());
+    for (int depth = 1; depth <= max_depth; depth++) {
+        PerftCounts counts;
+        double seconds = 0;
+        if (!runPerft(position, depth, options, counts, seconds)) return 1;
+        cout << position.seed << " " << position.plies << " " << depth << " " << counts.nodes << " "
+             << hex64(counts.checksum) << endl;
+        cerr << "depth " << depth << ": " << counts.nodes << " nodes in " << std::fixed << std::setprecision(3)
+             << seconds << "s (" << std::setprecision(0) << counts.nodes / std::max(seconds, 1e-9) << " nodes/s)";
+        if (counts.errors) cerr << ", " << counts.errors << " errors";
+        cerr << endl;
+        if (counts.errors) return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,557 @@
+// Game Record Tool
+// Converts referee logs and SETUP/REVEAL replay streams to binary game records
+// (game_record.h) and back, reports record sizes and replay speed, and packs
+// records into random-access archives (game_archive.h).
+
+#include <chrono>
+#include <iomanip>
+#include <random>
+#include "game_logic.h"
+#include "game_log.h"
+#include "game_record.h"
+#include "game_archive.h"
+
+using std::string;
+using std::vector;
+using std::cout;
+using std::cerr;
+using std::endl;
+using std::to_string;
+
+struct DeckTables {
+    vector<Card> cards;
+    vector<Noble> nobles;
+    uint64_t hash;
+};
+
+// One move line from a log; rejected moves were not applied by the referee
+struct LoggedMove {
+    string text;
+    int player;
+    uint32_t think_us;
+    bool rejected;
+    string hash;                    // Hex Zobrist key after the move (older logs only)
+};
+
+// Raw value of "key": in a referee log line (a string value is unescaped)
+static bool logField(const string& line, const char* key, string& out) {
+    string pattern = string("\"") + key + "\":";
+    size_t pos = line.find(pattern);
+    if (pos == string::npos) return false;
+    pos += pattern.size();
+    out.clear();
+    if (pos < line.size() && line[pos] == '"') {
+        for (size_t i = pos + 1; i < line.size(); i++) {
+            char c = line[i];
+            if (c == '"') return true;
+            if (c == '\\' && i + 1 < line.size()) {
+                char e = line[++i];
+                if (e == 'u' && i + 4 < line.size()) {
+                    out.push_back((char)strtol(line.substr(i + 1, 4).c_str(), nullptr, 16));
+                    i += 4;
+                } else {
+                    out.push_back(e == 'n' ? '\n' : e == 't' ? '\t' : e == 'r' ? '\r' : e);
+                }
+            } else {
+                out.push_back(c);
+            }
+        }
+        return false;
+    }
+    size_t end = line.find_first_of(",}", pos);
+    out = line.substr(pos, end == string::npos ? string::npos : end - pos);
+    return true;
+}
+
+static RecordEndReason reasonFromLog(const string& reason) {
+    if (reason == "game over") return END_NORMAL;
+    if (reason.find("timed out") != string::npos) return END_TIMEOUT;
+    if (reason.find("invalid move") != string::npos) return END_INVALID_MOVE;
+    return END_UNFINISHED;
+}
+
+// Read a JSON-lines referee log, or a text game.log from older referees
+static ValidationResult readLog(const string& path, GameRecord& record, vector<LoggedMove>& moves,
+                                string& final_hash) {
+    std::ifstream file(path.c_str());
+    if (!file.is_open()) return ValidationResult(false, "Cannot open " + path);
+    bool have_seed = false;
+    string line, value;
+    while (getline(file, line)) {
+        if (!line.empty() && line.back() == '\r') line.pop_back();
+        if (line.compare(0, 1, "{") == 0) {
+            logField(line, "type", value);
+            if (value == "start") {
+                logField(line, "seed_mode", value);
+                record.seed.mode = (value == "splitmix64") ? SEED_SPLITMIX64 : SEED_LEGACY_MT19937;
+            } else if (value == "move") {
+                LoggedMove move = LoggedMove();
+                logField(line, "move", move.text);
+                if (logField(line, "player", value)) move.player = atoi(value.c_str());
+                if (logField(line, "think_us", value)) move.think_us = (uint32_t)strtoul(value.c_str(), nullptr, 10);
+                move.rejected = logField(line, "error", value);
+                logField(line, "hash", move.hash);
+                moves.push_back(move);
+            } else if (value == "end") {
+                if (logField(line, "seed", value)) {
+                    record.seed.value = strtoull(value.c_str(), nullptr, 10);
+                    have_seed = true;
+                }
+                if (logField(line, "winner", value)) record.winner = atoi(value.c_str());
+                if (logField(line, "reason", value)) record.reason = reasonFromLog(value);
+                logField(line, "hash", final_hash);
+            }
+        } else if (line.compare(0, 6, "Seed: ") == 0) {
+            record.seed.value = strtoull(line.c_str() + 6, nullptr, 10);
+            if (line.find("(splitmix64)") != string::npos) record.seed.mode = SEED_SPLITMIX64;
+            have_seed = true;
+        } else if (line.compare(0, 7, "Player ") == 0 && line.size() > 10 && line[8] == ':') {
+            LoggedMove move = LoggedMove();
+            move.player = line[7] - '0';
+            move.text = line.substr(10);
+            moves.push_back(move);
+        } else if (line.compare(0, 15, "WINNER: Player ") == 0) {
+            record.winner = atoi(line.c_str() + 15);
+            record.reason = END_NORMAL;
+        } else if (line == "RESULT: TIE") {
+            record.winner = 0;
+            record.reason = END_NORMAL;
+        } else if (line.compare(0, 13, "Game Result: ") == 0 && line.find(" wins! (") != string::npos) {
+            record.winner = atoi(line.c_str() + 20);
+            record.reason = line.find("timeout") != string::npos ? END_TIMEOUT : END_INVALID_MOVE;
+        }
+    }
+    if (!have_seed) return ValidationResult(false, path + ": no seed (the game did not finish)");
+    return ValidationResult(true);
+}
+
+static ValidationResult convertLog(const string& path, const DeckTables& tables, GameRecord& record) {
+    record = GameRecord();
+    record.card_set_hash = tables.hash;
+    vector<LoggedMove> logged;
+    string final_hash;              // Hex Zobrist key of the final state, if logged
+    ValidationResult result = readLog(path, record, logged, final_hash);
+    if (!result.valid) return result;
+
+    std::ostream null_os(nullptr);
+    GameState state;
+    result = startReplay(record, tables.cards, tables.nobles, state);
+    if (!result.valid) return result;
+    for (const LoggedMove& entry : logged) {
+        if (entry.rejected || entry.player != state.current_player + 1) continue;
+        // Text logs don't mark rejected moves: whatever the referee refused is skipped
+        std::pair<Move, ValidationResult> parsed = parseMove(entry.text, state.current_player);
+        if (!parsed.second.valid || parsed.first.type == REVEAL_CARD || !validateMove(state, parsed.first).valid) {
+            continue;
+        }
+        RecordedMove move = {encodeRecordedMove(parsed.first), entry.think_us, 0};
+        record.moves.push_back(move);
+        result = replayMove(record, (int)record.moves.size() - 1, tables.cards, state, null_os);
+        if (!result.valid) return ValidationResult(false, path + ": " + result.error_message);
+        if (!entry.hash.empty() && strtoull(entry.hash.c_str(), nullptr, 16) != state.zobrist_key) {
+            return ValidationResult(false, path + ": replay diverges from the log at move " +
+                                    to_string(record.moves.size()));
+        }
+    }
+    if (!final_hash.empty() && strtoull(final_hash.c_str(), nullptr, 16) != state.zobrist_key) {
+        return ValidationResult(false, path + ": replay does not reach the logged final state");
+    }
+    return ValidationResult(true);
+}
+
+// A SETUP_FACEUP/SETUP_NOBLES/BEGIN header, then move lines, each followed by a
+// REVEAL line when it drew a card (see processSetupCommands/processRevealCommand)
+static ValidationResult convertReplayStream(const string& path, const DeckTables& tables, GameRecord& record) {
+    std::ifstream file(path.c_str());
+    if (!file.is_open()) return ValidationResult(false, "Cannot open " + path);
+    record = GameRecord();
+    record.explicit_deal = true;
+    record.card_set_hash = tables.hash;
+
+    std::ostream null_os(nullptr);
+    GameState state;
+    bool begun = false;
+    bool pending = false;           // Last move is waiting for a possible REVEAL
+    int line_number = 0;
+    auto applyPending = [&]() {
+        pending = false;
+        int ply = (int)record.moves.size() - 1;
+        size_t deck_sizes[3];
+        for (int level = 1; level <= 3; level++) deck_sizes[level - 1] = state.getDeck(level).size();
+        ValidationResult applied = replayMove(record, ply, tables.cards, state, null_os);
+        if (!applied.valid) return applied;
+        for (int level = 1; level <= 3; level++) {
+            if (state.getDeck(level).size() < deck_sizes[level - 1] && record.moves[ply].drawn_card == 0) {
+                return ValidationResult(false, "Move " + to_string(ply + 1) + " draws a card but no REVEAL follows");
+            }
+        }
+        return ValidationResult(true);
+    };
+
+    string line;
+    while (getline(file, line)) {
+        line_number++;
+        if (!line.empty() && line.back() == '\r') line.pop_back();
+        std::istringstream iss(line);
+        string command;
+        if (!(iss >> command) || command[0] == '#') continue;
+        string where = path + ":" + to_string(line_number) + ": ";
+
+        if (!begun) {
+            int id;
+            if (command == "SETUP_FACEUP") {
+                string level;
+                iss >> level;
+                int index = (level.size() == 6 && level.compare(0, 5, "level") == 0) ? level[5] - '1' : -1;
+                if (index < 0 || index > 2) return ValidationResult(false, where + "bad level " + level);
+                while (iss >> id) record.faceup[index].push_back(id);
+            } else if (command == "SETUP_NOBLES") {
+                while (iss >> id) record.nobles.push_back(id);
+            } else if (command == "BEGIN") {
+                ValidationResult dealt = startReplay(record, tables.cards, tables.nobles, state);
+                if (!dealt.valid) return ValidationResult(false, where + dealt.error_message);
+                begun = true;
+            }
+            // SETUP_DECK only orders the hidden cards; every draw is revealed later
+            continue;
+        }
+
+        if (command == "REVEAL") {
+            int id = 0;
+            iss >> id;
+            if (!pending || id <= 0 || id > MAX_CARD_ID) {
+                return ValidationResult(false, where + "unexpected REVEAL");
+            }
+            record.moves.back().drawn_card = (uint8_t)id;
+            ValidationResult applied = applyPending();
+            if (!applied.valid) return ValidationResult(false, where + applied.error_message);
+            continue;
+        }
+        if (pending) {
+            ValidationResult applied = applyPending();
+            if (!applied.valid) return ValidationResult(false, where + applied.error_message);
+        }
+        std::pair<Move, ValidationResult> parsed = parseMove(line, state.current_player);
+        if (parsed.second.valid) parsed.second = validateMove(state, parsed.first);
+        if (!parsed.second.valid) return ValidationResult(false, where + parsed.second.error_message);
+        RecordedMove move = {encodeRecordedMove(parsed.first), 0, 0};
+        record.moves.push_back(move);
+        pending = true;
+    }
+    if (!begun) return ValidationResult(false, path + ": no BEGIN line");
+    if (pending) {
+        ValidationResult applied = applyPending();
+        if (!applied.valid) return ValidationResult(false, path + ": " + applied.error_message);
+    }
+    if (isGameOver(state)) {
+        record.winner = determineWinner(state) + 1;
+        record.reason = END_NORMAL;
+    }
+    return ValidationResult(true);
+}
+
+static void writeReplayStream(const GameRecord& record, const DeckTables& tables, std::ostream& os) {
+    std::ostream null_os(nullptr);
+    GameState state;
+    ValidationResult result = startReplay(record, tables.cards, tables.nobles, state);
+    if (!result.valid) {
+        cerr << "ERROR: " << result.error_message << endl;
+        return;
+    }
+    for (int level = 1; level <= 3; level++) {
+        os << "SETUP_FACEUP level" << level;
+        for (const Card& card : state.getFaceup(level)) os << ' ' << card.id;
+        os << '\n';
+    }
+    os << "SETUP_NOBLES";
+    for (const Noble& noble : state.available_nobles) os << ' ' << noble.id;
+    os << "\nBEGIN\n";
+
+    for (size_t ply = 0; ply < record.moves.size(); ply++) {
+        int tops[3];
+        size_t deck_sizes[3];
+        for (int level = 1; level <= 3; level++) {
+            const vector<Card>& deck = state.getDeck(level);
+            deck_sizes[level - 1] = deck.size();
+            tops[level - 1] = deck.empty() ? 0 : deck.back().id;
+        }
+        Move move = decodeRecordedMove(record.moves[ply].code, state.current_player);
+        result = replayMove(record, (int)ply, tables.cards, state, null_os);
+        if (!result.valid) {
+            cerr << "ERROR: " << result.error_message << endl;
+            return;
+        }
+        os << moveToString(move) << '\n';
+        // Seeded records draw the top card; explicit deals name the card they drew
+        for (int level = 1; level <= 3; level++) {
+            if (state.getDeck(level).size() < deck_sizes[level - 1]) {
+                int drawn = record.moves[ply].drawn_card ? record.moves[ply].drawn_card : tops[level - 1];
+                os << "REVEAL " << drawn << '\n';
+            }
+        }
+    }
+}
+
+static const char* reasonText(const GameRecord& record) {
+    switch (record.reason) {
+        case END_NORMAL: return "game over";
+        case END_TIMEOUT: return "timed out";
+        case END_INVALID_MOVE: return "made invalid move";
+        default: return "unfinished";
+    }
+}
+
+// The JSON-lines log the referee would have written, minus rejected moves
+static void writeLog(const GameRecord& record, const DeckTables& tables, std::ostream& os) {
+    JsonBuffer out;
+    int last_mover = 0;
+    std::ostream null_os(nullptr);
+    GameState state;
+    ValidationResult result = replayGameRecord(record, tables.cards, tables.nobles, state,
+        [&](const GameState& s, int ply) {
+            if (ply == 0) {
+                writeLogStartRecord(s, record.seed.mode, false, out);
+            } else {
+                const RecordedMove& move = record.moves[ply - 1];
+                writeLogMoveRecord(ply, last_mover + 1, moveToString(decodeRecordedMove(move.code, last_mover)),
+                                   move.think_us, s.players[last_mover].time_bank, "", out);
+            }
+            os << out.text << '\n';
+            last_mover = s.current_player;
+            return true;
+        }, null_os);
+    if (!result.valid) {
+        cerr << "ERROR: " << result.error_message << endl;
+        return;
+    }
+    string reason = reasonText(record);
+    if (record.reason == END_TIMEOUT || record.reason == END_INVALID_MOVE) {
+        reason = "Player " + to_string(3 - record.winner) + " " + reason;
+    }
+    int winner = record.winner == RECORD_NO_RESULT ? -1 : record.winner;
+    writeLogEndRecord(state, winner, reason, record.explicit_deal ? 0 : record.seed.value, out);
+    os << out.text << '\n';
+}
+
+static void printInfo(const vector<GameRecord>& records, size_t bytes, const DeckTables& tables) {
+    long moves = 0;
+    for (const GameRecord& record : records) moves += record.moves.size();
+    cout << records.size() << " games, " << moves << " moves, " << bytes << " bytes";
+    if (!records.empty()) {
+        cout << std::fixed << std::setprecision(1) << " (" << (double)bytes / records.size() << " B/game, "
+             << std::setprecision(2) << (double)bytes / std::max(1L, moves) << " B/move)";
+    }
+    cout << endl;
+
+    // Rebuild every intermediate state, as a training loader would
+    std::ostream null_os(nullptr);
+    GameState state;
+    long states = 0, failed = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (const GameRecord& record : records) {
+        ValidationResult result = replayGameRecord(record, tables.cards, tables.nobles, state,
+            [&](const GameState&, int) { states++; return true; }, null_os);
+        if (!result.valid) failed++;
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    cout << "Replayed " << states << " states in " << std::setprecision(3) << elapsed.count() << "s ("
+         << std::setprecision(0) << states / std::max(elapsed.count(), 1e-9) << " states/s)";
+    if (failed) cout << ", " << failed << " records failed";
+    cout << endl;
+}
+
+// Materialize random positions, as a training loader sampling an archive would
+static void sampleArchive(const GameArchive& archive, long count) {
+    std::mt19937_64 rng(entropySeed());
+    GameState state;
+    GameRecord record;
+    long sampled = 0, failed = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (long i = 0; i < count && archive.numGames() > 0; i++) {
+        uint64_t game_id = rng() % archive.numGames();
+        if (!archive.readRecord(game_id, record).valid) {
+            failed++;
+            continue;
+        }
+        int ply = rng() % (record.moves.size() + 1);
+        if (archive.materialize(game_id, ply, state).valid) {
+            sampled++;
+        } else {
+            failed++;
+        }
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    cout << "Sampled " << sampled << " positions in " << std::fixed << std::setprecision(3) << elapsed.count()
+         << "s (" << std::setprecision(0) << sampled / std::max(elapsed.count(), 1e-9) << " positions/s)";
+    if (failed) cout << ", " << failed << " failed";
+    cout << endl;
+}
+
+static void printUsage() {
+    cerr << "Usage: ./record_tool [--cards PATH --nobles PATH] [--checkpoints N] COMMAND ...\n"
+         << "  from-log OUT LOG...         Append a record per referee log (JSON lines or old text game.log)\n"
+         << "  from-replay OUT STREAM...   Append a record per SETUP/REVEAL replay stream\n"
+         << "  to-log IN [INDEX]           Print record INDEX (default 0) as a JSON-lines referee log\n"
+         << "  to-replay IN [INDEX]        Print record INDEX (default 0) as a SETUP/REVEAL replay stream\n"
+         << "  info IN...                  Count records and time a full replay\n"
+         << "  pack OUT IN...              Write the records of every IN to a new archive, with a checkpoint\n"
+         << "                              every N plies (--checkpoints, default " << DEFAULT_CHECKPOINT_INTERVAL
+         << ", 0 = none)\n"
+         << "  position ARCHIVE GAME PLY   Print the god-view JSON state after PLY moves of GAME\n"
+         << "  find-seed ARCHIVE SEED      List the games dealt from SEED\n"
+         << "  sample ARCHIVE COUNT        Time COUNT random position lookups\n"
+         << "Records are replayed against the built-in cards and nobles unless --cards/--nobles are given." << endl;
+}
+
+int main(int argc, char* argv[]) {
+    DeckTables tables;
+    tables.cards = builtinCards();
+    tables.nobles = builtinNobles();
+    uint32_t checkpoint_interval = DEFAULT_CHECKPOINT_INTERVAL;
+    int arg = 1;
+    while (arg + 1 < argc && string(argv[arg]).compare(0, 2, "--") == 0) {
+        string option = argv[arg];
+        if (option == "--cards") {
+            tables.cards = loadCards(argv[arg + 1]);
+        } else if (option == "--nobles") {
+            tables.nobles = loadNobles(argv[arg + 1]);
+        } else if (option == "--checkpoints") {
+            checkpoint_interval = strtoul(argv[arg + 1], nullptr, 10);
+        } else {
+            cerr << "ERROR: Unknown option " << option << endl;
+            printUsage();
+            return 1;
+        }
+        arg += 2;
+    }
+    if (tables.cards.empty() || tables.nobles.empty()) {
+        cerr << "ERROR: Failed to load game data" << endl;
+        return 1;
+    }
+    tables.hash = cardSetHash(tables.cards, tables.nobles);
+    if (argc - arg < 2) {
+        printUsage();
+        return 1;
+    }
+    string command = argv[arg];
+    string path = argv[arg + 1];
+
+    if (command == "from-log" || command == "from-replay") {
+        string data;
+        int converted = 0, failed = 0;
+        for (int i = arg + 2; i < argc; i++) {
+            GameRecord record;
+            ValidationResult result = (command == "from-log") ? convertLog(argv[i], tables, record)
+                                                              : convertReplayStream(argv[i], tables, record);
+            if (!result.valid) {
+                cerr << "ERROR: " << result.error_message << endl;
+                failed++;
+                continue;
+            }
+            encodeGameRecord(record, data);
+            converted++;
+        }
+        std::ofstream out(path.c_str(), std::ios::binary | std::ios::app);
+        if (!out.write(data.data(), data.size())) {
+            cerr << "ERROR: Cannot write " << path << endl;
+            return 1;
+        }
+        cerr << "Appended " << converted << " records (" << data.size() << " bytes) to " << path;
+        if (failed) cerr << ", " << failed << " failed";
+        cerr << endl;
+        return failed ? 1 : 0;
+    }
+
+    if (command == "to-log" || command == "to-replay") {
+        vector<GameRecord> records;
+        ValidationResult result = loadGameRecords(path, records);
+        if (!result.valid) {
+            cerr << "ERROR: " << result.error_message << endl;
+            return 1;
+        }
+        size_t index = (argc - arg > 2) ? strtoul(argv[arg + 2], nullptr, 10) : 0;
+        if (index >= records.size()) {
+            cerr << "ERROR: " << path << " has " << records.size() << " records" << endl;
+            return 1;
+        }
+        if (command == "to-log") {
+            writeLog(records[index], tables, cout);
+        } else {
+            writeReplayStream(records[index], tables, cout);
+        }
+        return 0;
+    }
+
+    if (command == "info") {
+        vector<GameRecord> records;
+        size_t bytes = 0;
+        for (int i = arg + 1; i < argc; i++) {
+            ValidationResult result = loadGameRecords(argv[i], records);
+            if (!result.valid) {
+                cerr << "ERROR: " << result.error_message << endl;
+                return 1;
+            }
+            std::ifstream file(argv[i], std::ios::binary | std::ios::ate);
+            bytes += (size_t)file.tellg();
+        }
+        printInfo(records, bytes, tables);
+        return 0;
+    }
+
+    if (command == "pack") {
+        GameArchiveWriter writer;
+        ValidationResult result = writer.open(path, tables.cards, tables.nobles, checkpoint_interval);
+        long packed = 0, failed = 0;
+        for (int i = arg + 2; i < argc && result.valid; i++) {
+            vector<GameRecord> records;
+            result = loadGameRecords(argv[i], records);
+            for (size_t r = 0; r < records.size() && result.valid; r++) {
+                ValidationResult added = writer.add(records[r]);
+                if (added.valid) {
+                    packed++;
+                } else {
+                    cerr << "ERROR: " << argv[i] << ": " << added.error_message << endl;
+                    failed++;
+                }
+            }
+        }
+        if (result.valid) result = writer.close();
+        if (!result.valid) {
+            cerr << "ERROR: " << result.error_message << endl;
+            return 1;
+        }
+        cerr << "Packed " << packed << " games (" << writer.offset << " bytes of games and checkpoints) into " << path;
+        if (failed) cerr << ", " << failed << " failed";
+        cerr << endl;
+        return failed ? 1 : 0;
+    }
+
+    if (command == "position" || command == "find-seed" || command == "sample") {
+        GameArchive archive;
+        ValidationResult result = archive.open(path, tables.cards, tables.nobles);
+        if (!result.valid || argc - arg < 3 || (command == "position" && argc - arg < 4)) {
+            if (!result.valid) cerr << "ERROR: " << result.error_message << endl;
+            else printUsage();
+            return 1;
+        }
+        if (command == "position") {
+            GameState state;
+            result = archive.materialize(strtoull(argv[arg + 2], nullptr, 10), atoi(argv[arg + 3]), state);
+            if (!result.valid) {
+                cerr << "ERROR: " << result.error_message << endl;
+                return 1;
+            }
+            cout << gameStateToJson(state, 0) << endl;
+        } else if (command == "find-seed") {
+            for (uint64_t game_id : archive.findBySeed(strtoull(argv[arg + 2], nullptr, 0))) {
+                cout << game_id << endl;
+            }
+        } else {
+            sampleArchive(archive, atol(argv[arg + 2]));
+        }
+        return 0;
+    }
+
+    printUsage();
+    return 1;
+}
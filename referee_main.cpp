@@ -2,8 +2,16 @@
 // This executable runs the normal referee mode with random seed
 
 #include <chrono>
+#include <ctime>
 #include <iomanip>
+#include <signal.h>
+#include <unistd.h>
 #include "game_logic.h"
+#include "binary_protocol.h"
+#include "game_log.h"
+#include "game_record.h"
+#include "move_timing.h"
+#include "subprocess.h"
 
 using std::string;
 using std::vector;
@@ -11,7 +19,6 @@ using std::map;
 using std::cout;
 using std::cerr;
 using std::endl;
-using std::cin;
 using std::getline;
 using std::to_string;
 using std::pair;
@@ -37,19 +44,66 @@ using std::atoi;
 
 
 int main(int argc, char* argv[]) {
+    // cout is written only at the explicit flushes; input never goes through cin
+    // (see stdin_reader)
+    std::ios::sync_with_stdio(false);
+
     GameState game;
     game.replay_mode = false;
     
-    // Buffer for logging to prevent engines from reading game info during the match
-    stringstream log_ss;
+    // Leading options: "--binary" offers the binary protocol to the engines (see
+    // binary_protocol.h), "--delta" sends JSON deltas after the first full state,
+    // "--splitmix" deals with the 64-bit SplitMix64 generator instead of mt19937,
+    // "--log PATH" names the game log, "--record PATH" appends a binary game record,
+    // "--engine CMD" (twice: Player 1, then Player 2) runs the engines as children
+    bool binary = false;
+    bool delta_mode = false;
+    SeedMode seed_mode = SEED_LEGACY_MT19937;
+    string log_path;
+    string record_path;
+    vector<string> engine_cmds;
+    int arg_base = 1;
+    while (arg_base < argc && string(argv[arg_base]).compare(0, 2, "--") == 0) {
+        string option = argv[arg_base++];
+        if (option == "--binary") {
+            binary = true;
+        } else if (option == "--delta") {
+            delta_mode = true;
+        } else if (option == "--splitmix") {
+            seed_mode = SEED_SPLITMIX64;
+        } else if (option == "--log" && arg_base < argc) {
+            log_path = argv[arg_base++];
+        } else if (option == "--record" && arg_base < argc) {
+            record_path = argv[arg_base++];
+        } else if (option == "--engine" && arg_base < argc) {
+            engine_cmds.push_back(argv[arg_base++]);
+        } else {
+            cerr << "ERROR: Unknown option " << option << endl;
+            return 1;
+        }
+    }
+    if (!engine_cmds.empty() && engine_cmds.size() != 2) {
+        cerr << "ERROR: --engine must be given once per player" << endl;
+        return 1;
+    }
 
-    // Paths can be customized via environment variables or CLI in the future
-    const string cards_path = "cards.json";
-    const string nobles_path = "nobles.json";
-    
-    // Load all cards and nobles to check if they exist
-    vector<Card> all_cards = loadCards(cards_path);
-    vector<Noble> all_nobles = loadNobles(nobles_path);
+    // Normal mode with optional seed (mt19937 seeds are 32-bit). Without one, a fresh
+    // seed is drawn so referees started in the same second still differ.
+    uint64_t seed = 0;
+    if (argc > arg_base) {
+        seed = strtoull(argv[arg_base], nullptr, 10);
+    }
+    if (seed_mode == SEED_LEGACY_MT19937) {
+        seed = static_cast<unsigned int>(seed);
+    }
+    while (seed == 0) {
+        seed = (seed_mode == SEED_LEGACY_MT19937) ? static_cast<unsigned int>(entropySeed()) : entropySeed();
+    }
+
+    // Custom decks come from the optional cards/nobles paths after the seed; otherwise
+    // the built-in tables are used and no data file is read
+    vector<Card> all_cards = (argc > arg_base + 1) ? loadCards(argv[arg_base + 1]) : builtinCards();
+    vector<Noble> all_nobles = (argc > arg_base + 2) ? loadNobles(argv[arg_base + 2]) : builtinNobles();
     
     if (all_cards.empty() || all_nobles.empty()) {
         cerr << "ERROR: Failed to load game data" << endl;
@@ -57,21 +111,8 @@ int main(int argc, char* argv[]) {
     }
     
     cerr << "Loaded " << all_cards.size() << " cards and " << all_nobles.size() << " nobles" << endl;
-    
-    // Normal mode with optional seed
-    unsigned int seed = 0;
-    if (argc > 1) {
-        seed = static_cast<unsigned int>(atoi(argv[1]));
-    }
-    
-    if (seed == 0) {
-        seed = static_cast<unsigned int>(time(nullptr));
-    }
 
-    initializeGame(game, seed, cards_path, nobles_path);
-    
-    // Log the seed at the top
-    log_ss << "Seed: " << seed << endl;
+    initializeGame(game, GameSeed{seed, seed_mode}, all_cards, all_nobles);
     
     // Validate initial game state
     ValidationResult validation = validateGameState(game);
@@ -80,13 +121,211 @@ int main(int argc, char* argv[]) {
         return 1;
     }
     cerr << "Game state validated successfully" << endl;
-    
-    // Log initial state
-    log_ss << "Initial State: " << gameStateToJson(game, 0) << endl;
+
+    // With --engine the referee talks to each engine over its own pipes, waits on them
+    // with poll and real deadlines, and kills an engine that overruns its clock. Engine
+    // stderr is forwarded to ours as "[P1] ..." lines. Otherwise both players' states
+    // go to stdout and moves come from stdin.
+    bool spawned = !engine_cmds.empty();
+    Subprocess engines[2];
+    // Without --engine, fd 0 is read through the same buffered reader as the engines'
+    // pipes, so a partial line or frame still gives up at the mover's deadline
+    Subprocess stdin_reader;
+    stdin_reader.stdout_fd = STDIN_FILENO;
+    struct EngineGuard {
+        Subprocess* engines;
+        ~EngineGuard() { for (int p = 0; p < 2; p++) terminateProcess(engines[p]); }
+    } engine_guard = {engines};
+    if (spawned) {
+        signal(SIGPIPE, SIG_IGN);
+        for (int p = 0; p < 2; p++) {
+            engines[p].stderr_label = "[P" + to_string(p + 1) + "] ";
+            engines[p].stderr_peer = &engines[1 - p];
+            ValidationResult started = spawnProcess(splitCommand(engine_cmds[p]), engines[p], STDERR_CAPTURE);
+            if (!started.valid) {
+                cerr << "ERROR: Failed to start Player " << (p + 1) << " - " << started.error_message << endl;
+                return 1;
+            }
+        }
+    }
+
+    // The engines answer the handshake with the same line to switch to binary frames,
+    // or with the JSON line to keep the default protocol. Spawned engines each choose.
+    bool binary_io[2] = {binary, binary};
+    if (binary && spawned) {
+        for (int p = 0; p < 2; p++) {
+            string reply;
+            writeLine(engines[p], BINARY_HANDSHAKE, INITIAL_TIME_BANK);
+            if (readLine(engines[p], reply, INITIAL_TIME_BANK) != READ_OK ||
+                (reply != BINARY_HANDSHAKE && reply != JSON_HANDSHAKE)) {
+                cerr << "ERROR: Player " << (p + 1) << " failed the protocol handshake" << endl;
+                return 1;
+            }
+            binary_io[p] = (reply == BINARY_HANDSHAKE);
+            cerr << "Player " << (p + 1) << " protocol: " << (binary_io[p] ? "binary" : "JSON") << endl;
+        }
+    } else if (binary) {
+        cout << BINARY_HANDSHAKE << endl;
+        string reply;
+        if (readLine(stdin_reader, reply, INITIAL_TIME_BANK) != READ_OK) {
+            cerr << "ERROR: Failed to read protocol handshake from STDIN" << endl;
+            return 1;
+        }
+        if (reply == JSON_HANDSHAKE) {
+            binary_io[0] = binary_io[1] = false;
+        } else if (reply != BINARY_HANDSHAKE) {
+            cerr << "ERROR: Unknown protocol handshake \"" << reply << "\"" << endl;
+            return 1;
+        }
+        cerr << "Protocol: " << (binary_io[0] ? "binary" : "JSON") << endl;
+    }
+
+    // Player 1 and Player 2 views, serialized in one pass into buffers reused for the
+    // whole game. Binary mode never needs them, delta mode only for the first state.
+    const int viewer_ids[2] = {1, 2};
+    int num_views = (binary_io[0] && binary_io[1]) ? 0 : 2;
+    JsonBuffer views[2];
+
+    // Timestamps splitting each move's wall time (see move_timing.h)
+    MoveTiming timing;
+    TimingStats timing_stats;
+    int64_t serialize_start = 0;    // Start of building the next state
+    int64_t flushed_at = 0;         // State flushed: the mover's clock starts
+    int64_t received_at = 0;        // Complete move read
+
+    WireState wire;
+    string frames;
+    GameState previous;             // Last state sent, for delta mode
+    bool snapshot_sent = false;
+    StateDelta delta;
+    string payloads[2];
+    int stalled_engine = -1;        // Spawned engine that did not take its state in time
+    auto sendStates = [&]() {
+        for (int v = 0; v < 2; v++) {
+            payloads[v].clear();
+            if (!binary_io[v]) {
+                if (delta_mode && snapshot_sent) {
+                    computeStateDelta(previous, game, viewer_ids[v], delta);
+                    views[v].clear();
+                    writeStateDeltaJson(delta, viewer_ids[v], views[v]);
+                }
+                payloads[v].append(views[v].text);
+                payloads[v].push_back('\n');
+                continue;
+            }
+            ValidationResult packed = packWireState(game, viewer_ids[v], wire);
+            if (!packed.valid) {
+                cerr << "ERROR: Cannot encode state - " << packed.error_message << endl;
+                return false;
+            }
+            appendFrame(payloads[v], FRAME_STATE, (uint8_t)viewer_ids[v], &wire, sizeof(wire));
+        }
+        int64_t write_start = monotonicNs();
+        if (spawned) {
+            // An engine that stops reading its input gets its own clock to drain the pipe
+            for (int v = 0; v < 2; v++) {
+                if (!writeBytes(engines[v], payloads[v].data(), payloads[v].size(),
+                                std::max(0.0, game.players[v].time_bank))) {
+                    stalled_engine = v;
+                    return false;
+                }
+            }
+        } else {
+            cout << payloads[0] << payloads[1];
+            cout.flush();
+        }
+        flushed_at = monotonicNs();
+        timing.serialize_ns = write_start - serialize_start;
+        timing.write_ns = flushed_at - write_start;
+        if (delta_mode) {
+            previous = game;
+            snapshot_sent = true;
+            num_views = 0;
+        }
+        return true;
+    };
+    // The WINNER/REASON/RESULT/SEED lines, as text or as one RESULT frame. Spawned engines
+    // get them in their own protocol, and the text also goes to stdout.
+    auto sendResult = [&](const string& text) {
+        if (spawned) {
+            for (int p = 0; p < 2; p++) {
+                if (binary_io[p]) {
+                    string frame;
+                    appendFrame(frame, FRAME_RESULT, 0, text.data(), (uint32_t)text.size());
+                    writeBytes(engines[p], frame.data(), frame.size(), 1.0);
+                } else {
+                    writeBytes(engines[p], text.data(), text.size(), 1.0);
+                }
+            }
+            cout << text << std::flush;
+        } else if (binary_io[0]) {
+            writeFrame(cout, FRAME_RESULT, 0, text.data(), (uint32_t)text.size());
+            cout.flush();
+        } else {
+            cout << text << std::flush;
+        }
+    };
+
+    // The log is streamed to a per-game file while the game runs. The default name
+    // carries the start time and pid, not the seed, so concurrent referees don't
+    // clobber each other and engines can't learn the seed from the directory.
+    if (log_path.empty()) {
+        char stamp[32];
+        time_t now = time(nullptr);
+        strftime(stamp, sizeof(stamp), "%Y%m%d-%H%M%S", localtime(&now));
+        log_path = string("game_") + stamp + "_" + to_string(getpid()) + ".log";
+    }
+    GameLog game_log;
+    ValidationResult log_opened = game_log.open(log_path);
+    if (!log_opened.valid) {
+        cerr << "WARNING: " << log_opened.error_message << ", playing without a log" << endl;
+    } else {
+        cerr << "Logging to " << log_path << endl;
+    }
+    JsonBuffer log_line;
+    writeLogStartRecord(game, seed_mode, binary_io[0] && binary_io[1], log_line);
+    game_log.append(log_line.text);
+    int ply = 0;
+
+    GameRecord game_record;
+    game_record.seed = GameSeed{seed, seed_mode};
+    game_record.card_set_hash = cardSetHash(all_cards, all_nobles);
+    // Appended in one write, so referees can share a record file
+    auto saveRecord = [&](int winner, RecordEndReason reason) {
+        if (record_path.empty()) return;
+        game_record.winner = winner;
+        game_record.reason = reason;
+        string data;
+        encodeGameRecord(game_record, data);
+        std::ofstream record_file(record_path.c_str(), std::ios::binary | std::ios::app);
+        if (!record_file.write(data.data(), data.size())) cerr << "WARNING: Failed to write " << record_path << endl;
+    };
+
+    // The opponent of player_idx wins; `why` follows "Player N" in the reason
+    auto forfeit = [&](int player_idx, const string& why, const string& detail, RecordEndReason reason) {
+        timing_stats.report(cerr);
+        string loser = "Player " + to_string(player_idx + 1);
+        writeLogEndRecord(game, 2 - player_idx, loser + " " + why, seed, log_line);
+        game_log.append(log_line.text);
+        saveRecord(2 - player_idx, reason);
+        sendResult("WINNER: Player " + to_string(2 - player_idx) + "\n" +
+                   "REASON: " + loser + " " + why + " (" + detail + ")\n");
+        return 0;
+    };
+
+    // Referee-side time of the move just read, up to the next state
+    auto recordTiming = [&](int player_idx) {
+        timing.process_ns = monotonicNs() - received_at;
+        timing_stats.add(player_idx, timing);
+    };
 
     // Output initial game states to both players
-    printJsonGameState(game, 1);
-    printJsonGameState(game, 2);
+    serialize_start = monotonicNs();
+    writeGameStateJson(game, viewer_ids, views, num_views);
+    if (!sendStates()) {
+        if (stalled_engine < 0) return 1;
+        return forfeit(stalled_engine, "stopped reading its input", "state not taken in time", END_TIMEOUT);
+    }
     
     cerr << "\n=== Starting Game Loop ===" << endl;
     
@@ -95,58 +334,87 @@ int main(int argc, char* argv[]) {
         cerr << "\nWaiting for Player " << (current + 1) << " move (Bank: " 
              << std::fixed << std::setprecision(3) << game.players[current].time_bank << "s)..." << endl;
         
-        // Start timer
-        auto start_time = std::chrono::steady_clock::now();
-        
-        // Read move from STDIN
+        // The clock runs from the state flush until the complete reply has arrived, so
+        // an engine cannot stop it by sending one byte early. No reply by the end of
+        // the mover's bank loses on time, without waiting any longer.
+        int64_t deadline_ns = flushed_at + (int64_t)(std::max(0.0, game.players[current].time_bank) * 1e9);
+        int64_t input_at = 0;           // First byte of the reply
+        int64_t complete_at = 0;        // Read that delivered its newline or last frame byte
+        bool timed_out = false, read_ok = false;
         string move_string;
-        if (!getline(cin, move_string)) {
+        uint8_t frame_type = 0, frame_id = 0;
+        Subprocess& source = spawned ? engines[current] : stdin_reader;
+        double remaining = std::max<int64_t>(0, deadline_ns - monotonicNs()) / 1e9;
+        ReadStatus status = binary_io[current] ? readFrame(source, frame_type, frame_id, move_string, remaining)
+                                               : readLine(source, move_string, remaining);
+        timed_out = (status == READ_TIMEOUT);
+        read_ok = (status == READ_OK);
+        // Bytes buffered before the flush were sent early and cost no time. The last
+        // read is never earlier than the one that completed the reply.
+        input_at = std::max(flushed_at, (int64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+            source.read_buffer_since.time_since_epoch()).count());
+        complete_at = std::max(input_at, (int64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+            source.read_buffer_filled.time_since_epoch()).count());
+        received_at = monotonicNs();
+        if (timed_out) input_at = complete_at = received_at;
+        if (!read_ok && !timed_out) {
+            if (spawned) {
+                cerr << "ERROR: Player " << (current + 1) << " disconnected" << endl;
+                ply++;
+                recordTiming(current);
+                return forfeit(current, "disconnected", "no move received", END_UNFINISHED);
+            }
             cerr << "ERROR: Failed to read move from STDIN" << endl;
             break;
         }
-        
-        // Stop timer and update bank
-        auto end_time = std::chrono::steady_clock::now();
-        std::chrono::duration<double> elapsed = end_time - start_time;
-        
-        game.players[current].time_bank -= elapsed.count();
-        
+        timing.think_ns = complete_at - flushed_at;
+        timing.read_ns = complete_at - input_at;
+
+        game.players[current].time_bank -= timing.think_ns / 1e9;
+        long think_us = (long)(timing.think_ns / 1000);
+        ply++;
+
         // Check for timeout
-        if (game.players[current].time_bank < 0) {
+        if (timed_out || game.players[current].time_bank < 0) {
             cerr << "ERROR: Player " << (current + 1) << " timed out!" << endl;
-            log_ss << "ERROR: Player " << (current + 1) << " timed out!" << endl;
-            log_ss << "Game Result: Player " << (2 - current) << " wins! (Opponent timeout)" << endl;
-            
-            cout << "WINNER: Player " << (2 - current) << endl;
-            cout << "REASON: Player " << (current + 1) << " timed out (" 
-                 << std::fixed << std::setprecision(3) << game.players[current].time_bank << "s)" << endl;
-            
-            // Write log and exit
-            ofstream log_file("game.log");
-            if (log_file.is_open()) {
-                log_file << log_ss.str();
-                log_file.close();
-            }
-            return 0;
+            if (spawned) terminateProcess(engines[current], 0);
+            writeLogMoveRecord(ply, current + 1, move_string, think_us, game.players[current].time_bank,
+                               "timed out", log_line, &timing);
+            game_log.append(log_line.text);
+            recordTiming(current);
+            ostringstream bank;
+            bank << std::fixed << std::setprecision(3) << game.players[current].time_bank << "s";
+            return forfeit(current, "timed out", bank.str(), END_TIMEOUT);
         }
         
         // Add move increment
         game.players[current].time_bank += TIME_INCREMENT;
-        
+
+        // Decode a binary move up front so it can be logged like a text move
+        std::pair<Move, ValidationResult> parse_result;
+        if (binary_io[current]) {
+            parse_result = parseMoveFrame(frame_type, move_string, current);
+            move_string = parse_result.second.valid ? moveToString(parse_result.first) : "(invalid move frame)";
+        }
+
         cerr << "Received move: \"" << move_string << "\" (Took " 
-             << std::fixed << std::setprecision(3) << elapsed.count() << "s)" << endl;
-        
-        // Log the move
-        log_ss << "Player " << (current + 1) << ": " << move_string << endl;
+             << std::fixed << std::setprecision(3) << timing.think_ns / 1e9 << "s)" << endl;
 
         // REVEAL commands not allowed in normal mode
-        if (move_string.find("REVEAL") == 0) {
+        if (binary_io[current] ? parse_result.first.type == REVEAL_CARD : move_string.find("REVEAL") == 0) {
             cerr << "ERROR: REVEAL command only valid in replay mode" << endl;
+            writeLogMoveRecord(ply, current + 1, move_string, think_us, game.players[current].time_bank,
+                               "REVEAL command only valid in replay mode", log_line, &timing);
+            game_log.append(log_line.text);
+            recordTiming(current);
+            // No new state is sent; the clock restarts once the rejection is handled
+            timing = MoveTiming();
+            flushed_at = monotonicNs();
             continue;
         }
         
         // Parse the move
-        auto parse_result = parseMove(move_string, current);
+        if (!binary_io[current]) parse_result = parseMove(move_string, current);
         Move move = parse_result.first;
         ValidationResult move_valid = parse_result.second;
         
@@ -161,20 +429,11 @@ int main(int argc, char* argv[]) {
             cerr << "ERROR: Invalid move - " << move_valid.error_message << endl;
             cerr << "Player " << (current + 1) << " loses by invalid move" << endl;
             
-            log_ss << "ERROR: Invalid move from Player " << (current + 1) << ": " << move_valid.error_message << endl;
-            log_ss << "Game Result: Player " << (2 - current) << " wins! (Opponent invalid move)" << endl;
-
-            // Output result: opponent wins
-            cout << "WINNER: Player " << (2 - current) << endl;
-            cout << "REASON: Player " << (current + 1) << " made invalid move (" << move_valid.error_message << ")" << endl;
-            
-            // Write log and exit
-            ofstream log_file("game.log");
-            if (log_file.is_open()) {
-                log_file << log_ss.str();
-                log_file.close();
-            }
-            return 0;
+            writeLogMoveRecord(ply, current + 1, move_string, think_us, game.players[current].time_bank,
+                               move_valid.error_message, log_line, &timing);
+            game_log.append(log_line.text);
+            recordTiming(current);
+            return forfeit(current, "made invalid move", move_valid.error_message, END_INVALID_MOVE);
         }
         
         // Apply the move
@@ -185,25 +444,38 @@ int main(int argc, char* argv[]) {
         }
         cerr << "Move applied successfully" << endl;
 
-        // Log the state after the move to capture any revealed cards
-        log_ss << "Post-Move State: " << gameStateToJson(game, 0) << endl;
-        
+        // The hash identifies the position after the move; revealed cards stay out of
+        // the log until the end record
+        writeLogMoveRecord(ply, current + 1, move_string, think_us, game.players[current].time_bank, "",
+                           log_line, &timing);
+        game_log.append(log_line.text);
+        game_record.moves.push_back(RecordedMove{encodeRecordedMove(move), (uint32_t)think_us, 0});
+
         // Validate game state after move
         ValidationResult validation_after = validateGameState(game);
         if (!validation_after.valid) {
             cerr << "ERROR: Game state became invalid - " << validation_after.error_message << endl;
             return 1;
         }
-        
+        recordTiming(current);
+
         // Output updated game states to both players if game is not over
         if (!isGameOver(game)) {
-            printJsonGameState(game, 1);
-            printJsonGameState(game, 2);
+            serialize_start = monotonicNs();
+            if (num_views > 0) {
+                for (JsonBuffer& view : views) view.clear();
+                writeGameStateJson(game, viewer_ids, views, num_views);
+            }
+            if (!sendStates()) {
+                if (stalled_engine < 0) return 1;
+                return forfeit(stalled_engine, "stopped reading its input", "state not taken in time", END_TIMEOUT);
+            }
         }
     }
     
     // Game ended - determine winner
     cerr << "\n=== Game Over ===" << endl;
+    timing_stats.report(cerr);
     int winner = determineWinner(game);
     
     cerr << "Final Scores:" << endl;
@@ -213,32 +485,23 @@ int main(int argc, char* argv[]) {
          << game.players[1].cards.size() << " cards" << endl;
     
     // Output winner
+    ostringstream result_ss;
     if (winner == -1) {
-        cout << "RESULT: TIE" << endl;
+        result_ss << "RESULT: TIE" << endl;
         cerr << "Game ended in a tie" << endl;
-        log_ss << "RESULT: TIE" << endl;
     } else {
-        cout << "WINNER: Player " << (winner + 1) << endl;
+        result_ss << "WINNER: Player " << (winner + 1) << endl;
         cerr << "Player " << (winner + 1) << " wins!" << endl;
-        log_ss << "WINNER: Player " << (winner + 1) << endl;
     }
 
     // Reveal the seed to engines at the end of the game
-    cout << "SEED: " << seed << endl;
+    result_ss << "SEED: " << seed << endl;
+    sendResult(result_ss.str());
 
-    log_ss << "Final Scores - P1: " << game.players[0].points << ", P2: " << game.players[1].points << endl;
-    if (winner == -1) {
-        log_ss << "Game Result: TIE" << endl;
-    } else {
-        log_ss << "Game Result: Player " << (winner + 1) << " wins!" << endl;
-    }
-    
-    // Write the buffered log to game.log after the game is over
-    ofstream log_file("game.log");
-    if (log_file.is_open()) {
-        log_file << log_ss.str();
-        log_file.close();
-    }
+    writeLogEndRecord(game, winner + 1, isGameOver(game) ? "game over" : "move read failed", seed, log_line);
+    game_log.append(log_line.text);
+    saveRecord(winner + 1, isGameOver(game) ? END_NORMAL : END_UNFINISHED);
+    if (!game_log.close()) cerr << "WARNING: Failed to write " << log_path << endl;
     
     return 0;
 }
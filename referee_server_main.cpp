@@ -0,0 +1,697 @@
+// Referee Server
+// Hosts many concurrent matches in one process. Engines connect over a Unix
+// domain socket, introduce themselves with a HELLO line and then play game
+// after game on the same connection, so an engine process is started once per
+// run instead of once per game. One epoll loop referees every match: nothing
+// blocks on a slow engine, and each match has its own time banks (deadlines in
+// one ordered set), log and game record. Linux only (epoll, accept4).
+//
+// Protocol, one line per message:
+//   engine -> server   HELLO NAME [SLOTS]   First line; SLOTS = concurrent matches (default 1)
+//   server -> engine   {JSON state}         Same views and result lines as ./referee
+//   engine -> server   MOVE                 Same move text as ./referee
+// With SLOTS > 1 every server line is prefixed with "@MATCH_ID " and moves must
+// carry the same prefix. Single-slot engines may omit it and see exactly the
+// referee's JSON-lines stream, one game after another.
+
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <deque>
+#include <iomanip>
+#include <set>
+#include <unordered_map>
+#include <signal.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "game_logic.h"
+#include "game_log.h"
+#include "game_record.h"
+#include "move_timing.h"
+
+using std::string;
+using std::vector;
+using std::cout;
+using std::cerr;
+using std::endl;
+using std::to_string;
+
+const int MAX_SLOTS = 4096;
+const size_t MAX_LINE_BYTES = 1 << 16;      // Longer input without a newline drops the engine
+const size_t MAX_OUTPUT_BYTES = 1 << 24;    // An engine that lets this much pile up is not reading
+
+struct ServerConfig {
+    string socket_path;
+    long games = 0;                 // Matches to play before exiting, 0 = until SIGINT/SIGTERM
+    uint64_t first_seed = 1;
+    SeedMode seed_mode = SEED_LEGACY_MT19937;   // --splitmix: 64-bit seeds derived per match
+    double time_bank = INITIAL_TIME_BANK;
+    double increment = TIME_INCREMENT;
+    int max_moves = 1000;           // Adjudicated as a draw beyond this
+    string log_dir;                 // One JSON-lines log per match; empty = no logs
+    string record_path;             // Binary game records, appended as matches end
+};
+
+// An engine connection. Input and output are buffered here; sockets are non-blocking.
+struct Connection {
+    uint64_t id = 0;
+    int fd = -1;
+    string name;                    // From HELLO; empty until then
+    int slots = 0;
+    vector<uint64_t> matches;       // Matches in progress on this connection
+    string input;                   // Received bytes not yet split into lines
+    int64_t input_since = 0;        // Arrival of the first byte of the unfinished line in input
+    string output;                  // Queued bytes the socket has not taken yet
+    bool want_write = false;        // EPOLLOUT registered
+    // (match, ply) whose mover's clock restarts when output drains
+    vector<std::pair<uint64_t, int>> flush_waiters;
+    bool closing = false;           // Queued for closeConnection; gets no new output or matches
+};
+
+struct Match {
+    uint64_t id = 0;
+    GameSeed seed;
+    GameState game;
+    uint64_t conns[2] = {0, 0};     // Connection in each seat
+    int ply = 0;                    // Replies received, rejected REVEALs included
+    MoveTiming timing;
+    int64_t flushed_at = 0;         // State queued to the mover flushed: its clock starts
+    int64_t deadline_ns = 0;        // End of the mover's bank; key in Server::deadlines
+    string log;                     // JSON lines, written to log_dir when the match ends
+    GameRecord record;
+};
+
+struct EngineStats {
+    long wins = 0;
+    long draws = 0;
+    long losses = 0;
+    long forfeits = 0;              // Losses by timeout, invalid move or disconnect
+};
+
+struct Server {
+    ServerConfig config;
+    vector<Card> cards;
+    vector<Noble> nobles;
+    uint64_t card_set_hash = 0;
+    int epoll_fd = -1;
+    int listen_fd = -1;
+    std::unordered_map<uint64_t, Connection> connections;   // By id; epoll data carries the id
+    std::unordered_map<uint64_t, Match> matches;
+    std::set<std::pair<int64_t, uint64_t>> deadlines;       // (deadline_ns, match id)
+    std::deque<uint64_t> waiting;   // One entry per free slot, by connection id; stale ids are skipped
+    vector<uint64_t> to_close;      // Connections to drop once the current event is handled
+    uint64_t next_connection_id = 1;    // 0 is the listening socket
+    long started = 0;
+    long finished = 0;
+    long total_moves = 0;
+    std::map<string, EngineStats> stats;
+    std::ofstream record_file;
+    JsonBuffer views[2];
+    JsonBuffer log_line;
+};
+
+static volatile sig_atomic_t stop_requested = 0;
+
+static void requestStop(int) {
+    stop_requested = 1;
+}
+
+static ValidationResult listenUnix(const string& path, int& fd) {
+    struct sockaddr_un addr;
+    if (path.size() >= sizeof(addr.sun_path)) return ValidationResult(false, "Socket path too long: " + path);
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+    fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) return ValidationResult(false, string("socket: ") + strerror(errno));
+    unlink(path.c_str());           // A stale socket from an earlier run
+    if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0 || listen(fd, SOMAXCONN) < 0) {
+        string error = "Cannot listen on " + path + ": " + strerror(errno);
+        close(fd);
+        fd = -1;
+        return ValidationResult(false, error);
+    }
+    return ValidationResult(true);
+}
+
+static void markClosing(Server& server, Connection& conn) {
+    if (conn.closing) return;
+    conn.closing = true;
+    server.to_close.push_back(conn.id);
+}
+
+static void updateEvents(Server& server, Connection& conn) {
+    bool want_write = !conn.output.empty();
+    if (want_write == conn.want_write) return;
+    struct epoll_event event;
+    event.events = EPOLLIN | (want_write ? EPOLLOUT : 0);
+    event.data.u64 = conn.id;
+    epoll_ctl(server.epoll_fd, EPOLL_CTL_MOD, conn.fd, &event);
+    conn.want_write = want_write;
+}
+
+// The mover's clock (re)starts at `at` and runs out after its bank
+static void startClock(Server& server, Match& match, int64_t at) {
+    server.deadlines.erase(std::make_pair(match.deadline_ns, match.id));
+    double bank = std::max(0.0, match.game.players[match.game.current_player].time_bank);
+    match.flushed_at = at;
+    match.deadline_ns = at + (int64_t)(bank * 1e9);
+    server.deadlines.insert(std::make_pair(match.deadline_ns, match.id));
+}
+
+// Write as much queued output as the socket takes. When it drains, the clocks of
+// matches waiting on this connection start.
+static void flushOutput(Server& server, Connection& conn) {
+    size_t sent = 0;
+    while (sent < conn.output.size()) {
+        ssize_t n = send(conn.fd, conn.output.data() + sent, conn.output.size() - sent, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+        if (n <= 0) {
+            markClosing(server, conn);
+            return;
+        }
+        sent += (size_t)n;
+    }
+    conn.output.erase(0, sent);
+    if (conn.output.size() > MAX_OUTPUT_BYTES) {
+        cerr << "Engine " << conn.name << " (connection " << conn.id << ") stopped reading its input" << endl;
+        markClosing(server, conn);
+        return;
+    }
+    updateEvents(server, conn);
+    if (!conn.output.empty() || conn.flush_waiters.empty()) return;
+    int64_t now = monotonicNs();
+    for (const std::pair<uint64_t, int>& waiter : conn.flush_waiters) {
+        auto found = server.matches.find(waiter.first);
+        if (found == server.matches.end()) continue;
+        Match& match = found->second;
+        if (match.ply != waiter.second || match.conns[match.game.current_player] != conn.id) continue;
+        match.timing.write_ns += now - match.flushed_at;
+        startClock(server, match, now);
+    }
+    conn.flush_waiters.clear();
+}
+
+// Queue text (whole lines) for one match; multi-slot connections get each line tagged
+static void queueText(Connection& conn, uint64_t match_id, const string& text) {
+    if (conn.closing) return;
+    if (conn.slots <= 1) {
+        conn.output.append(text);
+        return;
+    }
+    string prefix = "@" + to_string(match_id) + " ";
+    size_t start = 0;
+    while (start < text.size()) {
+        size_t end = text.find('\n', start);
+        end = (end == string::npos) ? text.size() : end + 1;
+        conn.output.append(prefix);
+        conn.output.append(text, start, end - start);
+        start = end;
+    }
+}
+
+// Send both views of the current state; the mover's clock starts when its copy is flushed
+static void sendStates(Server& server, Match& match) {
+    const int viewer_ids[2] = {1, 2};
+    int64_t serialize_start = monotonicNs();
+    for (JsonBuffer& view : server.views) view.clear();
+    writeGameStateJson(match.game, viewer_ids, server.views, 2);
+    int64_t write_start = monotonicNs();
+    for (int seat = 0; seat < 2; seat++) {
+        Connection& conn = server.connections[match.conns[seat]];
+        server.views[seat].put('\n');
+        queueText(conn, match.id, server.views[seat].text);
+        flushOutput(server, conn);
+    }
+    int64_t flushed_at = monotonicNs();
+    match.timing = MoveTiming();
+    match.timing.serialize_ns = write_start - serialize_start;
+    match.timing.write_ns = flushed_at - write_start;
+    // Until a backed-up socket drains, the clock runs from now, so an engine that
+    // never reads still loses on time
+    startClock(server, match, flushed_at);
+    Connection& mover = server.connections[match.conns[match.game.current_player]];
+    if (!mover.output.empty()) mover.flush_waiters.push_back(std::make_pair(match.id, match.ply));
+}
+
+static void pairEngines(Server& server);
+
+// End a match: log, record, result lines to both engines, stats, free the slots.
+// winner is a seat, -1 for a tie; reason goes in the log's end record.
+static void finishMatch(Server& server, Match& match, int winner, const string& result_text, const string& reason,
+                        RecordEndReason end_reason) {
+    server.deadlines.erase(std::make_pair(match.deadline_ns, match.id));
+    uint64_t match_id = match.id;
+
+    writeLogEndRecord(match.game, winner + 1, reason, match.seed.value, server.log_line);
+    if (!server.config.log_dir.empty()) {
+        match.log.append(server.log_line.text);
+        match.log.push_back('\n');
+        string path = server.config.log_dir + "/match_" + to_string(match_id) + ".log";
+        std::ofstream log_file(path.c_str(), std::ios::binary | std::ios::trunc);
+        if (!log_file.write(match.log.data(), match.log.size())) cerr << "WARNING: Failed to write " << path << endl;
+    }
+    if (server.record_file.is_open()) {
+        match.record.winner = winner + 1;
+        match.record.reason = end_reason;
+        string data;
+        encodeGameRecord(match.record, data);
+        if (!server.record_file.write(data.data(), data.size()).flush()) {
+            cerr << "WARNING: Failed to write " << server.config.record_path << endl;
+        }
+    }
+
+    // Player 2 is queued first, so a pair that meets again swaps seats
+    for (int seat = 1; seat >= 0; seat--) {
+        Connection& conn = server.connections[match.conns[seat]];
+        EngineStats& stats = server.stats[conn.name];
+        if (winner == -1) stats.draws++;
+        else if (winner == seat) stats.wins++;
+        else {
+            stats.losses++;
+            stats.forfeits += (end_reason != END_NORMAL);
+        }
+        queueText(conn, match_id, result_text);
+        flushOutput(server, conn);
+        conn.matches.erase(std::find(conn.matches.begin(), conn.matches.end(), match_id));
+        if (!conn.closing) server.waiting.push_back(conn.id);
+    }
+    if (end_reason != END_NORMAL) {
+        cerr << "Match " << match_id << " (seed " << match.seed.value << ", "
+             << server.connections[match.conns[0]].name << " vs " << server.connections[match.conns[1]].name
+             << "): " << reason << endl;
+    }
+    server.total_moves += match.record.moves.size();
+    server.matches.erase(match_id);
+    server.finished++;
+    if (server.finished % 1000 == 0) {
+        cerr << "[" << server.finished << (server.config.games ? "/" + to_string(server.config.games) : string())
+             << "] " << server.matches.size() << " matches in progress, " << server.connections.size()
+             << " connections" << endl;
+    }
+    pairEngines(server);
+}
+
+// The opponent of `seat` wins; `why` follows "Player N" in the reason
+static void forfeit(Server& server, Match& match, int seat, const string& why, const string& detail,
+                    RecordEndReason end_reason) {
+    string loser = "Player " + to_string(seat + 1);
+    finishMatch(server, match, 1 - seat,
+                "WINNER: Player " + to_string(2 - seat) + "\n" + "REASON: " + loser + " " + why + " (" + detail + ")\n",
+                loser + " " + why, end_reason);
+}
+
+static void finishGameOver(Server& server, Match& match) {
+    int winner = determineWinner(match.game);
+    string text = (winner == -1) ? "RESULT: TIE\n" : "WINNER: Player " + to_string(winner + 1) + "\n";
+    // Reveal the seed to engines at the end of the game
+    text += "SEED: " + to_string(match.seed.value) + "\n";
+    finishMatch(server, match, winner, text, "game over", END_NORMAL);
+}
+
+static void startMatch(Server& server, uint64_t conn_a, uint64_t conn_b) {
+    // Match i plays seed first_seed + i (wrapping within the nonzero 32-bit seeds),
+    // or the i-th stream of the run seed with --splitmix
+    long index = server.started++;
+    uint64_t match_id = (uint64_t)index + 1;
+    Match& match = server.matches[match_id];
+    match.id = match_id;
+    match.seed = (server.config.seed_mode == SEED_SPLITMIX64)
+        ? GameSeed{deriveGameSeed(server.config.first_seed, (uint64_t)index), SEED_SPLITMIX64}
+        : GameSeed{1 + (server.config.first_seed - 1 + (uint64_t)index) % 0xFFFFFFFFULL, SEED_LEGACY_MT19937};
+    match.conns[0] = conn_a;
+    match.conns[1] = conn_b;
+    resetGame(match.game, match.seed, server.cards, server.nobles);
+    for (int p = 0; p < 2; p++) match.game.players[p].time_bank = server.config.time_bank;
+    match.record.seed = match.seed;
+    match.record.card_set_hash = server.card_set_hash;
+    if (!server.config.log_dir.empty()) {
+        writeLogStartRecord(match.game, match.seed.mode, false, server.log_line);
+        match.log.append(server.log_line.text);
+        match.log.push_back('\n');
+    }
+    server.connections[conn_a].matches.push_back(match_id);
+    server.connections[conn_b].matches.push_back(match_id);
+    sendStates(server, match);
+}
+
+static bool isOpenForMatches(const Server& server, uint64_t conn_id) {
+    auto found = server.connections.find(conn_id);
+    return found != server.connections.end() && !found->second.closing;
+}
+
+// Pair free slots of different connections in arrival order; the earlier one plays first
+static void pairEngines(Server& server) {
+    while (!stop_requested && (server.config.games == 0 || server.started < server.config.games)) {
+        while (!server.waiting.empty() && !isOpenForMatches(server, server.waiting.front())) {
+            server.waiting.pop_front();
+        }
+        if (server.waiting.empty()) return;
+        uint64_t first = server.waiting.front();
+        auto second = server.waiting.begin() + 1;
+        while (second != server.waiting.end() && (*second == first || !isOpenForMatches(server, *second))) ++second;
+        if (second == server.waiting.end()) return;
+        uint64_t opponent = *second;
+        server.waiting.erase(second);
+        server.waiting.pop_front();
+        startMatch(server, first, opponent);
+    }
+}
+
+// A reply to the match's current state. Its first byte arrived at input_at and the
+// recv holding its newline at complete_at; the mover is charged up to complete_at.
+static void handleMove(Server& server, Match& match, int seat, const string& move_string, int64_t input_at,
+                       int64_t complete_at) {
+    GameState& game = match.game;
+    Player& mover = game.players[seat];
+    match.timing.think_ns = complete_at - match.flushed_at;
+    match.timing.read_ns = complete_at - input_at;
+    mover.time_bank -= match.timing.think_ns / 1e9;
+    long think_us = (long)(match.timing.think_ns / 1000);
+    match.ply++;
+    bool logging = !server.config.log_dir.empty();
+    auto logMove = [&](const string& error) {
+        if (!logging) return;
+        writeLogMoveRecord(match.ply, seat + 1, move_string, think_us, mover.time_bank, error, server.log_line,
+                           &match.timing);
+        match.log.append(server.log_line.text);
+        match.log.push_back('\n');
+    };
+
+    if (mover.time_bank < 0) {
+        logMove("timed out");
+        std::ostringstream bank;
+        bank << std::fixed << std::setprecision(3) << mover.time_bank << "s";
+        forfeit(server, match, seat, "timed out", bank.str(), END_TIMEOUT);
+        return;
+    }
+    mover.time_bank += server.config.increment;
+
+    // REVEAL commands are not allowed in normal mode; the clock restarts once the
+    // rejection is handled
+    if (move_string.find("REVEAL") == 0) {
+        logMove("REVEAL command only valid in replay mode");
+        match.timing = MoveTiming();
+        startClock(server, match, monotonicNs());
+        return;
+    }
+
+    std::pair<Move, ValidationResult> parse_result = parseMove(move_string, seat);
+    ValidationResult move_valid = parse_result.second;
+    if (move_valid.valid) move_valid = validateMove(game, parse_result.first);
+    if (move_valid.valid) move_valid = applyMove(game, parse_result.first);
+    if (!move_valid.valid) {
+        logMove(move_valid.error_message);
+        forfeit(server, match, seat, "made invalid move", move_valid.error_message, END_INVALID_MOVE);
+        return;
+    }
+    logMove("");
+    match.record.moves.push_back(RecordedMove{encodeRecordedMove(parse_result.first), (uint32_t)think_us, 0});
+
+    if (isGameOver(game)) {
+        finishGameOver(server, match);
+    } else if ((int)match.record.moves.size() >= server.config.max_moves) {
+        finishMatch(server, match, -1,
+                    "RESULT: TIE\nREASON: move limit (" + to_string(server.config.max_moves) + " moves)\nSEED: " +
+                    to_string(match.seed.value) + "\n",
+                    "move limit", END_UNFINISHED);
+    } else {
+        sendStates(server, match);
+    }
+}
+
+static void handleLine(Server& server, Connection& conn, string line, int64_t started_at, int64_t completed_at) {
+    if (!line.empty() && line.back() == '\r') line.pop_back();
+    if (conn.name.empty()) {
+        std::istringstream hello(line);
+        string word, slots = "1", extra;
+        hello >> word >> conn.name >> slots >> extra;
+        conn.slots = atoi(slots.c_str());
+        if (word != "HELLO" || conn.name.empty() || !extra.empty() || conn.slots < 1 || conn.slots > MAX_SLOTS) {
+            cerr << "Connection " << conn.id << ": expected HELLO NAME [SLOTS], got \"" << line << "\"" << endl;
+            conn.name.clear();
+            markClosing(server, conn);
+            return;
+        }
+        for (int s = 0; s < conn.slots; s++) server.waiting.push_back(conn.id);
+        pairEngines(server);
+        return;
+    }
+
+    // "@ID MOVE" names the match; untagged lines go to the only match in progress
+    uint64_t match_id = 0;
+    size_t move_start = 0;
+    if (!line.empty() && line[0] == '@') {
+        size_t space = line.find(' ');
+        match_id = strtoull(line.c_str() + 1, nullptr, 10);
+        move_start = (space == string::npos) ? line.size() : space + 1;
+        if (std::find(conn.matches.begin(), conn.matches.end(), match_id) == conn.matches.end()) match_id = 0;
+    } else if (conn.matches.size() == 1) {
+        match_id = conn.matches[0];
+    }
+    if (match_id == 0) {
+        cerr << "Engine " << conn.name << " (connection " << conn.id << "): ignoring \"" << line
+             << "\" outside a match" << endl;
+        return;
+    }
+    Match& match = server.matches[match_id];
+    int seat = (match.conns[0] == conn.id) ? 0 : 1;
+    if (match.game.current_player != seat) {
+        forfeit(server, match, seat, "moved out of turn", line.substr(move_start), END_INVALID_MOVE);
+        return;
+    }
+    // Bytes that arrived before the state was flushed were sent early and cost no time
+    handleMove(server, match, seat, line.substr(move_start), std::max(started_at, match.flushed_at),
+               std::max(completed_at, match.flushed_at));
+}
+
+// Lines are handled per recv and stamped with its time, so a reply counts as
+// arrived only with the read that holds its newline
+static void readInput(Server& server, Connection& conn) {
+    char buffer[65536];
+    while (!conn.closing) {
+        ssize_t n = recv(conn.fd, buffer, sizeof(buffer), 0);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+        if (n <= 0) {
+            markClosing(server, conn);
+            break;
+        }
+        int64_t received_at = monotonicNs();
+        if (conn.input.empty()) conn.input_since = received_at;
+        size_t start = 0, scan_from = conn.input.size();
+        conn.input.append(buffer, (size_t)n);
+        size_t end;
+        while (!conn.closing && (end = conn.input.find('\n', scan_from)) != string::npos) {
+            handleLine(server, conn, conn.input.substr(start, end - start), conn.input_since, received_at);
+            start = scan_from = end + 1;
+            conn.input_since = received_at;     // Whatever follows came with this recv
+        }
+        conn.input.erase(0, start);
+        if (conn.input.size() > MAX_LINE_BYTES) {
+            cerr << "Engine " << conn.name << " (connection " << conn.id << "): line too long" << endl;
+            markClosing(server, conn);
+        }
+    }
+}
+
+static void acceptConnections(Server& server) {
+    while (true) {
+        int fd = accept4(server.listen_fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno == EINTR) continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK) cerr << "WARNING: accept: " << strerror(errno) << endl;
+            return;
+        }
+        Connection& conn = server.connections[server.next_connection_id];
+        conn.id = server.next_connection_id++;
+        conn.fd = fd;
+        struct epoll_event event;
+        event.events = EPOLLIN;
+        event.data.u64 = conn.id;
+        epoll_ctl(server.epoll_fd, EPOLL_CTL_ADD, fd, &event);
+    }
+}
+
+// Drop a connection; the engine forfeits every match it is playing
+static void closeConnection(Server& server, uint64_t conn_id) {
+    auto found = server.connections.find(conn_id);
+    if (found == server.connections.end()) return;
+    Connection& conn = found->second;
+    conn.closing = true;
+    vector<uint64_t> playing = conn.matches;
+    for (uint64_t match_id : playing) {
+        auto match = server.matches.find(match_id);
+        if (match == server.matches.end()) continue;
+        int seat = (match->second.conns[0] == conn_id) ? 0 : 1;
+        forfeit(server, match->second, seat, "disconnected", "connection closed", END_UNFINISHED);
+    }
+    epoll_ctl(server.epoll_fd, EPOLL_CTL_DEL, conn.fd, nullptr);
+    close(conn.fd);
+    server.connections.erase(found);
+}
+
+// Movers whose bank ran out without a reply lose on time, and their connection is
+// dropped: a late reply would otherwise be read as a move in the engine's next game
+static void expireDeadlines(Server& server) {
+    int64_t now = monotonicNs();
+    while (!server.deadlines.empty() && server.deadlines.begin()->first <= now) {
+        Match& match = server.matches[server.deadlines.begin()->second];
+        int seat = match.game.current_player;
+        Player& mover = match.game.players[seat];
+        match.timing.think_ns = now - match.flushed_at;
+        mover.time_bank -= match.timing.think_ns / 1e9;
+        match.ply++;
+        if (!server.config.log_dir.empty()) {
+            writeLogMoveRecord(match.ply, seat + 1, "", (long)(match.timing.think_ns / 1000), mover.time_bank,
+                               "timed out", server.log_line, &match.timing);
+            match.log.append(server.log_line.text);
+            match.log.push_back('\n');
+        }
+        // Closing first keeps finishMatch from queueing the connection for another match
+        markClosing(server, server.connections[match.conns[seat]]);
+        std::ostringstream bank;
+        bank << std::fixed << std::setprecision(3) << mover.time_bank << "s";
+        forfeit(server, match, seat, "timed out", bank.str(), END_TIMEOUT);
+    }
+}
+
+static void printUsage() {
+    cerr << "Usage: ./referee_server [options] SOCKET_PATH\n"
+         << "  --games N        Exit after N matches (default: run until SIGINT/SIGTERM)\n"
+         << "  --seed S         First seed (default 1); with --splitmix, the run seed\n"
+         << "  --splitmix       Deal with SplitMix64 streams derived from the run seed instead of mt19937\n"
+         << "  --time T         Initial time bank per player in seconds (default " << INITIAL_TIME_BANK << ")\n"
+         << "  --inc I          Increment per move in seconds (default " << TIME_INCREMENT << ")\n"
+         << "  --max-moves M    Adjudicate a draw after M moves (default 1000)\n"
+         << "  --log-dir DIR    Write each match's JSON-lines log to DIR/match_<id>.log\n"
+         << "  --record PATH    Append a binary game record per match\n"
+         << "Engines connect to SOCKET_PATH and send \"HELLO NAME [SLOTS]\"; free slots of different\n"
+         << "connections are paired in arrival order." << endl;
+}
+
+static bool parseArgs(int argc, char* argv[], ServerConfig& config) {
+    vector<string> positional;
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        bool has_value = i + 1 < argc;
+        if (arg == "--games" && has_value) config.games = atol(argv[++i]);
+        else if (arg == "--seed" && has_value) config.first_seed = strtoull(argv[++i], nullptr, 10);
+        else if (arg == "--splitmix") config.seed_mode = SEED_SPLITMIX64;
+        else if (arg == "--time" && has_value) config.time_bank = atof(argv[++i]);
+        else if (arg == "--inc" && has_value) config.increment = atof(argv[++i]);
+        else if (arg == "--max-moves" && has_value) config.max_moves = atoi(argv[++i]);
+        else if (arg == "--log-dir" && has_value) config.log_dir = argv[++i];
+        else if (arg == "--record" && has_value) config.record_path = argv[++i];
+        else if (arg.compare(0, 2, "--") == 0) return false;
+        else positional.push_back(arg);
+    }
+    if (positional.size() != 1 || config.games < 0 || config.max_moves < 1) return false;
+    // mt19937 seeds are 32-bit and 0 means "use the clock"
+    if (config.seed_mode == SEED_LEGACY_MT19937 && (config.first_seed == 0 || config.first_seed > 0xFFFFFFFFULL)) {
+        return false;
+    }
+    config.socket_path = positional[0];
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    Server server;
+    if (!parseArgs(argc, argv, server.config)) {
+        printUsage();
+        return 1;
+    }
+    server.cards = builtinCards();
+    server.nobles = builtinNobles();
+    server.card_set_hash = cardSetHash(server.cards, server.nobles);
+    if (!server.config.record_path.empty()) {
+        server.record_file.open(server.config.record_path.c_str(), std::ios::binary | std::ios::app);
+        if (!server.record_file.is_open()) {
+            cerr << "ERROR: Cannot open " << server.config.record_path << endl;
+            return 1;
+        }
+    }
+
+    ValidationResult listening = listenUnix(server.config.socket_path, server.listen_fd);
+    if (!listening.valid) {
+        cerr << "ERROR: " << listening.error_message << endl;
+        return 1;
+    }
+    server.epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    struct epoll_event listen_event;
+    listen_event.events = EPOLLIN;
+    listen_event.data.u64 = 0;
+    epoll_ctl(server.epoll_fd, EPOLL_CTL_ADD, server.listen_fd, &listen_event);
+
+    // A crashed engine must not kill the server when we write its next state. No
+    // SA_RESTART, so SIGINT/SIGTERM interrupt epoll_wait.
+    signal(SIGPIPE, SIG_IGN);
+    struct sigaction stop_action;
+    memset(&stop_action, 0, sizeof(stop_action));
+    stop_action.sa_handler = requestStop;
+    sigaction(SIGINT, &stop_action, nullptr);
+    sigaction(SIGTERM, &stop_action, nullptr);
+
+    cerr << "Listening on " << server.config.socket_path << endl;
+    auto start = std::chrono::steady_clock::now();
+    const int max_events = 256;
+    struct epoll_event events[max_events];
+    while (!stop_requested && (server.config.games == 0 || server.finished < server.config.games)) {
+        // Sleep until the earliest deadline at most
+        int wait_ms = -1;
+        if (!server.deadlines.empty()) {
+            int64_t remaining_ns = server.deadlines.begin()->first - monotonicNs();
+            wait_ms = (int)std::min<int64_t>(std::max<int64_t>(0, (remaining_ns + 999999) / 1000000), 1 << 30);
+        }
+        int ready = epoll_wait(server.epoll_fd, events, max_events, wait_ms);
+        if (ready < 0) {
+            if (errno == EINTR) continue;
+            cerr << "ERROR: epoll_wait: " << strerror(errno) << endl;
+            break;
+        }
+        for (int i = 0; i < ready; i++) {
+            uint64_t id = events[i].data.u64;
+            if (id == 0) {
+                acceptConnections(server);
+                continue;
+            }
+            auto found = server.connections.find(id);
+            if (found == server.connections.end() || found->second.closing) continue;
+            if (events[i].events & EPOLLOUT) flushOutput(server, found->second);
+            if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) readInput(server, found->second);
+        }
+        expireDeadlines(server);
+        // Forfeits from closing one connection can queue others (a failed result write)
+        while (!server.to_close.empty()) {
+            uint64_t id = server.to_close.back();
+            server.to_close.pop_back();
+            closeConnection(server, id);
+        }
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    long abandoned = (long)server.matches.size();
+    for (auto& entry : server.connections) close(entry.second.fd);
+    close(server.listen_fd);
+    close(server.epoll_fd);
+    unlink(server.config.socket_path.c_str());
+
+    cout << std::fixed << std::setprecision(1);
+    cout << "Matches: " << server.finished << " (" << abandoned << " abandoned at shutdown)" << endl;
+    for (const auto& entry : server.stats) {
+        const EngineStats& stats = entry.second;
+        long n = stats.wins + stats.draws + stats.losses;
+        cout << "  " << entry.first << ": " << n << " games, W " << stats.wins << " / D " << stats.draws << " / L "
+             << stats.losses << " (" << stats.forfeits << " forfeits), score "
+             << 100.0 * (stats.wins + 0.5 * stats.draws) / std::max(n, 1L) << "%" << endl;
+    }
+    if (server.finished > 0) {
+        cout << "Average moves: " << (double)server.total_moves / server.finished << endl;
+    }
+    cout << "Elapsed: " << elapsed.count() << " s (" << std::setprecision(2)
+         << server.finished / std::max(elapsed.count(), 1e-9) << " games/sec)" << endl;
+    return 0;
+}
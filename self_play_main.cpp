@@ -0,0 +1,198 @@
+// Self-Play Simulator
+// Plays seeded games in-process (no referee, pipes or JSON) between built-in
+// policies and reports results and throughput.
+
+#include <chrono>
+#include <functional>
+#include <iomanip>
+#include <thread>
+#include "game_logic.h"
+
+using std::string;
+using std::vector;
+using std::cout;
+using std::cerr;
+using std::endl;
+using std::ostream;
+using std::mt19937;
+
+// A policy picks the index of one generated move
+typedef int (*PolicyFn)(const GameState& state, const MoveList& moves, mt19937& rng);
+
+struct Policy {
+    const char* name;
+    PolicyFn choose;
+};
+
+static int randomPolicy(const GameState&, const MoveList& moves, mt19937& rng) {
+    return rng() % moves.count;
+}
+
+static int firstPolicy(const GameState&, const MoveList&, mt19937&) {
+    return 0;
+}
+
+// Points of a card the current player can buy (face-up or reserved)
+static int cardPoints(const GameState& state, int card_id) {
+    GameState::CardLocation loc = state.findCardInFaceup(card_id);
+    if (loc.found) return state.getFaceup(loc.level)[loc.index].points;
+    for (const Card& card : state.players[state.current_player].reserved) {
+        if (card.id == card_id) return card.points;
+    }
+    return 0;
+}
+
+// Buy the most valuable card, else take the most gems, else reserve; ties broken at random
+static int greedyPolicy(const GameState& state, const MoveList& moves, mt19937& rng) {
+    int best = 0, best_score = -1, ties = 0;
+    for (int i = 0; i < moves.count; i++) {
+        const CompactMove& m = moves.moves[i];
+        int score = 0;
+        if (m.type == BUY_CARD) {
+            score = 100 + 10 * cardPoints(state, m.card_id);
+        } else if (m.type == TAKE_GEMS) {
+            int taken = 0, returned = 0;
+            for (int c = 0; c < NUM_GEM_COLORS; c++) taken += m.gems_taken[c];
+            for (int c = 0; c < NUM_TOKEN_COLORS; c++) returned += m.gems_returned[c];
+            score = 10 + taken - returned;
+        } else if (m.type == RESERVE_CARD) {
+            score = 5;
+        }
+        if (score > best_score) {
+            best = i;
+            best_score = score;
+            ties = 1;
+        } else if (score == best_score && rng() % ++ties == 0) {
+            best = i;
+        }
+    }
+    return best;
+}
+
+static const Policy POLICIES[] = {
+    {"random", randomPolicy},
+    {"greedy", greedyPolicy},
+    {"first", firstPolicy},
+};
+
+static const Policy* findPolicy(const string& name) {
+    for (const Policy& policy : POLICIES) {
+        if (name == policy.name) return &policy;
+    }
+    return nullptr;
+}
+
+struct SelfPlayStats {
+    long games = 0;
+    long wins[2] = {0, 0};
+    long draws = 0;
+    long capped = 0;       // Stopped at the ply cap (counted separately from draws)
+    long plies = 0;
+};
+
+// Seed of game i: first_seed + i (mt19937 deals) or a stream derived from the run seed
+static GameSeed gameSeed(uint64_t first_seed, long i, SeedMode mode) {
+    if (mode == SEED_SPLITMIX64) return GameSeed{deriveGameSeed(first_seed, (uint64_t)i), mode};
+    return GameSeed{(unsigned int)(first_seed + i), mode};
+}
+
+// Play game i for every i in [0, games) with i % stride == offset
+static void playGames(long games, uint64_t first_seed, SeedMode mode, long offset, long stride,
+                      const Policy* policies[2], int max_plies, SelfPlayStats& stats) {
+    std::ostream null_os(nullptr);
+    MoveList moves;
+    GameState state;   // Reused across games, so setup does not allocate
+
+    for (long i = offset; i < games; i += stride) {
+        GameSeed seed = gameSeed(first_seed, i, mode);
+        resetGame(state, seed, builtinCards(), builtinNobles());
+        mt19937 rng((unsigned int)seed.value ^ 0x9E3779B9u);
+
+        int ply = 0;
+        while (!isGameOver(state) && ply < max_plies) {
+            generateMoves(state, moves);
+            int choice = policies[state.current_player]->choose(state, moves, rng);
+            applyMove(state, toMove(moves.moves[choice], state.current_player), null_os);
+            ply++;
+        }
+
+        stats.games++;
+        stats.plies += ply;
+        if (!isGameOver(state)) {
+            stats.capped++;
+        } else {
+            int winner = determineWinner(state);
+            if (winner < 0) stats.draws++;
+            else stats.wins[winner]++;
+        }
+    }
+}
+
+int main(int argc, char* argv[]) {
+    long games = (argc > 1) ? atol(argv[1]) : 1000;
+    uint64_t first_seed = (argc > 2) ? strtoull(argv[2], nullptr, 10) : 1;
+    string policy_names[2] = {(argc > 3) ? argv[3] : "random", (argc > 4) ? argv[4] : "random"};
+    int threads = (argc > 5) ? atoi(argv[5]) : 1;
+    int max_plies = (argc > 6) ? atoi(argv[6]) : 1000;
+    string rng_name = (argc > 7) ? argv[7] : "mt19937";
+
+    SeedMode mode = SEED_LEGACY_MT19937;
+    if (rng_name == "splitmix") {
+        mode = SEED_SPLITMIX64;
+    } else if (rng_name != "mt19937") {
+        cerr << "ERROR: Unknown generator '" << rng_name << "' (available: mt19937 splitmix)" << endl;
+        return 1;
+    }
+    if (mode == SEED_LEGACY_MT19937 && first_seed + games - 1 > 0xFFFFFFFFULL) {
+        cerr << "ERROR: mt19937 seeds are 32-bit; use the splitmix generator for larger seeds" << endl;
+        return 1;
+    }
+    if (first_seed == 0 && mode == SEED_LEGACY_MT19937) {
+        cerr << "ERROR: seed 0 means 'use the clock' to resetGame; pick a first seed >= 1" << endl;
+        return 1;
+    }
+    const Policy* policies[2];
+    for (int p = 0; p < 2; p++) {
+        policies[p] = findPolicy(policy_names[p]);
+        if (!policies[p]) {
+            cerr << "ERROR: Unknown policy '" << policy_names[p] << "' (available:";
+            for (const Policy& policy : POLICIES) cerr << " " << policy.name;
+            cerr << ")" << endl;
+            return 1;
+        }
+    }
+    if (threads < 1) threads = 1;
+
+    vector<SelfPlayStats> thread_stats(threads);
+    auto start = std::chrono::steady_clock::now();
+    vector<std::thread> workers;
+    for (int t = 0; t < threads; t++) {
+        workers.emplace_back(playGames, games, first_seed, mode, (long)t, (long)threads, policies, max_plies, std::ref(thread_stats[t]));
+    }
+    for (std::thread& worker : workers) worker.join();
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    SelfPlayStats total;
+    for (const SelfPlayStats& stats : thread_stats) {
+        total.games += stats.games;
+        total.wins[0] += stats.wins[0];
+        total.wins[1] += stats.wins[1];
+        total.draws += stats.draws;
+        total.capped += stats.capped;
+        total.plies += stats.plies;
+    }
+
+    cout << std::fixed << std::setprecision(1);
+    cout << "Games: " << total.games << " (" << policy_names[0] << " vs " << policy_names[1];
+    if (mode == SEED_SPLITMIX64) cout << ", run seed " << first_seed << " (splitmix)";
+    else cout << ", seeds " << first_seed << "-" << (first_seed + games - 1);
+    cout << ", " << threads << " thread(s))" << endl;
+    cout << "Player 0 wins: " << total.wins[0] << ", Player 1 wins: " << total.wins[1]
+         << ", Draws: " << total.draws << ", Ply cap: " << total.capped << endl;
+    cout << "Average plies: " << (total.games ? (double)total.plies / total.games : 0.0) << endl;
+    cout << "Elapsed: " << std::setprecision(3) << elapsed.count() << " s" << endl;
+    cout << std::setprecision(1);
+    cout << "Games/sec: " << total.games / elapsed.count() << endl;
+    cout << "Plies/sec: " << total.plies / elapsed.count() << endl;
+    return 0;
+}
@@ -0,0 +1,289 @@
+#include "subprocess.h"
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <thread>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "binary_protocol.h"
+
+using std::string;
+using std::vector;
+
+static void closeFd(int& fd) {
+    if (fd >= 0) {
+        close(fd);
+        fd = -1;
+    }
+}
+
+// Close-on-exec from creation, so children spawned concurrently by other threads don't inherit them
+static bool makePipe(int fds[2]) {
+    return pipe2(fds, O_CLOEXEC) == 0;
+}
+
+static void closePipe(int fds[2]) {
+    closeFd(fds[0]);
+    closeFd(fds[1]);
+}
+
+ValidationResult spawnProcess(const vector<string>& argv, Subprocess& proc, StderrMode stderr_mode) {
+    if (argv.empty()) return ValidationResult(false, "Empty command");
+
+    // Everything the child needs is prepared before fork: only async-signal-safe calls after it
+    vector<char*> args;
+    for (const string& arg : argv) args.push_back(const_cast<char*>(arg.c_str()));
+    args.push_back(nullptr);
+
+    // exec_pipe is closed by a successful exec; otherwise the child writes its errno there
+    int in_pipe[2] = {-1, -1}, out_pipe[2] = {-1, -1}, err_pipe[2] = {-1, -1}, exec_pipe[2] = {-1, -1};
+    if (!makePipe(in_pipe) || !makePipe(out_pipe) || !makePipe(exec_pipe) ||
+        (stderr_mode == STDERR_CAPTURE && !makePipe(err_pipe))) {
+        int err = errno;
+        closePipe(in_pipe); closePipe(out_pipe); closePipe(exec_pipe); closePipe(err_pipe);
+        return ValidationResult(false, string("pipe failed: ") + strerror(err));
+    }
+    int null_fd = (stderr_mode == STDERR_DISCARD) ? open("/dev/null", O_WRONLY | O_CLOEXEC) : -1;
+
+    pid_t pid = fork();
+    if (pid < 0) {
+        int err = errno;
+        closePipe(in_pipe); closePipe(out_pipe); closePipe(exec_pipe); closePipe(err_pipe);
+        if (null_fd >= 0) close(null_fd);
+        return ValidationResult(false, string("fork failed: ") + strerror(err));
+    }
+    if (pid == 0) {
+        dup2(in_pipe[0], STDIN_FILENO);
+        dup2(out_pipe[1], STDOUT_FILENO);
+        if (null_fd >= 0) dup2(null_fd, STDERR_FILENO);
+        if (err_pipe[1] >= 0) dup2(err_pipe[1], STDERR_FILENO);
+        signal(SIGPIPE, SIG_DFL);
+        execvp(args[0], args.data());
+        int err = errno;
+        ssize_t ignored = write(exec_pipe[1], &err, sizeof(err));
+        (void)ignored;
+        _exit(127);
+    }
+
+    closeFd(in_pipe[0]);
+    closeFd(out_pipe[1]);
+    closeFd(exec_pipe[1]);
+    closeFd(err_pipe[1]);
+    if (null_fd >= 0) close(null_fd);
+
+    int exec_errno = 0;
+    ssize_t n;
+    do {
+        n = read(exec_pipe[0], &exec_errno, sizeof(exec_errno));
+    } while (n < 0 && errno == EINTR);
+    close(exec_pipe[0]);
+    if (n == (ssize_t)sizeof(exec_errno)) {
+        closeFd(in_pipe[1]);
+        closeFd(out_pipe[0]);
+        closeFd(err_pipe[0]);
+        waitpid(pid, nullptr, 0);
+        return ValidationResult(false, "Cannot run " + argv[0] + ": " + strerror(exec_errno));
+    }
+
+    // Writes wait with a deadline in writeBytes instead of blocking on a child that stopped reading
+    fcntl(in_pipe[1], F_SETFL, fcntl(in_pipe[1], F_GETFL) | O_NONBLOCK);
+
+    proc.pid = pid;
+    proc.stdin_fd = in_pipe[1];
+    proc.stdout_fd = out_pipe[0];
+    proc.stderr_fd = err_pipe[0];
+    proc.read_buffer.clear();
+    proc.stderr_buffer.clear();
+    return ValidationResult(true);
+}
+
+typedef std::chrono::steady_clock::time_point Deadline;
+
+static Deadline deadlineAfter(double seconds) {
+    return std::chrono::steady_clock::now() +
+           std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(seconds));
+}
+
+// Milliseconds to pass to poll: -1 without a deadline, 0 once it has passed
+static int pollTimeout(const Deadline& deadline, bool has_deadline) {
+    if (!has_deadline) return -1;
+    auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now()).count();
+    return remaining > 0 ? (int)remaining : 0;
+}
+
+bool writeBytes(Subprocess& proc, const char* data, size_t size, double timeout_seconds) {
+    if (proc.stdin_fd < 0) return false;
+    Deadline deadline = deadlineAfter(timeout_seconds);
+    size_t written = 0;
+    while (written < size) {
+        ssize_t n = write(proc.stdin_fd, data + written, size - written);
+        if (n >= 0) {
+            written += n;
+            continue;
+        }
+        if (errno == EINTR) continue;
+        if (errno != EAGAIN && errno != EWOULDBLOCK) return false;
+
+        // Pipe full: wait for the child to read
+        int wait_ms = pollTimeout(deadline, timeout_seconds >= 0);
+        if (wait_ms == 0) return false;
+        struct pollfd pfd = {proc.stdin_fd, POLLOUT, 0};
+        if (poll(&pfd, 1, wait_ms) < 0 && errno != EINTR) return false;
+    }
+    return true;
+}
+
+bool writeLine(Subprocess& proc, const string& line, double timeout_seconds) {
+    string data = line + "\n";
+    return writeBytes(proc, data.data(), data.size(), timeout_seconds);
+}
+
+// Read what is available of the child's captured stderr and forward complete lines.
+// At EOF the pipe is closed and a partial last line is forwarded too.
+static void readStderr(Subprocess& proc) {
+    char chunk[4096];
+    ssize_t n;
+    do {
+        n = read(proc.stderr_fd, chunk, sizeof(chunk));
+    } while (n < 0 && errno == EINTR);
+    if (n > 0) proc.stderr_buffer.append(chunk, n);
+    size_t start = 0, newline;
+    while ((newline = proc.stderr_buffer.find('\n', start)) != string::npos) {
+        std::cerr << proc.stderr_label << proc.stderr_buffer.substr(start, newline - start) << '\n';
+        start = newline + 1;
+    }
+    proc.stderr_buffer.erase(0, start);
+    if (n <= 0) {
+        closeFd(proc.stderr_fd);
+        if (!proc.stderr_buffer.empty()) std::cerr << proc.stderr_label << proc.stderr_buffer << '\n';
+        proc.stderr_buffer.clear();
+    }
+    std::cerr.flush();
+}
+
+void forwardStderr(Subprocess& proc) {
+    while (proc.stderr_fd >= 0) {
+        struct pollfd pfd = {proc.stderr_fd, POLLIN, 0};
+        int ready = poll(&pfd, 1, 0);
+        if (ready < 0 && errno == EINTR) continue;
+        if (ready <= 0) return;
+        readStderr(proc);
+    }
+}
+
+// Append whatever the child has written to read_buffer, waiting until the deadline
+// if nothing is available. READ_OK means at least one byte was added.
+// Captured stderr of the process and of its stderr_peer is forwarded while waiting.
+static ReadStatus fillReadBuffer(Subprocess& proc, const Deadline& deadline, bool has_deadline) {
+    char chunk[4096];
+    Subprocess* peer = proc.stderr_peer;
+    while (true) {
+        if (proc.stdout_fd < 0) return READ_EOF;
+
+        int wait_ms = pollTimeout(deadline, has_deadline);
+        if (wait_ms == 0) return READ_TIMEOUT;
+
+        struct pollfd pfds[3] = {{proc.stdout_fd, POLLIN, 0}, {proc.stderr_fd, POLLIN, 0},
+                                 {peer ? peer->stderr_fd : -1, POLLIN, 0}};
+        int ready = poll(pfds, 3, wait_ms);
+        if (ready < 0) {
+            if (errno == EINTR) continue;
+            return READ_EOF;
+        }
+        if (pfds[1].revents) readStderr(proc);
+        if (pfds[2].revents) readStderr(*peer);
+        if (pfds[0].revents == 0) continue;  // Deadline re-checked at the top of the loop
+
+        ssize_t n = read(proc.stdout_fd, chunk, sizeof(chunk));
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) {
+            closeFd(proc.stdout_fd);
+            return READ_EOF;
+        }
+        proc.read_buffer_filled = std::chrono::steady_clock::now();
+        if (proc.read_buffer.empty()) proc.read_buffer_since = proc.read_buffer_filled;
+        proc.read_buffer.append(chunk, n);
+        return READ_OK;
+    }
+}
+
+ReadStatus readLine(Subprocess& proc, string& line, double timeout_seconds) {
+    Deadline deadline = deadlineAfter(timeout_seconds);
+
+    while (true) {
+        size_t newline = proc.read_buffer.find('\n');
+        if (newline != string::npos) {
+            line = proc.read_buffer.substr(0, newline);
+            if (!line.empty() && line.back() == '\r') line.pop_back();
+            proc.read_buffer.erase(0, newline + 1);
+            return READ_OK;
+        }
+        ReadStatus status = fillReadBuffer(proc, deadline, timeout_seconds >= 0);
+        if (status != READ_OK) return status;
+    }
+}
+
+ReadStatus readBytes(Subprocess& proc, char* out, size_t size, double timeout_seconds) {
+    Deadline deadline = deadlineAfter(timeout_seconds);
+
+    while (proc.read_buffer.size() < size) {
+        ReadStatus status = fillReadBuffer(proc, deadline, timeout_seconds >= 0);
+        if (status != READ_OK) return status;
+    }
+    memcpy(out, proc.read_buffer.data(), size);
+    proc.read_buffer.erase(0, size);
+    return READ_OK;
+}
+
+ReadStatus readFrame(Subprocess& proc, uint8_t& type, uint8_t& id, string& payload, double timeout_seconds) {
+    Deadline deadline = deadlineAfter(timeout_seconds);
+    unsigned char header[FRAME_HEADER_SIZE];
+    ReadStatus status = readBytes(proc, reinterpret_cast<char*>(header), FRAME_HEADER_SIZE, timeout_seconds);
+    if (status != READ_OK) return status;
+    uint32_t size;
+    decodeFrameHeader(header, size, type, id);
+    if (size > MAX_FRAME_PAYLOAD) return READ_EOF;
+    payload.resize(size);
+    if (size == 0) return READ_OK;
+    std::chrono::duration<double> remaining = deadline - std::chrono::steady_clock::now();
+    return readBytes(proc, &payload[0], size, std::max(0.0, remaining.count()));
+}
+
+void terminateProcess(Subprocess& proc, double grace_seconds) {
+    closeFd(proc.stdin_fd);
+    closeFd(proc.stdout_fd);
+    if (proc.pid <= 0) return;
+
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::duration<double>(grace_seconds);
+    while (waitpid(proc.pid, nullptr, WNOHANG) == 0) {
+        if (std::chrono::steady_clock::now() >= deadline) {
+            kill(proc.pid, SIGKILL);
+            waitpid(proc.pid, nullptr, 0);
+            break;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    proc.pid = -1;
+    forwardStderr(proc);
+    if (proc.stderr_fd >= 0) {
+        if (!proc.stderr_buffer.empty()) std::cerr << proc.stderr_label << proc.stderr_buffer << std::endl;
+        proc.stderr_buffer.clear();
+        closeFd(proc.stderr_fd);
+    }
+}
+
+vector<string> splitCommand(const string& command) {
+    vector<string> argv;
+    std::istringstream iss(command);
+    string word;
+    while (iss >> word) argv.push_back(word);
+    if (!argv.empty() && argv[0].size() > 3 && argv[0].compare(argv[0].size() - 3, 3, ".py") == 0) {
+        argv.insert(argv.begin(), "python3");
+    }
+    return argv;
+}
@@ -0,0 +1,68 @@
+#ifndef SUBPROCESS_H
+#define SUBPROCESS_H
+
+#include <chrono>
+#include <string>
+#include <vector>
+#include <sys/types.h>
+#include "game_logic.h"
+
+// Child process connected by pipes to its stdin/stdout (POSIX only).
+// Used to talk to engines line by line with per-read deadlines.
+struct Subprocess {
+    pid_t pid = -1;
+    int stdin_fd = -1;            // Write end of the child's stdin (non-blocking)
+    int stdout_fd = -1;           // Read end of the child's stdout
+    std::string read_buffer;      // Bytes read past the last returned line
+    std::chrono::steady_clock::time_point read_buffer_since;   // Arrival of the oldest buffered bytes
+    std::chrono::steady_clock::time_point read_buffer_filled;  // Last read into read_buffer
+
+    // STDERR_CAPTURE: the child's stderr is read while waiting on its stdout and
+    // forwarded to our stderr line by line, prefixed with stderr_label
+    int stderr_fd = -1;
+    std::string stderr_label;
+    std::string stderr_buffer;    // Partial stderr line
+    Subprocess* stderr_peer = nullptr;  // Captured stderr also forwarded while reading this process
+};
+
+enum StderrMode {
+    STDERR_INHERIT,               // Child writes straight to our stderr
+    STDERR_DISCARD,               // /dev/null
+    STDERR_CAPTURE                // Pipe, forwarded with a label (see Subprocess)
+};
+
+enum ReadStatus {
+    READ_OK,
+    READ_TIMEOUT,
+    READ_EOF                      // Child closed stdout or exited
+};
+
+// Start argv[0] (searched on PATH) with argv as arguments
+ValidationResult spawnProcess(const std::vector<std::string>& argv, Subprocess& proc,
+                              StderrMode stderr_mode = STDERR_INHERIT);
+
+// Write one line (a newline is appended). False if the child has closed its stdin, or
+// has not taken the data within timeout_seconds (< 0 waits forever).
+// The caller should ignore SIGPIPE.
+bool writeLine(Subprocess& proc, const std::string& line, double timeout_seconds = -1);
+// Write raw bytes (binary protocol frames)
+bool writeBytes(Subprocess& proc, const char* data, size_t size, double timeout_seconds = -1);
+
+// Read one line without its newline, waiting at most timeout_seconds (< 0 waits forever)
+ReadStatus readLine(Subprocess& proc, std::string& line, double timeout_seconds);
+// Read exactly size bytes into out, sharing the line reader's buffer and deadline rules
+ReadStatus readBytes(Subprocess& proc, char* out, size_t size, double timeout_seconds);
+// Read one binary protocol frame, waiting at most timeout_seconds in total
+ReadStatus readFrame(Subprocess& proc, uint8_t& type, uint8_t& id, std::string& payload, double timeout_seconds);
+
+// Forward any complete captured stderr lines without waiting
+void forwardStderr(Subprocess& proc);
+
+// Close the pipes, give the child grace_seconds to exit, then kill it, and reap it.
+// Captured stderr left in the pipe is forwarded first.
+void terminateProcess(Subprocess& proc, double grace_seconds = 0.2);
+
+// Split a command line on whitespace; a ".py" script is run with python3
+std::vector<std::string> splitCommand(const std::string& command);
+
+#endif // SUBPROCESS_H
@@ -0,0 +1,311 @@
+// Tournament Runner
+// Plays many seeded matches between two engine commands on a pool of worker
+// threads. Each worker referees its match in-process and talks to the two
+// engine processes over pipes using the referee's JSON-lines protocol, or the
+// binary framed protocol with --binary.
+
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <iomanip>
+#include <mutex>
+#include <thread>
+#include <signal.h>
+#include "game_logic.h"
+#include "binary_protocol.h"
+#include "subprocess.h"
+
+using std::string;
+using std::vector;
+using std::cout;
+using std::cerr;
+using std::endl;
+
+struct TournamentConfig {
+    string engines[2];              // Engine A, engine B
+    long games = 100;
+    uint64_t first_seed = 1;
+    SeedMode seed_mode = SEED_LEGACY_MT19937;   // --splitmix: 64-bit seeds derived per game pair
+    int concurrency = 0;            // 0 = one worker per core
+    double time_bank = INITIAL_TIME_BANK;
+    double increment = TIME_INCREMENT;
+    int max_moves = 1000;           // Adjudicated as a draw beyond this
+    bool engine_stderr = false;     // Pass engine stderr through instead of discarding it
+    bool binary = false;            // Offer the binary protocol to both engines
+};
+
+struct MatchResult {
+    int winner = -1;                // Seat of the winner, -1 = draw
+    int moves = 0;
+    string reason;                  // Why the game ended, if not normally
+    bool aborted = false;           // Could not be played (engine failed to start)
+};
+
+// Play one game with engine_cmds[seat] in each seat
+static MatchResult playMatch(const TournamentConfig& config, const string engine_cmds[2], const GameSeed& seed) {
+    std::ostream null_os(nullptr);
+    MatchResult result;
+
+    GameState game;
+    resetGame(game, seed, builtinCards(), builtinNobles());
+    for (int p = 0; p < 2; p++) game.players[p].time_bank = config.time_bank;
+
+    Subprocess engines[2];
+    for (int p = 0; p < 2; p++) {
+        ValidationResult spawned = spawnProcess(splitCommand(engine_cmds[p]), engines[p],
+                                                 config.engine_stderr ? STDERR_INHERIT : STDERR_DISCARD);
+        if (!spawned.valid) {
+            result.reason = "Failed to start player " + std::to_string(p + 1) + ": " + spawned.error_message;
+            result.aborted = true;
+            for (int q = 0; q < p; q++) terminateProcess(engines[q]);
+            return result;
+        }
+    }
+
+    auto forfeit = [&](int loser, const string& why) {
+        result.winner = 1 - loser;
+        result.reason = "Player " + std::to_string(loser + 1) + " " + why;
+    };
+
+    // Each engine answers the handshake with the binary or the JSON line; anything else forfeits
+    bool binary[2] = {false, false};
+    if (config.binary) {
+        for (int p = 0; p < 2; p++) {
+            string reply;
+            ReadStatus status = writeLine(engines[p], BINARY_HANDSHAKE, game.players[p].time_bank)
+                ? readLine(engines[p], reply, game.players[p].time_bank) : READ_TIMEOUT;
+            if (status == READ_OK && reply == BINARY_HANDSHAKE) binary[p] = true;
+            else if (status != READ_OK || reply != JSON_HANDSHAKE) {
+                forfeit(p, "failed the protocol handshake");
+                for (int q = 0; q < 2; q++) terminateProcess(engines[q]);
+                return result;
+            }
+        }
+    }
+
+    WireState wire;
+    string frame;
+    uint8_t frame_type = 0, frame_id = 0;
+    bool send_states = true;
+    while (!isGameOver(game)) {
+        if (result.moves >= config.max_moves) {
+            result.reason = "Move limit reached";
+            break;
+        }
+        int current = game.current_player;
+
+        // An engine that stops reading its input gets its own clock to drain the pipe,
+        // as in the referee, so a full pipe cannot hang the worker
+        if (send_states) {
+            for (int p = 0; p < 2; p++) {
+                double timeout = std::max(0.0, game.players[p].time_bank);
+                bool written;
+                if (!binary[p]) {
+                    written = writeLine(engines[p], gameStateToJson(game, p + 1), timeout);
+                } else {
+                    ValidationResult packed = packWireState(game, p + 1, wire);
+                    if (!packed.valid) {
+                        result.reason = "Cannot encode state: " + packed.error_message;
+                        result.aborted = true;
+                        break;
+                    }
+                    frame.clear();
+                    appendFrame(frame, FRAME_STATE, (uint8_t)(p + 1), &wire, sizeof(wire));
+                    written = writeBytes(engines[p], frame.data(), frame.size(), timeout);
+                }
+                if (!written) {
+                    forfeit(p, "stopped reading its input");
+                    break;
+                }
+            }
+            if (!result.reason.empty()) break;
+        }
+
+        auto start_time = std::chrono::steady_clock::now();
+        string move_string;
+        ReadStatus status = binary[current]
+            ? readFrame(engines[current], frame_type, frame_id, move_string, game.players[current].time_bank)
+            : readLine(engines[current], move_string, game.players[current].time_bank);
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start_time;
+        game.players[current].time_bank -= elapsed.count();
+
+        if (status == READ_EOF) {
+            forfeit(current, "disconnected");
+            break;
+        }
+        if (status == READ_TIMEOUT || game.players[current].time_bank < 0) {
+            forfeit(current, "timed out");
+            break;
+        }
+        game.players[current].time_bank += config.increment;
+
+        auto parse_result = binary[current] ? parseMoveFrame(frame_type, move_string, current)
+                                            : parseMove(move_string, current);
+
+        // As in the referee, REVEAL is ignored outside replay mode and the player moves again
+        if (binary[current] ? parse_result.first.type == REVEAL_CARD : move_string.find("REVEAL") == 0) {
+            send_states = false;
+            continue;
+        }
+        send_states = true;
+
+        Move move = parse_result.first;
+        ValidationResult move_valid = parse_result.second;
+        if (move_valid.valid) move_valid = validateMove(game, move);
+        if (!move_valid.valid) {
+            forfeit(current, "made invalid move (" + move_valid.error_message + ")");
+            break;
+        }
+
+        ValidationResult apply_result = applyMove(game, move, null_os);
+        if (!apply_result.valid) {
+            forfeit(current, "move could not be applied (" + apply_result.error_message + ")");
+            break;
+        }
+        result.moves++;
+    }
+
+    if (result.reason.empty()) result.winner = determineWinner(game);
+
+    for (int p = 0; p < 2; p++) terminateProcess(engines[p]);
+    return result;
+}
+
+struct TournamentStats {
+    long wins = 0;                  // From engine A's point of view
+    long draws = 0;
+    long losses = 0;
+    long forfeits = 0;              // Games decided by timeout, crash or invalid move
+    long aborted = 0;               // Not played, excluded from the score
+    long total_moves = 0;
+};
+
+// Elo difference for a score fraction in (0, 1)
+static double eloFromScore(double score) {
+    score = std::min(std::max(score, 1e-6), 1.0 - 1e-6);
+    return -400.0 * std::log10(1.0 / score - 1.0);
+}
+
+static void printUsage() {
+    cerr << "Usage: ./tournament [options] ENGINE_A ENGINE_B\n"
+         << "  --games N        Number of games (default 100); seats alternate, each seed is played twice\n"
+         << "  --seed S         First seed (default 1); with --splitmix, the run seed\n"
+         << "  --splitmix       Deal with SplitMix64 streams derived from the run seed instead of mt19937\n"
+         << "  --concurrency J  Parallel games (default: number of cores)\n"
+         << "  --time T         Initial time bank per player in seconds (default " << INITIAL_TIME_BANK << ")\n"
+         << "  --inc I          Increment per move in seconds (default " << TIME_INCREMENT << ")\n"
+         << "  --max-moves M    Adjudicate a draw after M moves (default 1000)\n"
+         << "  --engine-stderr  Show engine stderr instead of discarding it\n"
+         << "  --binary         Offer the binary framed protocol (engines may answer with JSON)\n"
+         << "Engine commands are split on spaces; .py scripts are run with python3." << endl;
+}
+
+static bool parseArgs(int argc, char* argv[], TournamentConfig& config) {
+    vector<string> positional;
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        bool has_value = i + 1 < argc;
+        if (arg == "--games" && has_value) config.games = atol(argv[++i]);
+        else if (arg == "--seed" && has_value) config.first_seed = strtoull(argv[++i], nullptr, 10);
+        else if (arg == "--splitmix") config.seed_mode = SEED_SPLITMIX64;
+        else if (arg == "--concurrency" && has_value) config.concurrency = atoi(argv[++i]);
+        else if (arg == "--time" && has_value) config.time_bank = atof(argv[++i]);
+        else if (arg == "--inc" && has_value) config.increment = atof(argv[++i]);
+        else if (arg == "--max-moves" && has_value) config.max_moves = atoi(argv[++i]);
+        else if (arg == "--engine-stderr") config.engine_stderr = true;
+        else if (arg == "--binary") config.binary = true;
+        else if (arg.compare(0, 2, "--") == 0) return false;
+        else positional.push_back(arg);
+    }
+    if (positional.size() != 2 || config.games < 1) return false;
+    // mt19937 seeds are 32-bit and 0 means "use the clock"
+    if (config.seed_mode == SEED_LEGACY_MT19937 &&
+        (config.first_seed == 0 || config.first_seed + (config.games - 1) / 2 > 0xFFFFFFFFULL)) {
+        return false;
+    }
+    config.engines[0] = positional[0];
+    config.engines[1] = positional[1];
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    TournamentConfig config;
+    if (!parseArgs(argc, argv, config)) {
+        printUsage();
+        return 1;
+    }
+    if (config.concurrency <= 0) config.concurrency = std::max(1u, std::thread::hardware_concurrency());
+
+    // A crashed engine must not kill the runner when we write its next state
+    signal(SIGPIPE, SIG_IGN);
+
+    TournamentStats stats;
+    std::mutex stats_mutex;
+    std::atomic<long> next_game(0);
+    long finished = 0;
+    auto start = std::chrono::steady_clock::now();
+
+    // Game i plays seed first_seed + i/2 (or the i/2-th stream of the run seed) with
+    // engine A in seat i%2
+    auto worker = [&]() {
+        while (true) {
+            long i = next_game++;
+            if (i >= config.games) break;
+            GameSeed seed = (config.seed_mode == SEED_SPLITMIX64)
+                ? GameSeed{deriveGameSeed(config.first_seed, (uint64_t)(i / 2)), SEED_SPLITMIX64}
+                : GameSeed{config.first_seed + (uint64_t)(i / 2), SEED_LEGACY_MT19937};
+            int seat_a = (int)(i % 2);
+            string seats[2];
+            seats[seat_a] = config.engines[0];
+            seats[1 - seat_a] = config.engines[1];
+
+            MatchResult result = playMatch(config, seats, seed);
+
+            std::lock_guard<std::mutex> lock(stats_mutex);
+            if (result.aborted) stats.aborted++;
+            else if (result.winner == -1) stats.draws++;
+            else if (result.winner == seat_a) stats.wins++;
+            else stats.losses++;
+            if (!result.reason.empty()) {
+                stats.forfeits += (!result.aborted && result.winner != -1);
+                cerr << "Game " << (i + 1) << " (seed " << seed.value << ", A as Player " << (seat_a + 1) << "): "
+                     << result.reason << endl;
+            }
+            stats.total_moves += result.moves;
+            finished++;
+            if (finished % 100 == 0) {
+                cerr << "[" << finished << "/" << config.games << "] +" << stats.wins << " =" << stats.draws
+                     << " -" << stats.losses << endl;
+            }
+        }
+    };
+
+    vector<std::thread> workers;
+    for (int t = 0; t < config.concurrency; t++) workers.emplace_back(worker);
+    for (std::thread& t : workers) t.join();
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    // Score and Elo from engine A's point of view, with a normal-approximation 95% interval
+    long n = stats.wins + stats.draws + stats.losses;
+    if (n == 0) {
+        cerr << "ERROR: No games could be played (" << stats.aborted << " aborted)" << endl;
+        return 1;
+    }
+    double score = (stats.wins + 0.5 * stats.draws) / n;
+    double variance = (stats.wins * std::pow(1.0 - score, 2) + stats.draws * std::pow(0.5 - score, 2)
+                       + stats.losses * std::pow(0.0 - score, 2)) / n;
+    double margin = 1.96 * std::sqrt(variance / n);
+
+    cout << std::fixed << std::setprecision(1);
+    cout << "Engine A: " << config.engines[0] << endl;
+    cout << "Engine B: " << config.engines[1] << endl;
+    cout << "Games: " << n << " (W " << stats.wins << " / D " << stats.draws << " / L " << stats.losses
+         << ", " << stats.forfeits << " forfeits, " << stats.aborted << " aborted)" << endl;
+    cout << "Score: " << 100.0 * score << "%" << endl;
+    cout << "Elo: " << eloFromScore(score) << " [" << eloFromScore(score - margin) << ", "
+         << eloFromScore(score + margin) << "] (95% CI)" << endl;
+    cout << "Average moves: " << (double)stats.total_moves / n << endl;
+    cout << "Elapsed: " << elapsed.count() << " s (" << std::setprecision(2) << n / elapsed.count()
+         << " games/sec, " << config.concurrency << " workers)" << endl;
+    return 0;
+}
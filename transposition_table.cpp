@@ -0,0 +1,123 @@
+#include "transposition_table.h"
+#include <climits>
+
+// Slot data layout (a slot whose data word is 0 is empty):
+//   bits 0-31  move (encodeMove)
+//   bits 32-47 score (int16)
+//   bits 48-55 depth
+//   bits 56-57 bound
+//   bits 58-63 generation
+static uint64_t packEntry(const TTEntry& entry, uint8_t generation) {
+    int score = std::max(-32768, std::min(32767, entry.score));
+    int depth = std::max(0, std::min(255, entry.depth));
+    return (uint64_t)entry.move
+         | ((uint64_t)(uint16_t)score << 32)
+         | ((uint64_t)depth << 48)
+         | ((uint64_t)(entry.bound & 3) << 56)
+         | ((uint64_t)(generation & 63) << 58);
+}
+
+static TTEntry unpackEntry(uint64_t data) {
+    TTEntry entry;
+    entry.move = (uint32_t)data;
+    entry.score = (int16_t)(uint16_t)(data >> 32);
+    entry.depth = (int)((data >> 48) & 0xFF);
+    entry.bound = (TTBound)((data >> 56) & 3);
+    return entry;
+}
+
+static inline int entryDepth(uint64_t data) { return (int)((data >> 48) & 0xFF); }
+static inline uint8_t entryGeneration(uint64_t data) { return (uint8_t)(data >> 58); }
+
+TranspositionTable::TranspositionTable(size_t megabytes) {
+    resize(megabytes);
+}
+
+void TranspositionTable::resize(size_t megabytes) {
+    size_t budget = (megabytes << 20) / sizeof(TTBucket);
+    size_t count = 1;
+    while (count * 2 <= budget) count *= 2;
+
+    buckets.reset(new TTBucket[count]);
+    num_buckets = count;
+    clear();
+}
+
+void TranspositionTable::clear() {
+    for (size_t b = 0; b < num_buckets; b++) {
+        for (int s = 0; s < TT_BUCKET_SLOTS; s++) {
+            buckets[b].slots[s].data.store(0, std::memory_order_relaxed);
+            buckets[b].slots[s].key_xor_data.store(0, std::memory_order_relaxed);
+        }
+    }
+    generation = 0;
+}
+
+bool TranspositionTable::probe(uint64_t key, TTEntry& out) const {
+    const TTBucket& bucket = buckets[key & (num_buckets - 1)];
+    for (int s = 0; s < TT_BUCKET_SLOTS; s++) {
+        const TTSlot& slot = bucket.slots[s];
+        uint64_t data = slot.data.load(std::memory_order_relaxed);
+        uint64_t check = slot.key_xor_data.load(std::memory_order_relaxed);
+        if (data != 0 && (check ^ data) == key) {
+            out = unpackEntry(data);
+            return true;
+        }
+    }
+    return false;
+}
+
+void TranspositionTable::store(uint64_t key, const TTEntry& entry) {
+    TTBucket& bucket = buckets[key & (num_buckets - 1)];
+    TTSlot* target = nullptr;
+    TTEntry to_store = entry;
+
+    // Same position already stored: overwrite unless it holds a clearly deeper result
+    // from this search, and keep its move if the new entry has none
+    for (int s = 0; s < TT_BUCKET_SLOTS && !target; s++) {
+        TTSlot& slot = bucket.slots[s];
+        uint64_t data = slot.data.load(std::memory_order_relaxed);
+        if (data == 0 || (slot.key_xor_data.load(std::memory_order_relaxed) ^ data) != key) continue;
+
+        if (entry.bound != TT_EXACT && entry.depth + 2 < entryDepth(data) && entryGeneration(data) == generation) {
+            return;
+        }
+        if (to_store.move == NO_ENCODED_MOVE) to_store.move = (uint32_t)data;
+        target = &slot;
+    }
+
+    // Otherwise replace an empty slot, else the shallowest entry, counting older searches as shallower
+    if (!target) {
+        int worst = INT_MAX;
+        for (int s = 0; s < TT_BUCKET_SLOTS; s++) {
+            TTSlot& slot = bucket.slots[s];
+            uint64_t data = slot.data.load(std::memory_order_relaxed);
+            if (data == 0) {
+                target = &slot;
+                break;
+            }
+            int age = (generation - entryGeneration(data)) & 63;
+            int value = entryDepth(data) - 8 * age;
+            if (value < worst) {
+                worst = value;
+                target = &slot;
+            }
+        }
+    }
+
+    uint64_t data = packEntry(to_store, generation);
+    target->data.store(data, std::memory_order_relaxed);
+    target->key_xor_data.store(key ^ data, std::memory_order_relaxed);
+}
+
+int TranspositionTable::hashfull() const {
+    size_t sample = std::min<size_t>(num_buckets, 250);
+    int used = 0;
+    for (size_t b = 0; b < sample; b++) {
+        for (int s = 0; s < TT_BUCKET_SLOTS; s++) {
+            uint64_t data = buckets[b].slots[s].data.load(std::memory_order_relaxed);
+            if (data != 0 && entryGeneration(data) == generation) used++;
+        }
+    }
+    return (int)(used * 1000 / (sample * TT_BUCKET_SLOTS));
+}
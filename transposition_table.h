@@ -0,0 +1,70 @@
+#ifndef TRANSPOSITION_TABLE_H
+#define TRANSPOSITION_TABLE_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include "game_logic.h"
+
+// Shared transposition table for search engines linking game_logic.o.
+//
+// Keyed on GameState::zobrist_key. Entries live in 4-slot buckets (64 bytes).
+// Each slot is two 64-bit words, the data and (key ^ data), so probe/store are
+// lock-free: a slot torn by a concurrent write fails the key check and reads
+// as a miss. Any number of search threads may probe and store at once;
+// resize/clear must not run concurrently with them.
+
+enum TTBound : uint8_t {
+    TT_NONE = 0,
+    TT_UPPER = 1,     // Score is an upper bound (fail low)
+    TT_LOWER = 2,     // Score is a lower bound (fail high)
+    TT_EXACT = 3
+};
+
+struct TTEntry {
+    uint32_t move = NO_ENCODED_MOVE;  // Best move, see encodeMove/decodeMove
+    int score = 0;                    // Clamped to int16 when stored
+    int depth = 0;                    // Clamped to 0-255 when stored
+    TTBound bound = TT_NONE;
+};
+
+const int TT_BUCKET_SLOTS = 4;
+
+struct TTSlot {
+    std::atomic<uint64_t> key_xor_data;
+    std::atomic<uint64_t> data;
+};
+
+struct TTBucket {
+    TTSlot slots[TT_BUCKET_SLOTS];
+};
+
+struct TranspositionTable {
+    explicit TranspositionTable(size_t megabytes = 16);
+
+    // Reallocate to the largest power-of-two bucket count within the budget (min 1 bucket).
+    // Clears the table.
+    void resize(size_t megabytes);
+    void clear();
+
+    // Call once per root search; older entries become preferred replacement victims
+    void newSearch() { generation = (generation + 1) & 63; }
+
+    bool probe(uint64_t key, TTEntry& out) const;
+    void store(uint64_t key, const TTEntry& entry);
+
+    bool probe(const GameState& state, TTEntry& out) const { return probe(state.zobrist_key, out); }
+    void store(const GameState& state, const TTEntry& entry) { store(state.zobrist_key, entry); }
+
+    // Permille of sampled slots written during the current search
+    int hashfull() const;
+
+    size_t sizeBytes() const { return num_buckets * sizeof(TTBucket); }
+
+    std::unique_ptr<TTBucket[]> buckets;
+    size_t num_buckets = 0;
+    uint8_t generation = 0;
+};
+
+#endif // TRANSPOSITION_TABLE_H
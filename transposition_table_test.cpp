@@ -0,0 +1,215 @@
+// Transposition Table Tests
+// Checks TranspositionTable against its contract: entries (encodeMove codes
+// included) round-trip, replacement prefers shallow and stale entries, a bucket
+// never holds more than TT_BUCKET_SLOTS positions, and concurrent probes never
+// return data stored under another key. Run by `make check`; exits non-zero on
+// any failure.
+
+#include <atomic>
+#include <thread>
+#include "game_logic.h"
+#include "transposition_table.h"
+
+using std::string;
+using std::vector;
+using std::cout;
+using std::cerr;
+using std::endl;
+
+static int failures = 0;
+
+static void check(bool ok, const string& what) {
+    if (!ok) {
+        cerr << "FAIL: " << what << endl;
+        failures++;
+    }
+}
+
+static TTEntry makeEntry(uint32_t move, int score, int depth, TTBound bound) {
+    TTEntry entry;
+    entry.move = move;
+    entry.score = score;
+    entry.depth = depth;
+    entry.bound = bound;
+    return entry;
+}
+
+static bool hasDepth(const TranspositionTable& tt, uint64_t key, int depth) {
+    TTEntry entry;
+    return tt.probe(key, entry) && entry.depth == depth;
+}
+
+// Keys that all land in bucket 0 of any table
+static uint64_t bucketZeroKey(int i) {
+    return (uint64_t)(i + 1) << 40;
+}
+
+// Every move of seeded positions survives store/probe and decodes back to itself
+static void testRoundTrip() {
+    TranspositionTable tt(4);
+    std::ostream null_os(nullptr);
+    long moves_checked = 0;
+    for (unsigned int seed = 1; seed <= 20; seed++) {
+        GameState state;
+        initializeGame(state, seed, builtinCards(), builtinNobles(), null_os);
+        std::mt19937 rng(seed);
+        for (int ply = 0; ply < 60 && !isGameOver(state); ply++) {
+            vector<Move> moves = findAllValidMoves(state);
+            if (moves.empty()) break;
+            for (size_t i = 0; i < moves.size(); i++) {
+                uint32_t code = encodeMove(moves[i]);
+                uint64_t key = state.zobrist_key ^ ((uint64_t)i * 0x9E3779B97F4A7C15ULL);
+                tt.store(key, makeEntry(code, (int)i - 50, ply % 40, TT_EXACT));
+                TTEntry entry;
+                bool found = tt.probe(key, entry);
+                check(found && entry.move == code, "move code round trip at seed " + std::to_string(seed));
+                if (found) {
+                    check(moveToString(toMove(decodeMove(entry.move), state.current_player)) ==
+                          moveToString(moves[i]), "decoded move differs: " + moveToString(moves[i]));
+                    check(entry.score == (int)i - 50 && entry.depth == ply % 40 && entry.bound == TT_EXACT,
+                          "score/depth/bound round trip");
+                }
+                moves_checked++;
+            }
+            applyMove(state, moves[rng() % moves.size()], null_os);
+        }
+    }
+    check(moves_checked > 1000, "too few moves checked");
+
+    // Out-of-range scores and depths are clamped, not wrapped
+    tt.clear();
+    TTEntry entry;
+    tt.store(1, makeEntry(7, 100000, 1000, TT_LOWER));
+    check(tt.probe(1, entry) && entry.score == 32767 && entry.depth == 255 && entry.bound == TT_LOWER,
+          "high score/depth clamp");
+    tt.store(2, makeEntry(7, -100000, -5, TT_UPPER));
+    check(tt.probe(2, entry) && entry.score == -32768 && entry.depth == 0 && entry.bound == TT_UPPER,
+          "low score/depth clamp");
+    check(!tt.probe(3, entry), "probe of a never-stored key hits");
+}
+
+static void testReplacement() {
+    TranspositionTable tt(0);           // A single bucket
+    check(tt.num_buckets == 1, "resize(0) should leave one bucket");
+    const uint64_t a = bucketZeroKey(0), b = bucketZeroKey(1), c = bucketZeroKey(2), d = bucketZeroKey(3);
+    const uint64_t e = bucketZeroKey(4), f = bucketZeroKey(5), g = bucketZeroKey(6), h = bucketZeroKey(7);
+
+    // Within a search the shallowest entry goes first
+    tt.store(a, makeEntry(1, 0, 10, TT_EXACT));
+    tt.store(b, makeEntry(2, 0, 9, TT_EXACT));
+    tt.store(c, makeEntry(3, 0, 8, TT_EXACT));
+    tt.store(d, makeEntry(4, 0, 7, TT_EXACT));
+    tt.store(e, makeEntry(5, 0, 1, TT_EXACT));
+    check(hasDepth(tt, a, 10) && hasDepth(tt, b, 9) && hasDepth(tt, c, 8) && hasDepth(tt, e, 1),
+          "same-search replacement evicted a deeper entry");
+    check(!hasDepth(tt, d, 7), "same-search replacement kept the shallowest entry");
+
+    // A much shallower bound for a stored position is ignored; an exact score is not.
+    // Storing without a move keeps the stored one.
+    tt.store(a, makeEntry(NO_ENCODED_MOVE, 0, 3, TT_LOWER));
+    check(hasDepth(tt, a, 10), "shallow bound overwrote a deeper entry of the same search");
+    tt.store(b, makeEntry(NO_ENCODED_MOVE, 5, 3, TT_EXACT));
+    TTEntry entry;
+    check(tt.probe(b, entry) && entry.depth == 3 && entry.score == 5 && entry.move == 2,
+          "exact overwrite or move preservation");
+    tt.store(b, makeEntry(2, 0, 9, TT_EXACT));
+
+    // After newSearch, older entries count as 8 plies shallower per search
+    tt.newSearch();
+    tt.store(f, makeEntry(6, 0, 20, TT_EXACT));     // Evicts e: 1 - 8
+    check(!hasDepth(tt, e, 1) && hasDepth(tt, f, 20), "aged shallow entry not evicted first");
+    tt.store(g, makeEntry(7, 0, 5, TT_EXACT));      // Evicts c: 8 - 8 < 9 - 8 < 10 - 8
+    check(!hasDepth(tt, c, 8) && hasDepth(tt, g, 5) && hasDepth(tt, a, 10) && hasDepth(tt, b, 9),
+          "aged entries not evicted shallowest first");
+    tt.store(a, makeEntry(NO_ENCODED_MOVE, 0, 3, TT_LOWER));
+    check(hasDepth(tt, a, 3) && tt.probe(a, entry) && entry.move == 1,
+          "shallow bound should replace an entry from an older search");
+
+    // Enough searches later, even a deep old entry loses to a shallow new one
+    tt.store(a, makeEntry(1, 0, 30, TT_EXACT));
+    tt.newSearch();
+    tt.newSearch();
+    tt.newSearch();
+    tt.newSearch();
+    tt.store(h, makeEntry(8, 0, 0, TT_EXACT));
+    check(hasDepth(tt, h, 0), "new entry not stored");
+    check(hasDepth(tt, a, 30), "deepest entry evicted while shallower old ones remained");
+    int kept = hasDepth(tt, b, 9) + hasDepth(tt, f, 20) + hasDepth(tt, g, 5);
+    check(kept == 2 && !hasDepth(tt, b, 9), "oldest shallow entry should be the victim");
+
+    check(tt.hashfull() > 0, "hashfull reports an empty table");
+    tt.clear();
+    check(!tt.probe(a, entry) && tt.hashfull() == 0, "clear left entries behind");
+}
+
+// A bucket holds at most TT_BUCKET_SLOTS positions; the latest store always lands,
+// and other buckets are untouched
+static void testBucketOverflow() {
+    TranspositionTable tt(1);
+    const uint64_t other = 1;           // Bucket 1
+    tt.store(other, makeEntry(99, 0, 4, TT_EXACT));
+    TTEntry entry;
+    for (int i = 0; i < 100; i++) {
+        tt.store(bucketZeroKey(i), makeEntry((uint32_t)i + 1, i, 4, TT_EXACT));
+        check(tt.probe(bucketZeroKey(i), entry) && entry.move == (uint32_t)i + 1, "latest store missing");
+        int hits = 0;
+        for (int j = 0; j <= i; j++) hits += tt.probe(bucketZeroKey(j), entry);
+        check(hits == std::min(i + 1, TT_BUCKET_SLOTS), "bucket holds " + std::to_string(hits) + " entries after " +
+              std::to_string(i + 1) + " stores");
+    }
+    check(tt.probe(other, entry) && entry.move == 99, "overflow of bucket 0 touched bucket 1");
+}
+
+// Entry fields derived from the key, so a probe can tell whose data it got
+static TTEntry entryForKey(uint64_t key) {
+    uint64_t mix = key * 0xD6E8FEB86659FD93ULL;
+    return makeEntry((uint32_t)(mix >> 32) | 1, (int16_t)(mix >> 16), (int)(mix & 0x3F), (TTBound)(1 + (mix >> 8) % 3));
+}
+
+// Threads hammer a small table (heavy bucket contention, constant eviction); every
+// hit must carry exactly the data stored for the probed key
+static void testConcurrentStress() {
+    TranspositionTable tt(1);
+    const int threads = std::max(4u, std::thread::hardware_concurrency());
+    const long ops_per_thread = 400000;
+    std::atomic<long> hits(0), wrong(0);
+    vector<std::thread> workers;
+    for (int t = 0; t < threads; t++) {
+        workers.emplace_back([&, t]() {
+            std::mt19937_64 rng(1000 + t);
+            long local_hits = 0, local_wrong = 0;
+            for (long i = 0; i < ops_per_thread; i++) {
+                // 2^20 keys over 16384 buckets: each bucket sees ~64 keys
+                uint64_t key = (rng() & 0xFFFFF) * 0x9E3779B97F4A7C15ULL;
+                if (rng() & 1) {
+                    tt.store(key, entryForKey(key));
+                    continue;
+                }
+                TTEntry entry;
+                if (!tt.probe(key, entry)) continue;
+                TTEntry expected = entryForKey(key);
+                local_hits++;
+                if (entry.move != expected.move || entry.score != expected.score || entry.depth != expected.depth ||
+                    entry.bound != expected.bound) {
+                    local_wrong++;
+                }
+            }
+            hits += local_hits;
+            wrong += local_wrong;
+        });
+    }
+    for (std::thread& worker : workers) worker.join();
+    check(hits > 0, "stress test never hit");
+    check(wrong == 0, std::to_string(wrong.load()) + " probes returned another key's data");
+    cout << "stress: " << threads << " threads, " << threads * ops_per_thread << " ops, " << hits << " hits, "
+         << wrong << " wrong" << endl;
+}
+
+int main() {
+    testRoundTrip();
+    testReplacement();
+    testBucketOverflow();
+    testConcurrentStress();
+    cout << (failures ? "FAILED" : "ok") << " (" << failures << " failures)" << endl;
+    return failures ? 1 : 0;
+}